@@ -0,0 +1,113 @@
+#!/bin/sh
+#
+# Runs the PSYC, JSON and XML parsers on the same packets and prints the
+# results as org tables, in the layout of the Results section of benchmark.org.
+#
+# Usage: compare.sh [-c count] [-x xmlbench]
+#
+# Run from test/ after building the test programs and the binary packets
+# (make bench-compare does both). Values are milliseconds for count packets,
+# binary packets are parsed fewer times and scaled to count. The test programs
+# report microseconds, so the scaled values keep their precision. Parsers whose
+# programs are not available are left out: test_json needs json-c, test_json_glib
+# json-glib, and the XML parsers need xmlbench (http://xmlbench.sourceforge.net/).
+
+count=1000000
+xmlbench=
+
+while getopts c:x: opt; do
+    case $opt in
+	c) count=$OPTARG ;;
+	x) xmlbench=$OPTARG ;;
+	*) echo "Usage: $0 [-c count] [-x xmlbench]" >&2; exit 1 ;;
+    esac
+done
+
+# name:command, the packet type is appended to the name to select its files
+codecs="strlen/*:./test_strlen
+libpsyc/psyc:./test_psyc_speed
+json-c/json:./test_json
+json-glib/json:./test_json_glib
+libxml sax/xml:$xmlbench/parse/libxml-sax
+libxml/xml:$xmlbench/parse/libxml
+rapidxml/xml:$xmlbench/parse/rapidxml"
+
+available=
+set -f
+IFS='
+'
+for c in $codecs; do
+    cmd=${c#*:}
+    if [ -x "$cmd" ]; then
+	available="$available$c
+"
+    else
+	echo "# skipping ${c%%/*}: $cmd not available" >&2
+    fi
+done
+unset IFS
+set +f
+
+# run <cmd> <file> <count> <scale>: print ms for count * scale parses
+run () {
+    case $1 in
+	./test_json*) "$1" -ssnc "$3" -f "$2" ;;
+	./test_*) "$1" -ssc "$3" -f "$2" ;;
+	*) "$1" "$3" "$2" ;;
+    esac 2>/dev/null | awk -v scale="$4" '
+	/^[0-9]+ us$/ { us = $1 }
+	/^[0-9]+( ms)?$/ { us = $1 * 1000 }
+	END {
+	    if (us == "") { print "-"; exit }
+	    ms = us * scale / 1000
+	    printf(ms < 100 ? "%.2f\n" : "%d\n", ms)
+	}'
+}
+
+# table <binary> <packets...>: one row per packet, one column per parser,
+# packets are given without extension
+table () {
+    binary=$1; shift
+
+    printf '| %-16s' ''
+    echo "$available" | while IFS= read -r c; do
+	[ -n "$c" ] && printf '| %12s ' "${c%%/*}"
+    done
+    echo '|'
+    echo '|-'
+
+    for p in "$@"; do
+	n=$count
+	scale=1
+	size=$(wc -c < "$p.psyc")
+	if [ "$binary" = 1 ] && [ "$size" -gt 7000 ]; then
+	    # parse large packets less often, scale the result to count packets
+	    scale=$((size / 7000))
+	    n=$((count / scale))
+	    [ "$n" -lt 1 ] && n=1 && scale=$count
+	fi
+
+	printf '| %-16s' "$(basename "$p")"
+	echo "$available" | while IFS= read -r c; do
+	    [ -z "$c" ] && continue
+	    type=${c%%:*}; type=${type#*/}; cmd=${c#*:}
+	    [ "$type" = '*' ] && type=psyc
+	    ms=-
+	    if [ -f "$p.$type" ]; then
+		ms=$(run "$cmd" "$p.$type" "$n" "$scale")
+	    fi
+	    printf '| %12s ' "$ms"
+	done
+	echo '|'
+    done
+    echo
+}
+
+dir=../bench/packets
+
+echo "Parsing time of $count packets, in milliseconds."
+echo
+table 0 $dir/user_profile $dir/psyc-unfriendly $dir/json-unfriendly $dir/xml-unfriendly
+table 0 $dir/presence $dir/presence-c $dir/chat_msg $dir/chat_msg-c \
+    $dir/activity $dir/activity-c
+table 1 $(ls $dir/binary/[0-9]*K.psyc 2>/dev/null | sed 's/\.psyc$//' | sort -t/ -k5 -n)
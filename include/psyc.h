@@ -78,7 +78,17 @@ typedef struct {
 #include "psyc/parse.h"
 #include "psyc/render.h"
 #include "psyc/text.h"
+#include "psyc/delta.h"
 #include "psyc/uniform.h"
+#include "psyc/window.h"
+#include "psyc/fragment.h"
+#include "psyc/forward.h"
+#include "psyc/arena.h"
+#include "psyc/builder.h"
+#include "psyc/compact.h"
+#include "psyc/skeleton.h"
+#include "psyc/modify.h"
+#include "psyc/tpack.h"
 
 #if 0                           /* keep Emacsens' auto-indent happy */
 {
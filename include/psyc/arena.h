@@ -0,0 +1,107 @@
+#ifndef PSYC_ARENA_H
+#define PSYC_ARENA_H
+
+/**
+ * @file psyc/arena.h
+ * @brief Interface for the bump allocator.
+ *
+ * Arena allocation functions are defined here.
+ */
+
+/**
+ * @defgroup arena Arena allocator
+ *
+ * A PsycArena hands out memory from large blocks by bumping a pointer.
+ * Nothing is freed individually, instead the whole arena is reset at once,
+ * e.g. after a packet has been sent. The blocks are kept for reuse,
+ * so after the first few packets no more memory is allocated at all.
+ *
+ * An arena is not thread-safe, use one per thread or per packet.
+ * @{
+ */
+
+#include <stddef.h>
+
+/**
+ * Alignment of memory returned by psyc_arena_alloc().
+ */
+#define PSYC_ARENA_ALIGN 16
+
+/**
+ * Default block size for psyc_arena_init().
+ */
+#define PSYC_ARENA_BLOCK_SIZE 4096
+
+/** Block of an arena. */
+typedef struct PsycArenaBlock {
+    struct PsycArenaBlock *next; ///< Next block.
+    size_t size;		///< Usable size of the block.
+    size_t used;		///< Number of bytes used.
+    char *data;			///< Memory of the block, right after the header.
+} PsycArenaBlock;
+
+/** Arena allocator. */
+typedef struct {
+    PsycArenaBlock *first;	///< First block.
+    PsycArenaBlock *current;	///< Block allocations are made from.
+    size_t block_size;		///< Minimum size of new blocks.
+} PsycArena;
+
+/**
+ * Initialize an arena.
+ *
+ * @param arena Arena to initialize.
+ * @param block_size Minimum size of the blocks allocated,
+ *                   e.g. PSYC_ARENA_BLOCK_SIZE.
+ */
+static inline void
+psyc_arena_init (PsycArena *arena, size_t block_size)
+{
+    arena->first = arena->current = NULL;
+    arena->block_size = block_size ? block_size : PSYC_ARENA_BLOCK_SIZE;
+}
+
+/**
+ * Allocate memory from an arena.
+ *
+ * @return Memory aligned to PSYC_ARENA_ALIGN,
+ *         or NULL if a new block could not be allocated.
+ */
+void *
+psyc_arena_alloc (PsycArena *arena, size_t size);
+
+/**
+ * Grow the memory of a previous allocation.
+ *
+ * The last allocation made from the arena is grown in place if there's room,
+ * otherwise new memory is allocated and the contents copied.
+ *
+ * @return The memory, or NULL if it could not be allocated.
+ */
+void *
+psyc_arena_realloc (PsycArena *arena, void *ptr, size_t oldsize,
+		    size_t newsize);
+
+/**
+ * Copy data to memory allocated from an arena.
+ */
+void *
+psyc_arena_copy (PsycArena *arena, const void *data, size_t size);
+
+/**
+ * Release all memory allocated from an arena at once.
+ *
+ * The blocks are kept and reused for subsequent allocations.
+ */
+void
+psyc_arena_reset (PsycArena *arena);
+
+/**
+ * Free the blocks of an arena.
+ */
+void
+psyc_arena_free (PsycArena *arena);
+
+/** @} */ // end of arena group
+
+#endif
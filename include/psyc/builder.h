@@ -0,0 +1,133 @@
+#ifndef PSYC_BUILDER_H
+#define PSYC_BUILDER_H
+
+/**
+ * @file psyc/builder.h
+ * @brief Interface for building packets.
+ *
+ * Functions for assembling packets without fixed size modifier arrays are
+ * defined here.
+ */
+
+/**
+ * @defgroup builder Packet builder
+ *
+ * A PsycBuilder collects the routing and entity modifiers of a packet in
+ * arrays that grow as needed, with all memory taken from a PsycArena.
+ * Lists and dicts are rendered into the arena as well.
+ * When done, it sets up a standard PsycPacket for psyc_render().
+ *
+ * @code
+ * PsycArena arena;
+ * psyc_arena_init(&arena, PSYC_ARENA_BLOCK_SIZE);
+ *
+ * // for each packet
+ * PsycBuilder b;
+ * psyc_builder_init(&b, &arena);
+ * psyc_builder_routing(&b, PSYC_OPERATOR_SET,
+ *                      PSYC_C2ARG("_target"), PSYC_C2ARG(target));
+ * psyc_builder_entity(&b, PSYC_OPERATOR_SET,
+ *                     PSYC_C2ARG("_nick"), PSYC_C2ARG(nick));
+ * psyc_builder_packet(&b, &packet, PSYC_C2ARG("_message_private"),
+ *                     PSYC_C2ARG(text), PSYC_STATE_NOOP,
+ *                     PSYC_PACKET_CHECK_LENGTH);
+ * psyc_render(&packet, buffer, sizeof(buffer));
+ * psyc_arena_reset(&arena);
+ * @endcode
+ *
+ * Names and values are referenced, not copied, unless they're rendered lists
+ * or dicts. Use psyc_arena_copy() for values that don't live long enough.
+ * @{
+ */
+
+#include "packet.h"
+#include "arena.h"
+
+/** Packet under construction. */
+typedef struct {
+    PsycArena *arena;		///< Arena the memory is taken from.
+    PsycHeader routing;		///< Routing modifiers added so far.
+    PsycHeader entity;		///< Entity modifiers added so far.
+    size_t routingmax;		///< Size of the routing modifier array.
+    size_t entitymax;		///< Size of the entity modifier array.
+} PsycBuilder;
+
+/**
+ * Initialize a builder for a new packet.
+ */
+static inline void
+psyc_builder_init (PsycBuilder *b, PsycArena *arena)
+{
+    *b = (PsycBuilder) {
+	.arena = arena,
+    };
+}
+
+/**
+ * Add a routing modifier.
+ *
+ * @return The modifier, or NULL if memory could not be allocated.
+ */
+PsycModifier *
+psyc_builder_routing (PsycBuilder *b, PsycOperator oper,
+		      char *name, size_t namelen,
+		      char *value, size_t valuelen);
+
+/**
+ * Add an entity modifier, its length flag is checked.
+ *
+ * @return The modifier, or NULL if memory could not be allocated.
+ */
+PsycModifier *
+psyc_builder_entity (PsycBuilder *b, PsycOperator oper,
+		     char *name, size_t namelen,
+		     char *value, size_t valuelen);
+
+/**
+ * Add an entity modifier with a list value.
+ *
+ * The list is rendered into the arena.
+ *
+ * @param b Builder.
+ * @param oper Operator.
+ * @param name Variable name, usually starting with _list.
+ * @param namelen Length of name.
+ * @param elems List elements.
+ * @param num_elems Number of elements.
+ *
+ * @return The modifier, or NULL if memory could not be allocated.
+ */
+PsycModifier *
+psyc_builder_list (PsycBuilder *b, PsycOperator oper,
+		   char *name, size_t namelen,
+		   PsycElem *elems, size_t num_elems);
+
+/**
+ * Add an entity modifier with a dict value.
+ *
+ * The dict is rendered into the arena.
+ *
+ * @return The modifier, or NULL if memory could not be allocated.
+ * @see psyc_builder_list()
+ */
+PsycModifier *
+psyc_builder_dict (PsycBuilder *b, PsycOperator oper,
+		   char *name, size_t namelen,
+		   PsycDictElem *elems, size_t num_elems);
+
+/**
+ * Initialize a packet with the modifiers added to the builder.
+ *
+ * The packet remains valid until the arena is reset.
+ *
+ * @see psyc_packet_init()
+ */
+void
+psyc_builder_packet (PsycBuilder *b, PsycPacket *packet,
+		     char *method, size_t methodlen,
+		     char *data, size_t datalen,
+		     char stateop, PsycPacketFlag flag);
+
+/** @} */ // end of builder group
+
+#endif
@@ -0,0 +1,204 @@
+#ifndef PSYC_COMPACT_H
+#define PSYC_COMPACT_H
+
+/**
+ * @file psyc/compact.h
+ * @brief Interface for compact keywords.
+ *
+ * Tables mapping method and variable names to compact keywords are defined here.
+ */
+
+/**
+ * @defgroup compact Compact keywords
+ *
+ * Compact keywords are short aliases for method and variable names,
+ * e.g. c for _context or np for _notice_presence, to make packets smaller.
+ * Both sides of a circuit have to agree on the aliases used,
+ * psyc_aliases contains a default set.
+ *
+ * A PsycAliasTable indexes an array of aliases in both directions:
+ * compact keywords (one or two lowercase letters) index an array directly,
+ * long names are looked up in a hash table. The position of an alias in the
+ * array is its ID.
+ *
+ * To render with compact keywords, set the aliases of the PsycRenderPolicy
+ * used for a circuit and render with psyc_render_append_policy().
+ * To expand compact keywords when parsing, use psyc_parse_alias() instead of
+ * psyc_parse().
+ *
+ * @code
+ * PsycAliasTable aliases;
+ * psyc_alias_table_init(&aliases, psyc_aliases, psyc_aliases_num);
+ *
+ * PsycRenderPolicy policy = PSYC_RENDER_POLICY_DEFAULT;
+ * policy.aliases = &aliases;
+ * psyc_render_append_policy(&packet, &buf, &out, &policy);
+ * @endcode
+ * @{
+ */
+
+#include "packet.h"
+#include "parse.h"
+
+/**
+ * Maximum number of aliases in a table.
+ */
+#define PSYC_ALIAS_MAX 255
+
+/**
+ * Number of slots in the long name hash table, a power of 2.
+ */
+#define PSYC_ALIAS_HASH_SIZE 512
+
+/**
+ * Number of possible compact keywords: a-z followed by nothing or a-z.
+ */
+#define PSYC_ALIAS_COMPACT_SLOTS (26 * 27)
+
+/**
+ * Returned as ID when there's no alias for a name.
+ */
+#define PSYC_ALIAS_NONE -1
+
+/**
+ * Return codes for psyc_alias_table_init().
+ */
+typedef enum {
+    /// Error, too many aliases.
+    PSYC_ALIAS_ERROR_FULL = -3,
+    /// Error, a compact keyword is not one or two lowercase letters,
+    /// or a name does not start with an underscore.
+    PSYC_ALIAS_ERROR_KEYWORD = -2,
+    /// Error, a name or compact keyword is used more than once.
+    PSYC_ALIAS_ERROR_DUPLICATE = -1,
+    /// Table is set up.
+    PSYC_ALIAS_SUCCESS = 0,
+} PsycAliasRC;
+
+/** Alias of a method or variable name. */
+typedef struct {
+    PsycString name;		///< Long name, e.g. _context.
+    PsycString compact;		///< Compact keyword, e.g. c.
+} PsycAlias;
+
+/** Alias lookup table. */
+typedef struct PsycAliasTable {
+    const PsycAlias *aliases;	///< Aliases, array provided by the caller.
+    size_t num;			///< Number of aliases.
+    /// ID + 1 of the alias for each compact keyword, 0 if unused.
+    uint8_t compact[PSYC_ALIAS_COMPACT_SLOTS];
+    /// ID + 1 of the alias for each hash of a long name, 0 if unused.
+    uint8_t name[PSYC_ALIAS_HASH_SIZE];
+} PsycAliasTable;
+
+/// Default aliases.
+extern const PsycAlias psyc_aliases[];
+extern const size_t psyc_aliases_num;
+
+/**
+ * Set up a table for an array of aliases.
+ *
+ * @param t Table to set up.
+ * @param aliases Array of aliases, it should remain valid as long as t is used.
+ * @param num Number of aliases, at most PSYC_ALIAS_MAX.
+ */
+PsycAliasRC
+psyc_alias_table_init (PsycAliasTable *t, const PsycAlias *aliases, size_t num);
+
+/**
+ * \internal
+ * Get the slot of a compact keyword.
+ *
+ * @return The slot, or -1 if it's not a valid compact keyword.
+ */
+static inline int
+psyc_alias_compact_slot (const char *keyword, size_t len)
+{
+    if (len < 1 || len > 2 || keyword[0] < 'a' || keyword[0] > 'z')
+	return -1;
+    if (len == 1)
+	return (keyword[0] - 'a') * 27;
+    if (keyword[1] < 'a' || keyword[1] > 'z')
+	return -1;
+    return (keyword[0] - 'a') * 27 + keyword[1] - 'a' + 1;
+}
+
+/**
+ * Get the ID of a compact keyword.
+ *
+ * @return The ID, or PSYC_ALIAS_NONE.
+ */
+static inline int
+psyc_alias_compact_id (const PsycAliasTable *t, const char *keyword, size_t len)
+{
+    int slot = psyc_alias_compact_slot(keyword, len);
+    return slot < 0 ? PSYC_ALIAS_NONE : t->compact[slot] - 1;
+}
+
+/**
+ * Get the ID of a long name.
+ *
+ * @return The ID, or PSYC_ALIAS_NONE.
+ */
+int
+psyc_alias_name_id (const PsycAliasTable *t, const char *name, size_t len);
+
+/**
+ * Get the ID of a long name or a compact keyword.
+ *
+ * @return The ID, or PSYC_ALIAS_NONE.
+ */
+static inline int
+psyc_alias_id (const PsycAliasTable *t, const char *name, size_t len)
+{
+    return len && name[0] == '_'
+	? psyc_alias_name_id(t, name, len)
+	: psyc_alias_compact_id(t, name, len);
+}
+
+/**
+ * Get the compact keyword for a long name.
+ *
+ * @return The compact keyword, or NULL if there's none.
+ */
+static inline const PsycString *
+psyc_alias_compact (const PsycAliasTable *t, const char *name, size_t len)
+{
+    int id = psyc_alias_name_id(t, name, len);
+    return id == PSYC_ALIAS_NONE ? NULL : &t->aliases[id].compact;
+}
+
+/**
+ * Get the long name for a compact keyword.
+ *
+ * @return The long name, or NULL if there's none.
+ */
+static inline const PsycString *
+psyc_alias_expand (const PsycAliasTable *t, const char *keyword, size_t len)
+{
+    int id = psyc_alias_compact_id(t, keyword, len);
+    return id == PSYC_ALIAS_NONE ? NULL : &t->aliases[id].name;
+}
+
+/**
+ * Parse the next part of a packet and expand compact keywords.
+ *
+ * Same as psyc_parse(), but when a modifier or the body is returned, name is
+ * set to the long name if it was a compact keyword in the table.
+ *
+ * @param state Parser state.
+ * @param t Alias table.
+ * @param oper Operator of the modifier.
+ * @param name Name of the modifier or the method.
+ * @param value Value of the modifier or the body.
+ * @param id If not NULL, set to the ID of name, or PSYC_ALIAS_NONE.
+ *
+ * @see psyc_parse()
+ */
+PsycParseRC
+psyc_parse_alias (PsycParseState *state, const PsycAliasTable *t, char *oper,
+		  PsycString *name, PsycString *value, int *id);
+
+/** @} */ // end of compact group
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef PSYC_DELTA_H
+#define PSYC_DELTA_H
+
+/**
+ * @file psyc/delta.h
+ * @brief Interface for state-diffing packet rendering.
+ *
+ * Functions for sending only the changes of persistent state are defined here.
+ */
+
+/**
+ * @defgroup delta State diffing
+ *
+ * This module keeps track of the persistent state last sent on a circuit and
+ * reduces the entity header of outgoing packets to the modifiers that actually
+ * change the state of the receiver.
+ *
+ * Persistent variables are passed in with the assign (=) operator,
+ * as if the complete value was sent every time.
+ * Unchanged variables are left out, lists that only grew or shrunk at the end
+ * are sent with the augment (+) or diminish (-) operator.
+ * Set (:) modifiers are transient and always passed through as they are.
+ *
+ * @code
+ * PsycDeltaVar vars[32];
+ * PsycDelta delta;
+ * psyc_delta_init(&delta, vars, PSYC_NUM_ELEM(vars));
+ *
+ * PsycModifier out[ENTITY_LINES + 32];
+ * psyc_delta_packet_init(&delta, &packet, routing, routinglen,
+ *                        entity, entitylen, out, PSYC_NUM_ELEM(out),
+ *                        PSYC_C2ARG("_notice_presence"), NULL, 0,
+ *                        PSYC_PACKET_CHECK_LENGTH);
+ * psyc_render(&packet, buffer, buflen);
+ * @endcode
+ *
+ * When the other side requests a resync with a ? state operation, call
+ * psyc_delta_resync(), the next packet then resets the state with the =
+ * state operation and contains all persistent variables.
+ * @{
+ */
+
+#include "packet.h"
+
+/**
+ * Return codes for psyc_delta_diff().
+ */
+typedef enum {
+    /// Error, output modifier array is too small.
+    PSYC_DELTA_ERROR_OUTPUT = -1,
+    /// Entity header is reduced to the changes.
+    PSYC_DELTA_SUCCESS = 0,
+} PsycDeltaRC;
+
+/** Persistent variable as last sent on a circuit. */
+typedef struct {
+    PsycString name;		///< Variable name, owned by the state.
+    PsycString value;		///< Value last sent, owned by the state.
+} PsycDeltaVar;
+
+/** Persistent state of a circuit. */
+typedef struct {
+    PsycDeltaVar *vars;		///< Variables, array provided by the caller.
+    size_t num_vars;		///< Number of variables in use.
+    size_t max_vars;		///< Size of the vars array.
+    void *garbage;		///< Replaced values still referenced by the output.
+    uint8_t resync;		///< Send the whole state with the next packet.
+} PsycDelta;
+
+/**
+ * Initialize the state of a circuit.
+ *
+ * @param delta State to initialize.
+ * @param vars Array for keeping the variables,
+ *             variables not fitting in here are always sent in full.
+ * @param max_vars Size of vars.
+ */
+void
+psyc_delta_init (PsycDelta *delta, PsycDeltaVar *vars, size_t max_vars);
+
+/**
+ * Free the memory held by the state of a circuit.
+ *
+ * Modifiers returned by the last psyc_delta_diff() call are not valid anymore
+ * after calling this.
+ */
+void
+psyc_delta_free (PsycDelta *delta);
+
+/**
+ * Request sending the whole state with the next packet.
+ *
+ * Call this when the other side sent a ? state operation
+ * or when it is otherwise unknown what state the other side has.
+ */
+static inline void
+psyc_delta_resync (PsycDelta *delta)
+{
+    delta->resync = PSYC_TRUE;
+}
+
+/**
+ * Reduce an entity header to the modifiers that change the persistent state.
+ *
+ * The output modifiers point either to the input or to memory held by delta,
+ * they remain valid until the next call with the same delta.
+ *
+ * @param delta State of the circuit.
+ * @param entity Entity modifiers of the packet to send.
+ * @param entitylen Number of entity modifiers.
+ * @param out Output array for the entity modifiers to render.
+ * @param outmax Size of out, entitylen + delta->num_vars is always enough.
+ * @param outlen Number of modifiers written to out.
+ * @param stateop Set to PSYC_STATE_RESET when the whole state is sent,
+ *                otherwise to PSYC_STATE_NOOP.
+ */
+PsycDeltaRC
+psyc_delta_diff (PsycDelta *delta, PsycModifier *entity, size_t entitylen,
+		 PsycModifier *out, size_t outmax, size_t *outlen,
+		 PsycStateOp *stateop);
+
+/**
+ * Initialize a packet with its entity header reduced to the state changes.
+ *
+ * @see psyc_delta_diff()
+ * @see psyc_packet_init()
+ */
+PsycDeltaRC
+psyc_delta_packet_init (PsycDelta *delta, PsycPacket *packet,
+			PsycModifier *routing, size_t routinglen,
+			PsycModifier *entity, size_t entitylen,
+			PsycModifier *out, size_t outmax,
+			char *method, size_t methodlen,
+			char *data, size_t datalen,
+			PsycPacketFlag flag);
+
+/** @} */ // end of delta group
+
+#endif
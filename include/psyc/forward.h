@@ -0,0 +1,133 @@
+#ifndef PSYC_FORWARD_H
+#define PSYC_FORWARD_H
+
+/**
+ * @file psyc/forward.h
+ * @brief Interface for forwarding packets without touching their content.
+ *
+ * Functions for relaying packets with a rewritten routing header are defined
+ * here.
+ */
+
+/**
+ * @defgroup forward Forwarding
+ *
+ * Relays only need to look at the routing header of a packet.
+ * psyc_forward() parses the routing header of a received packet, applies
+ * rewrites to its routing modifiers, e.g. a new _target or an added
+ * _source_relay, and renders the new routing header.
+ * The content is not parsed nor copied: it's returned as an iovec pointing to
+ * the receive buffer.
+ *
+ * When the content has a length and it has not been received completely,
+ * the number of bytes still to be read is returned as well, those can be moved
+ * from one socket to the other without passing through user space with
+ * psyc_forward_splice() on Linux.
+ *
+ * @code
+ * PsycModifier rewrite[1], routing[16];
+ * psyc_modifier_init(&rewrite[0], PSYC_OPERATOR_SET,
+ *                    PSYC_C2ARG("_target"), PSYC_C2ARG(target),
+ *                    PSYC_MODIFIER_ROUTING);
+ *
+ * ret = psyc_forward(buf, len, rewrite, 1, routing, 16,
+ *                    header, sizeof(header), iov, &consumed, &remaining);
+ * if (ret >= PSYC_FORWARD_COMPLETE) {
+ *     writev(out, iov, PSYC_FORWARD_IOV);
+ *     if (ret == PSYC_FORWARD_INCOMPLETE)
+ *         while (remaining
+ *                && (n = psyc_forward_splice(in, out, pipefd, remaining,
+ *                                            &piped)) > 0)
+ *             remaining -= n; // on EAGAIN wait for the sockets and retry
+ * }
+ * @endcode
+ * @{
+ */
+
+#include <sys/uio.h>
+
+#include "packet.h"
+
+/**
+ * Number of iovec entries written by psyc_forward().
+ */
+#define PSYC_FORWARD_IOV 2
+
+/**
+ * Return codes for psyc_forward().
+ */
+typedef enum {
+    /// Error, header buffer or routing modifier array is too small.
+    PSYC_FORWARD_ERROR_HEADER = -2,
+    /// Error in packet.
+    PSYC_FORWARD_ERROR = -1,
+    /// Packet is complete in the buffer.
+    PSYC_FORWARD_COMPLETE = 0,
+    /// Routing header is complete, but the rest of the packet is still to be
+    /// received.
+    PSYC_FORWARD_INCOMPLETE = 1,
+    /// Routing header is incomplete, try again with more data.
+    PSYC_FORWARD_INSUFFICIENT = 2,
+} PsycForwardRC;
+
+/**
+ * Parse the routing header of a packet and render it with rewrites applied.
+ *
+ * Rewrite modifiers replace the value of a routing modifier with the same name
+ * or are appended to the routing header if there's none.
+ *
+ * The first iovec entry points to the new routing header, the second one to
+ * the content and the packet delimiter as far as they are in the buffer.
+ *
+ * @param buffer Receive buffer starting with a packet.
+ * @param buflen Length of buffer.
+ * @param rewrite Routing modifiers to replace or add.
+ * @param rewritelen Number of rewrite modifiers.
+ * @param routing Array for the routing modifiers of the packet,
+ *                these point into buffer.
+ * @param routingmax Size of routing.
+ * @param header Buffer for the new routing header.
+ * @param headerlen Length of header buffer.
+ * @param iov Output iovec array, PSYC_FORWARD_IOV entries.
+ * @param consumed Set to the number of bytes of buffer used by the packet.
+ * @param remaining Set to the number of bytes of the packet not in buffer yet.
+ */
+PsycForwardRC
+psyc_forward (char *buffer, size_t buflen,
+	      PsycModifier *rewrite, size_t rewritelen,
+	      PsycModifier *routing, size_t routingmax,
+	      char *header, size_t headerlen,
+	      struct iovec *iov, size_t *consumed, size_t *remaining);
+
+#ifdef __linux__
+/**
+ * Move the rest of a packet from one file descriptor to another using splice().
+ *
+ * Data is moved through a pipe in the kernel without being copied to user
+ * space. Either in or out may be a socket, also a non-blocking one.
+ *
+ * The transfer may be short when in has no more data available or out is
+ * full. Bytes read from in but not written to out yet stay in the pipe, their
+ * number is kept in piped and they are written first by the next call with the
+ * same pipe. Call it again with len reduced by the return value until all of
+ * the packet is moved.
+ *
+ * @param in File descriptor to read from.
+ * @param out File descriptor to write to.
+ * @param pipefd Pipe used in between, as created by pipe().
+ * @param len Number of bytes still to be written to out,
+ *            including the ones in the pipe.
+ * @param piped Number of bytes in the pipe, 0 on the first call for a pipe.
+ *
+ * @return Number of bytes written to out, which is less than len on a short
+ *         transfer and 0 at the end of file of in.
+ *         -1 if nothing could be written, with errno set, e.g. to EAGAIN.
+ */
+ssize_t
+psyc_forward_splice (int in, int out, int pipefd[2], size_t len,
+		     size_t *piped);
+#endif
+
+/** @} */ // end of forward group
+
+#endif
@@ -0,0 +1,201 @@
+#ifndef PSYC_FRAGMENT_H
+#define PSYC_FRAGMENT_H
+
+/**
+ * @file psyc/fragment.h
+ * @brief Interface for packet fragmentation and reassembly.
+ *
+ * Functions for splitting the content of large packets into fragments and
+ * putting it back together are defined here.
+ */
+
+/**
+ * @defgroup fragment Fragmentation and reassembly
+ *
+ * A packet that is too large to be sent at once can be split into fragments.
+ * Each fragment is a packet on its own with the routing header of the original
+ * packet, a _fragment and an _amount_fragments routing variable, and a slice of
+ * the original content. Fragments always have a content length, since a slice
+ * can contain the packet delimiter.
+ *
+ * psyc_fragment_split() renders only the routing headers and returns iovecs
+ * pointing into the content, which is never copied.
+ *
+ * On the receiving side PsycReassembly collects the content of the fragments
+ * of a packet in an iovec chain without copying either, so the buffers of the
+ * received fragments have to be kept until reassembly is complete or given up.
+ * When all fragments are there, psyc_reassembly_parse_init() sets up a parser
+ * with PSYC_PARSE_START_AT_CONTENT for the reassembled content.
+ *
+ * @code
+ * struct iovec frags[64];
+ * PsycReassembly r;
+ * psyc_reassembly_init(&r, frags, PSYC_NUM_ELEM(frags), 1024 * 1024, 30);
+ *
+ * // for each fragment received, content parsed with PSYC_PARSE_ROUTING_ONLY
+ * if (psyc_reassembly_expired(&r, time(NULL)))
+ *     psyc_reassembly_reset(&r);
+ * if (psyc_reassembly_add(&r, fragment, amount, PSYC_S2ARG(content),
+ *                         time(NULL)) == PSYC_REASSEMBLY_COMPLETE) {
+ *     psyc_reassembly_parse_init(&r, &state, buffer, sizeof(buffer));
+ *     // parse the content with psyc_parse()
+ * }
+ * @endcode
+ * @{
+ */
+
+#include <sys/uio.h>
+
+#include "packet.h"
+#include "parse.h"
+#include "render.h"
+
+/**
+ * Number of iovec entries used per fragment by psyc_fragment_split().
+ */
+#define PSYC_FRAGMENT_IOV 4
+
+/**
+ * Maximum length of the fragment specific part of a fragment header:
+ * _fragment, _amount_fragments and the content length.
+ */
+#define PSYC_FRAGMENT_HEADER_MAX \
+    (sizeof(":_fragment\t\n:_amount_fragments\t\n\n") - 1 + 3 * 20)
+
+/**
+ * Return codes for psyc_reassembly_add().
+ */
+typedef enum {
+    /// Error, reassembly has timed out, call psyc_reassembly_reset().
+    PSYC_REASSEMBLY_ERROR_TIMEOUT = -5,
+    /// Error, the fragment would exceed the memory limit.
+    PSYC_REASSEMBLY_ERROR_MEMORY = -4,
+    /// Error, invalid fragment number or amount of fragments.
+    PSYC_REASSEMBLY_ERROR_FRAGMENT = -3,
+    /// Error, buffer is too small or reassembly is not complete yet.
+    PSYC_REASSEMBLY_ERROR = -2,
+    /// Fragment has been received already.
+    PSYC_REASSEMBLY_DUPLICATE = -1,
+    /// Fragment is added, more fragments are needed.
+    PSYC_REASSEMBLY_INCOMPLETE = 0,
+    /// All fragments are there.
+    PSYC_REASSEMBLY_COMPLETE = 1,
+} PsycReassemblyRC;
+
+/** Reassembly state of a packet. */
+typedef struct {
+    struct iovec *iov;		///< Fragments, array provided by the caller.
+    size_t max_fragments;	///< Size of the iov array.
+    size_t amount;		///< Number of fragments, 0 if not known yet.
+    size_t received;		///< Number of fragments received.
+    size_t length;		///< Length of the content received.
+    size_t max_length;		///< Memory limit for the content.
+    uint64_t timeout;		///< Time allowed for receiving all fragments.
+    uint64_t deadline;		///< Time the reassembly expires.
+} PsycReassembly;
+
+/**
+ * Split the content of a packet into fragments.
+ *
+ * The routing modifiers of the packet are rendered only once into headers,
+ * followed by the _fragment, _amount_fragments & content length part of each
+ * fragment.
+ *
+ * For each fragment PSYC_FRAGMENT_IOV entries are written to iov:
+ * the common routing header, the fragment header, the slice of the content and
+ * the packet delimiter, ready to be passed to writev() one fragment at a time.
+ *
+ * @param packet The packet to split, only the routing header and its length
+ *               are used.
+ * @param content Content of the packet without the packet delimiter,
+ *                either packet->content of a raw packet or as rendered by
+ *                psyc_render_content().
+ * @param contentlen Length of content.
+ * @param fragsize Maximum content length of a fragment.
+ * @param headers Buffer for the headers, packet->routinglen +
+ *                PSYC_FRAGMENT_HEADER_MAX bytes per fragment are enough.
+ * @param headerslen Length of headers buffer.
+ * @param iov Output iovec array, PSYC_FRAGMENT_IOV entries per fragment.
+ * @param iovlen Number of entries in iov.
+ * @param num Set to the number of fragments.
+ */
+PsycRenderRC
+psyc_fragment_split (PsycPacket *packet, char *content, size_t contentlen,
+		     size_t fragsize, char *headers, size_t headerslen,
+		     struct iovec *iov, size_t iovlen, size_t *num);
+
+/**
+ * Initialize a reassembly state.
+ *
+ * @param r Reassembly state to initialize.
+ * @param iov Array for the fragments.
+ * @param max_fragments Size of iov, the maximum number of fragments accepted.
+ * @param max_length Maximum length of the reassembled content.
+ * @param timeout Time allowed between the first fragment and the last one,
+ *                in the unit of the time passed to psyc_reassembly_add(),
+ *                0 for no timeout.
+ */
+void
+psyc_reassembly_init (PsycReassembly *r, struct iovec *iov,
+		      size_t max_fragments, size_t max_length,
+		      uint64_t timeout);
+
+/**
+ * Forget all fragments and start over.
+ *
+ * The buffers of the fragments received so far can be released after this.
+ */
+void
+psyc_reassembly_reset (PsycReassembly *r);
+
+/**
+ * Has the reassembly timed out?
+ */
+static inline PsycBool
+psyc_reassembly_expired (PsycReassembly *r, uint64_t now)
+{
+    return r->received && r->timeout && now >= r->deadline
+	? PSYC_TRUE : PSYC_FALSE;
+}
+
+/**
+ * Add a received fragment.
+ *
+ * @param r Reassembly state.
+ * @param fragment Value of _fragment, starting at 0.
+ * @param amount Value of _amount_fragments.
+ * @param content Content of the fragment, it's only referenced and has to be
+ *                kept until the reassembly is done or reset.
+ * @param contentlen Length of content.
+ * @param now Current time.
+ */
+PsycReassemblyRC
+psyc_reassembly_add (PsycReassembly *r, uint64_t fragment, uint64_t amount,
+		     char *content, size_t contentlen, uint64_t now);
+
+/**
+ * Copy the reassembled content to a buffer.
+ *
+ * @return PSYC_REASSEMBLY_COMPLETE, or PSYC_REASSEMBLY_ERROR if the buffer is
+ *         too small or fragments are missing.
+ */
+PsycReassemblyRC
+psyc_reassembly_gather (PsycReassembly *r, char *buffer, size_t buflen);
+
+/**
+ * Set up a parser for the reassembled content.
+ *
+ * The parser is initialized with PSYC_PARSE_START_AT_CONTENT.
+ * If the fragments are adjacent in memory the content is parsed in place,
+ * otherwise it is gathered into buffer first.
+ *
+ * @return PSYC_REASSEMBLY_COMPLETE, or PSYC_REASSEMBLY_ERROR if the buffer is
+ *         too small or fragments are missing.
+ */
+PsycReassemblyRC
+psyc_reassembly_parse_init (PsycReassembly *r, PsycParseState *state,
+			    char *buffer, size_t buflen);
+
+/** @} */ // end of fragment group
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef PSYC_MODIFY_H
+#define PSYC_MODIFY_H
+
+/**
+ * @file psyc/modify.h
+ * @brief Interface for re-rendering parsed and modified packets.
+ *
+ * Functions for changing a few modifiers of a received packet and rendering it
+ * again are defined here.
+ */
+
+/**
+ * @defgroup modify Modified packets
+ *
+ * Relays often parse a packet, change a modifier and render it again.
+ * PsycModPacket keeps the source bytes of each parsed modifier: when
+ * rendering, modifiers that did not change are copied from the original
+ * buffer as they are, only changed and added ones are rendered, and the
+ * content length is recalculated. The result is the same as psyc_render()
+ * would produce for the packet.
+ *
+ * Modifiers can be changed in place as long as the original buffer stays
+ * valid, a modifier counts as changed once its operator, name, value or
+ * length flag differ from the source bytes.
+ *
+ * @code
+ * PsycModifier routing[16], entity[32];
+ * PsycString routing_raw[16], entity_raw[32];
+ * PsycModPacket mp;
+ * psyc_modpacket_init(&mp, routing, routing_raw, 16, entity, entity_raw, 32);
+ *
+ * if (psyc_modpacket_parse(&mp, buffer, buflen, PSYC_PARSE_ROUTING_ONLY)
+ *     == PSYC_PARSE_COMPLETE) {
+ *     PsycModifier *m = psyc_modpacket_find(&mp, PSYC_C2ARG("_target"));
+ *     psyc_modpacket_set(&mp, m, PSYC_C2ARG("psyc://example.net/~bob"));
+ *     psyc_modpacket_render(&mp, out, outlen);
+ * }
+ * @endcode
+ * @{
+ */
+
+#include "packet.h"
+#include "parse.h"
+#include "render.h"
+
+/** Parsed packet with the source bytes of its modifiers. */
+typedef struct {
+    PsycPacket packet;		///< Parsed packet.
+    PsycString *routing_raw;	///< Source bytes of each routing modifier.
+    PsycString *entity_raw;	///< Source bytes of each entity modifier.
+    size_t routingmax;		///< Size of the routing arrays.
+    size_t entitymax;		///< Size of the entity arrays.
+} PsycModPacket;
+
+/**
+ * Initialize a modified packet.
+ *
+ * @param mp Packet to initialize.
+ * @param routing Array for the routing modifiers.
+ * @param routing_raw Array for the source bytes of the routing modifiers.
+ * @param routingmax Size of the routing arrays.
+ * @param entity Array for the entity modifiers.
+ * @param entity_raw Array for the source bytes of the entity modifiers.
+ * @param entitymax Size of the entity arrays.
+ */
+void
+psyc_modpacket_init (PsycModPacket *mp,
+		     PsycModifier *routing, PsycString *routing_raw,
+		     size_t routingmax,
+		     PsycModifier *entity, PsycString *entity_raw,
+		     size_t entitymax);
+
+/**
+ * Parse a complete packet.
+ *
+ * The modifiers point to the buffer, it has to stay valid until the packet
+ * is rendered.
+ *
+ * @param mp Packet initialized with psyc_modpacket_init().
+ * @param buffer Buffer containing a complete packet.
+ * @param buflen Length of buffer.
+ * @param flags Parser flags, with PSYC_PARSE_ROUTING_ONLY the content is kept
+ *              as raw content.
+ *
+ * @return PSYC_PARSE_COMPLETE, PSYC_PARSE_INSUFFICIENT if the packet is
+ *         incomplete, or a parse error. PSYC_PARSE_ERROR is also returned if
+ *         the packet has more modifiers than the arrays can hold.
+ */
+PsycParseRC
+psyc_modpacket_parse (PsycModPacket *mp, char *buffer, size_t buflen,
+		      PsycParseFlag flags);
+
+/**
+ * Find a modifier by name, routing modifiers are looked up first.
+ *
+ * @return The modifier, or NULL if not found.
+ */
+PsycModifier *
+psyc_modpacket_find (PsycModPacket *mp, const char *name, size_t namelen);
+
+/**
+ * Set the value of a modifier.
+ *
+ * Whether an entity modifier needs a length is checked again.
+ */
+void
+psyc_modpacket_set (PsycModPacket *mp, PsycModifier *m,
+		    char *value, size_t valuelen);
+
+/**
+ * Add a modifier.
+ *
+ * It's added to the routing header if flag is PSYC_MODIFIER_ROUTING,
+ * otherwise to the entity header.
+ *
+ * @return The modifier, or NULL if the header is full.
+ */
+PsycModifier *
+psyc_modpacket_add (PsycModPacket *mp, PsycOperator oper,
+		    char *name, size_t namelen,
+		    char *value, size_t valuelen, PsycModifierFlag flag);
+
+/**
+ * Remove a modifier.
+ *
+ * Modifiers after it are moved, pointers to them are not valid anymore.
+ */
+void
+psyc_modpacket_remove (PsycModPacket *mp, PsycModifier *m);
+
+/**
+ * Render a modified packet.
+ *
+ * Unchanged modifiers are copied from their source bytes, the lengths of the
+ * packet are recalculated. A content length is added if the content did not
+ * have one but a modifier in it needs a length now.
+ *
+ * @return PSYC_RENDER_ERROR if the buffer is too small, or another
+ *         PsycRenderRC error if the packet is invalid.
+ */
+PsycRenderRC
+psyc_modpacket_render (PsycModPacket *mp, char *buffer, size_t buflen);
+
+/** @} */ // end of modify group
+
+#endif
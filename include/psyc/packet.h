@@ -16,8 +16,6 @@
  * @{
  */
 
-#include <math.h>
-
 #include "method.h"
 
 /**
@@ -56,6 +54,61 @@
 # define PSYC_ELEM_SIZE_THRESHOLD 9
 #endif
 
+/** Render policy modes. */
+typedef enum {
+    /// Add lengths only where the thresholds require them,
+    /// which results in the smallest packets.
+    PSYC_POLICY_COMPACT = 0,
+    /// Also add lengths to all values and content larger than skip_size,
+    /// so that the receiver can skip over them instead of scanning for their end.
+    PSYC_POLICY_RECEIVER_COST = 1,
+} PsycPolicyMode;
+
+/**
+ * Render policy, decides which values are rendered with a length.
+ *
+ * Pass it to psyc_render_append_policy() or psyc_packet_init_policy(),
+ * the compile time thresholds above are used by default.
+ */
+typedef struct {
+    size_t modifier_threshold;	///< Modifier size after which a length is added.
+    size_t elem_threshold;	///< Element size after which a length is added.
+    size_t content_threshold;	///< Data size after which a content length is added.
+    size_t skip_size;		///< Size after which a length is always added
+				///< in receiver-cost mode.
+    PsycPolicyMode mode;	///< Policy mode.
+    /// If set, names are rendered as compact keywords where possible.
+    /// @see compact
+    const struct PsycAliasTable *aliases;
+} PsycRenderPolicy;
+
+#define PSYC_RENDER_POLICY(mod, elem, cont, skip, md)		\
+    (PsycRenderPolicy) {					\
+	.modifier_threshold = mod,				\
+	.elem_threshold = elem,					\
+	.content_threshold = cont,				\
+	.skip_size = skip,					\
+	.mode = md,						\
+    }
+
+/** Render policy using the compile time thresholds. */
+#define PSYC_RENDER_POLICY_DEFAULT					\
+    PSYC_RENDER_POLICY(PSYC_MODIFIER_SIZE_THRESHOLD, PSYC_ELEM_SIZE_THRESHOLD, \
+		       PSYC_CONTENT_SIZE_THRESHOLD, 0, PSYC_POLICY_COMPACT)
+
+/**
+ * Get the size after which a length is added according to a policy.
+ *
+ * @param policy Render policy.
+ * @param threshold One of the thresholds of the policy.
+ */
+static inline size_t
+psyc_policy_threshold (const PsycRenderPolicy *policy, size_t threshold)
+{
+    return policy->mode == PSYC_POLICY_RECEIVER_COST
+	&& policy->skip_size < threshold ? policy->skip_size : threshold;
+}
+
 #define PSYC_PACKET_DELIMITER_CHAR '|'
 #define PSYC_PACKET_DELIMITER	   "\n|\n"
 
@@ -226,30 +279,88 @@ typedef struct {
     PsycPacketFlag flag;	///< Packet flag.
 } PsycPacket;
 
+/**
+ * Set up a packet without calculating its lengths.
+ *
+ * The lengths are set by psyc_render_append(),
+ * or call psyc_packet_length_set() to use it with the other renderers.
+ */
+#define PSYC_PACKET(rout, routlen, ent, entlen, meth, methlen,		\
+		    dat, datlen, op, flg)				\
+    (PsycPacket) {							\
+	.routing = {routlen, rout},					\
+	.entity = {entlen, ent},					\
+	.method = PSYC_STRING(meth, methlen),				\
+	.data = PSYC_STRING(dat, datlen),				\
+	.stateop = op,							\
+	.flag = flg,							\
+    }
+
 /**
  * Return the number of digits a number has in its base 10 representation.
+ *
+ * The digit count is estimated from the bit length, log10(2) ~ 1233 / 4096,
+ * then corrected with a table of powers of 10.
  */
 static inline size_t
-psyc_num_length (size_t n)
+psyc_num_length (uint64_t n)
 {
-    return n < 10 ? 1 : log10(n) + 1;
+#ifdef __GNUC__
+    static const uint64_t pow10[20] = {
+	0, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+	10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+	100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+	100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+	100000000000000000ULL, 1000000000000000000ULL,
+	10000000000000000000ULL,
+    };
+    size_t t = (64 - __builtin_clzll(n | 1)) * 1233 >> 12;
+    return t + (n >= pow10[t]);
+#else
+    size_t len = 1;
+
+    for (;;) {
+	if (n < 10)
+	    return len;
+	if (n < 100)
+	    return len + 1;
+	if (n < 1000)
+	    return len + 2;
+	if (n < 10000)
+	    return len + 3;
+	n /= 10000;
+	len += 4;
+    }
+#endif
 }
 
 /**
  * \internal
- * Check if a modifier needs length.
+ * Check if a modifier needs length according to a render policy.
  */
 static inline PsycModifierFlag
-psyc_modifier_length_check (PsycModifier *m)
+psyc_modifier_length_check_policy (PsycModifier *m,
+				   const PsycRenderPolicy *policy)
 {
     if (m->value.length > 0
-	&& (m->value.length > PSYC_MODIFIER_SIZE_THRESHOLD
+	&& (m->value.length > psyc_policy_threshold(policy,
+						    policy->modifier_threshold)
 	    || memchr(m->value.data, (int) '\n', m->value.length)))
 	return PSYC_MODIFIER_NEED_LENGTH;
 
     return PSYC_MODIFIER_NO_LENGTH;
 }
 
+/**
+ * \internal
+ * Check if a modifier needs length using the default policy.
+ */
+static inline PsycModifierFlag
+psyc_modifier_length_check (PsycModifier *m)
+{
+    return psyc_modifier_length_check_policy(m, &PSYC_RENDER_POLICY_DEFAULT);
+}
+
 /** Initialize modifier */
 static inline void
 psyc_modifier_init (PsycModifier *m, PsycOperator oper,
@@ -274,6 +385,14 @@ psyc_modifier_init (PsycModifier *m, PsycOperator oper,
 PsycElemFlag
 psyc_elem_length_check (PsycString *value, const char end);
 
+/**
+ * \internal
+ * Check if a list/dict element needs length according to a render policy.
+ */
+PsycElemFlag
+psyc_elem_length_check_policy (PsycString *value, const char end,
+			       const PsycRenderPolicy *policy);
+
 /**
  * \internal
  * Get the rendered length of a list/dict element.
@@ -295,6 +414,14 @@ psyc_dict_key_length (PsycDictKey *elem);
 size_t
 psyc_list_length_set (PsycList *list);
 
+/**
+ * \internal
+ * Get the rendered length of a list, deciding which elements need length
+ * according to a render policy.
+ */
+size_t
+psyc_list_length_set_policy (PsycList *list, const PsycRenderPolicy *policy);
+
 /**
  * \internal
  * Get the rendered length of a dict.
@@ -302,6 +429,14 @@ psyc_list_length_set (PsycList *list);
 size_t
 psyc_dict_length_set (PsycDict *dict);
 
+/**
+ * \internal
+ * Get the rendered length of a dict, deciding which elements need length
+ * according to a render policy.
+ */
+size_t
+psyc_dict_length_set_policy (PsycDict *dict, const PsycRenderPolicy *policy);
+
 /**
  * \internal
  * Get the rendered length of a modifier.
@@ -316,6 +451,17 @@ psyc_modifier_length (PsycModifier *m);
 PsycPacketFlag
 psyc_packet_length_check (PsycPacket *p);
 
+/**
+ * \internal
+ * Check if a packet needs length according to a render policy.
+ *
+ * Entity modifiers flagged with PSYC_MODIFIER_CHECK_LENGTH are checked with
+ * the policy as well, the result is the flag psyc_render_append_policy() sets.
+ * The packet is not modified.
+ */
+PsycPacketFlag
+psyc_packet_length_check_policy (PsycPacket *p, const PsycRenderPolicy *policy);
+
 /**
  * Calculate and set the rendered length of packet parts and total packet length.
  */
@@ -339,6 +485,23 @@ psyc_packet_init (PsycPacket *packet,
 		  char *data, size_t datalen,
 		  char stateop, PsycPacketFlag flag);
 
+/**
+ * Initialize a packet, deciding where lengths are needed according to a render
+ * policy.
+ *
+ * Entity modifiers flagged with PSYC_MODIFIER_CHECK_LENGTH are set to need a
+ * length or not, so that psyc_render() renders the packet as
+ * psyc_render_append_policy() would, except for compact names.
+ */
+void
+psyc_packet_init_policy (PsycPacket *packet,
+			 PsycModifier *routing, size_t routinglen,
+			 PsycModifier *entity, size_t entitylen,
+			 char *method, size_t methodlen,
+			 char *data, size_t datalen,
+			 char stateop, PsycPacketFlag flag,
+			 const PsycRenderPolicy *policy);
+
 /** Initialize packet with raw content. */
 void
 psyc_packet_init_raw (PsycPacket *packet,
@@ -346,6 +509,17 @@ psyc_packet_init_raw (PsycPacket *packet,
 		      char *content, size_t contentlen,
 		      PsycPacketFlag flag);
 
+/**
+ * Initialize packet with raw content, deciding if it needs a length according
+ * to a render policy.
+ */
+void
+psyc_packet_init_raw_policy (PsycPacket *packet,
+			     PsycModifier *routing, size_t routinglen,
+			     char *content, size_t contentlen,
+			     PsycPacketFlag flag,
+			     const PsycRenderPolicy *policy);
+
 void
 psyc_packet_id (PsycList *list, PsycElem *elems,
 		char *context, size_t contextlen,
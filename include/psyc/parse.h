@@ -212,6 +212,36 @@ typedef enum {
     PSYC_PART_END = 5,
 } PsycPart;
 
+#ifdef PSYC_PARSE_STATS
+/// Size of PsycParseStats.errors, the error codes of psyc_parse() are -1 to -10.
+#define PSYC_PARSE_STATS_ERRORS 11
+
+/**
+ * Counters of the packet parser.
+ *
+ * Only available when both libpsyc and the application are compiled with
+ * -DPSYC_PARSE_STATS (make stats), as they change the size of PsycParseState.
+ *
+ * @see psyc_parse_stats()
+ * @see psyc_parse_stats_global()
+ */
+typedef struct {
+    /// Bytes scanned per PsycPart, including bytes scanned again after a rewind.
+    size_t bytes[PSYC_PART_END + 1];
+    /// Number of times PSYC_PARSE_INSUFFICIENT was returned.
+    size_t rewinds;
+    /// Bytes scanned before PSYC_PARSE_INSUFFICIENT was returned,
+    /// which have to be scanned again with the next buffer.
+    size_t rescanned;
+    /// Values with a length: binary modifiers & bodies.
+    size_t binary;
+    /// Values without a length, which were searched for their end.
+    size_t simple;
+    /// Number of errors, indexed by the negated PsycParseRC.
+    size_t errors[PSYC_PARSE_STATS_ERRORS];
+} PsycParseStats;
+#endif
+
 /**
  * The return value definitions for the list parsing function.
  * @see psyc_parse_list()
@@ -419,6 +449,12 @@ typedef struct {
     uint8_t flags;		///< Flags for the parser, see PsycParseFlag.
     uint8_t contentlen_found;	///< Is there a length given for this packet?
     uint8_t valuelen_found;	///< Is there a length given for this modifier?
+
+#ifdef PSYC_PARSE_STATS
+    PsycParseStats stats;	///< Counters of this parser.
+    size_t stats_cursor;	///< Position up to which bytes were counted.
+    PsycPart stats_part;	///< Part the following bytes are counted for.
+#endif
 } PsycParseState;
 
 /**
@@ -515,6 +551,9 @@ psyc_parse_buffer_set (PsycParseState *state, const char *buffer, size_t length)
 {
     state->buffer = (PsycString) {length, (char*)buffer};
     state->cursor = 0;
+#ifdef PSYC_PARSE_STATS
+    state->stats_cursor = 0;
+#endif
 
     if (state->flags & PSYC_PARSE_START_AT_CONTENT) {
 	state->contentlen = length;
@@ -673,6 +712,34 @@ PsycParseRC
 psyc_parse (PsycParseState *state, char *oper,
 	    PsycString *name, PsycString *value);
 
+#ifdef PSYC_PARSE_STATS
+/**
+ * Get the counters of a parser state.
+ *
+ * The counters are kept until the state is initialized again.
+ */
+static inline void
+psyc_parse_stats (const PsycParseState *state, PsycParseStats *stats)
+{
+    *stats = state->stats;
+}
+
+/**
+ * Get a snapshot of the counters of all parser states in the process.
+ *
+ * Each counter is read atomically, but parsers running in other threads may
+ * update some of them in between.
+ */
+void
+psyc_parse_stats_global (PsycParseStats *stats);
+
+/**
+ * Reset the counters of all parser states in the process to zero.
+ */
+void
+psyc_parse_stats_global_reset (void);
+#endif
+
 /**
  * List parser.
  *
@@ -1,6 +1,8 @@
 #ifndef PSYC_RENDER_H
 #define PSYC_RENDER_H
 
+#include <sys/uio.h>
+
 #include "packet.h"
 
 /**
@@ -29,8 +31,24 @@ typedef enum {
     PSYC_RENDER_ERROR = -1,
     /// Packet is rendered successfully in the buffer.
     PSYC_RENDER_SUCCESS = 0,
+    /// Buffer is full, set a new buffer and call psyc_render_stream() again.
+    PSYC_RENDER_INCOMPLETE = 1,
 } PsycRenderRC;
 
+/**
+ * Struct for keeping the state of psyc_render_stream().
+ */
+typedef struct {
+    PsycPacket *packet;		///< Packet to render.
+    PsycString buffer;		///< Output buffer.
+    size_t written;		///< Number of bytes written to buffer.
+    size_t offset;		///< Number of bytes of the packet rendered so far.
+    uint8_t part;		///< Part of the packet to continue at.
+    uint8_t field;		///< Field of the part to continue at.
+    size_t index;		///< Modifier of the part to continue at.
+    size_t pos;			///< Bytes of the field rendered already.
+} PsycRenderState;
+
 /**
  * Render a PSYC packet into a buffer.
  *
@@ -51,6 +69,294 @@ static inline
 PsycRenderRC
 psyc_render (PsycPacket *packet, char *buffer, size_t buflen);
 
+/**
+ * Initialize the state for rendering a packet with psyc_render_stream().
+ *
+ * The packet should have its lengths set like for psyc_render().
+ */
+static inline void
+psyc_render_state_init (PsycRenderState *state, PsycPacket *packet)
+{
+    memset(state, 0, sizeof(PsycRenderState));
+    state->packet = packet;
+}
+
+/**
+ * Set the output buffer for psyc_render_stream().
+ */
+static inline void
+psyc_render_buffer_set (PsycRenderState *state, char *buffer, size_t length)
+{
+    state->buffer = (PsycString) {length, buffer};
+    state->written = 0;
+}
+
+/**
+ * Number of bytes written to the current buffer.
+ */
+static inline size_t
+psyc_render_bytes_written (PsycRenderState *state)
+{
+    return state->written;
+}
+
+/**
+ * Render a packet into buffers of limited size.
+ *
+ * Renders as much of the packet as fits in the buffer and returns
+ * PSYC_RENDER_INCOMPLETE if it's full. After sending the buffer contents set a
+ * new buffer with psyc_render_buffer_set(), or the same one again, then call
+ * this function again to continue exactly where it left off, even in the
+ * middle of a value.
+ *
+ * @code
+ * psyc_render_state_init(&state, &packet);
+ * do {
+ *     psyc_render_buffer_set(&state, buffer, sizeof(buffer));
+ *     ret = psyc_render_stream(&state);
+ *     write(fd, buffer, psyc_render_bytes_written(&state));
+ * } while (ret == PSYC_RENDER_INCOMPLETE);
+ * @endcode
+ *
+ * @return PSYC_RENDER_SUCCESS when the whole packet has been rendered,
+ *         PSYC_RENDER_INCOMPLETE if the buffer is full,
+ *         PSYC_RENDER_ERROR if the buffer is empty,
+ *         or another error if the packet is invalid.
+ */
+PsycRenderRC
+psyc_render_stream (PsycRenderState *state);
+
+/** Growable output buffer for psyc_render_append(). */
+typedef struct {
+    char *data;			///< Buffer, allocated with malloc().
+    size_t length;		///< Number of bytes used.
+    size_t size;		///< Number of bytes allocated.
+} PsycBuffer;
+
+/**
+ * Initialize an empty buffer, memory is allocated when needed.
+ */
+static inline void
+psyc_buffer_init (PsycBuffer *buf)
+{
+    *buf = (PsycBuffer) {0, 0, 0};
+}
+
+/**
+ * Free the memory of a buffer.
+ */
+void
+psyc_buffer_free (PsycBuffer *buf);
+
+/**
+ * Space reserved for the content length & NL by psyc_render_append().
+ */
+#define PSYC_RENDER_LENGTH_MAX 21
+
+/**
+ * Render a packet into a growable buffer in a single pass.
+ *
+ * Unlike psyc_render(), the lengths of the packet don't have to be set before:
+ * whether modifiers and the content need a length is decided, and the parts
+ * are copied, in one traversal of the packet. Space for the content length is
+ * reserved in front of the routing header and the length is filled in when the
+ * content is done, then the routing header is moved next to it.
+ * So a packet can be set up without psyc_packet_init(), e.g. with
+ * PSYC_PACKET(), avoiding the separate length calculation pass.
+ *
+ * The packet is appended to the buffer, it starts up to
+ * PSYC_RENDER_LENGTH_MAX bytes after the previous end of the buffer.
+ * The lengths of the packet are set as psyc_packet_length_set() would do.
+ *
+ * @param packet The packet to render.
+ * @param buf Buffer to append the packet to, grown as needed.
+ * @param out Set to the rendered packet in buf.
+ *
+ * @return PSYC_RENDER_ERROR if memory could not be allocated.
+ */
+PsycRenderRC
+psyc_render_append (PsycPacket *packet, PsycBuffer *buf, PsycString *out);
+
+/**
+ * Render a packet into a growable buffer, deciding where lengths are needed
+ * according to a render policy.
+ *
+ * Only modifiers flagged with PSYC_MODIFIER_CHECK_LENGTH and packets flagged
+ * with PSYC_PACKET_CHECK_LENGTH are affected by the policy.
+ * With PSYC_POLICY_RECEIVER_COST, more bytes are sent, but the receiver can
+ * skip over values larger than skip_size, and a routing-only receiver over the
+ * whole content.
+ *
+ * @see psyc_render_append()
+ */
+PsycRenderRC
+psyc_render_append_policy (PsycPacket *packet, PsycBuffer *buf,
+			   PsycString *out, const PsycRenderPolicy *policy);
+
+/**
+ * Render a PSYC list into a growable buffer in a single pass.
+ *
+ * Unlike psyc_list_init() followed by psyc_render_list(), the elements are
+ * only traversed once: elements flagged with PSYC_ELEM_CHECK_LENGTH get a
+ * length if they are larger than the element threshold of the policy,
+ * smaller ones are checked for the | delimiter while they are copied and get
+ * a length inserted if it's found.
+ *
+ * The flags & lengths of the elements and the length of the list are set
+ * as psyc_list_length_set_policy() would do, so the list can be used with the
+ * other renderers afterwards.
+ *
+ * @param list The list to render.
+ * @param buf Buffer to append the list to, grown as needed.
+ * @param out Set to the rendered list in buf.
+ * @param policy Render policy, e.g. &PSYC_RENDER_POLICY_DEFAULT.
+ *
+ * @return PSYC_RENDER_ERROR if memory could not be allocated.
+ */
+PsycRenderRC
+psyc_render_list_append (PsycList *list, PsycBuffer *buf, PsycString *out,
+			 const PsycRenderPolicy *policy);
+
+/**
+ * Render a PSYC dict into a growable buffer in a single pass.
+ *
+ * Keys are checked for } and values for { while they are copied.
+ *
+ * @see psyc_render_list_append()
+ */
+PsycRenderRC
+psyc_render_dict_append (PsycDict *dict, PsycBuffer *buf, PsycString *out,
+			 const PsycRenderPolicy *policy);
+
+/**
+ * Render the routing header of a packet followed by the content length.
+ *
+ * Renders packet->length - packet->contentlen - 2 bytes,
+ * everything in front of the content.
+ */
+PsycRenderRC
+psyc_render_routing (PsycPacket *packet, char *buffer, size_t buflen);
+
+/**
+ * Render the content of a packet followed by the packet delimiter.
+ *
+ * Renders packet->contentlen + 2 bytes.
+ */
+PsycRenderRC
+psyc_render_content (PsycPacket *packet, char *buffer, size_t buflen);
+
+/**
+ * Number of iovec entries used per recipient by psyc_render_fanout().
+ */
+#define PSYC_FANOUT_IOV 3
+
+/**
+ * Render a packet for multiple recipients.
+ *
+ * The content is rendered only once into the content buffer, and the routing
+ * modifiers of the packet only once into the headers buffer.
+ * For each recipient its own routing modifiers, usually _target and maybe
+ * _counter, are rendered after those into headers together with the content
+ * length.
+ *
+ * For each recipient PSYC_FANOUT_IOV entries are written to iov:
+ * the common routing header, the recipient's routing header and the content,
+ * ready to be passed to writev() or sendmmsg() one recipient at a time.
+ *
+ * The packet should be initialized with the common routing modifiers,
+ * the recipient's modifiers are not part of packet->length.
+ * The packet is not modified, so it can be fanned out from several threads.
+ *
+ * @param packet The packet to send.
+ * @param recipients Recipient specific routing modifiers.
+ * @param num Number of recipients.
+ * @param content Buffer for the content, packet->contentlen + 2 bytes.
+ * @param contentlen Length of content buffer.
+ * @param headers Buffer for the routing headers.
+ * @param headerslen Length of headers buffer.
+ * @param iov Output iovec array, num * PSYC_FANOUT_IOV entries.
+ * @param iovlen Number of entries in iov.
+ */
+PsycRenderRC
+psyc_render_fanout (PsycPacket *packet, PsycHeader *recipients, size_t num,
+		    char *content, size_t contentlen,
+		    char *headers, size_t headerslen,
+		    struct iovec *iov, size_t iovlen);
+
+/**
+ * Default threshold for PsycRenderIov,
+ * values shorter than this are copied instead of referenced.
+ */
+#define PSYC_RENDER_IOV_THRESHOLD 512
+
+/** Output of the iovec renderers. */
+typedef struct {
+    struct iovec *iov;		///< Output iovec array.
+    size_t iovlen;		///< Size of iov.
+    size_t iovcnt;		///< Number of iov entries used.
+    char *scratch;		///< Buffer for syntax and short values.
+    size_t scratchlen;		///< Length of scratch buffer.
+    size_t scratchused;		///< Number of scratch bytes used.
+    size_t threshold;		///< Values of at least this length are referenced.
+} PsycRenderIov;
+
+/**
+ * Initialize the output of the iovec renderers.
+ *
+ * @param r Output to initialize.
+ * @param iov Output iovec array.
+ * @param iovlen Number of entries in iov.
+ * @param scratch Buffer for operators, names, lengths, delimiters and values
+ *                shorter than threshold.
+ * @param scratchlen Length of scratch buffer.
+ * @param threshold Minimum length of values referenced in place,
+ *                  e.g. PSYC_RENDER_IOV_THRESHOLD.
+ */
+static inline void
+psyc_render_iov_init (PsycRenderIov *r, struct iovec *iov, size_t iovlen,
+		      char *scratch, size_t scratchlen, size_t threshold)
+{
+    *r = (PsycRenderIov) {
+	.iov = iov,
+	.iovlen = iovlen,
+	.scratch = scratch,
+	.scratchlen = scratchlen,
+	.threshold = threshold,
+    };
+}
+
+/**
+ * Render a PSYC packet into an iovec array without copying large values.
+ *
+ * Values of modifiers, data and raw content of at least r->threshold bytes are
+ * referenced in place, everything else is copied to the scratch buffer.
+ * Adjacent parts in the scratch buffer share an iovec entry.
+ * The result is appended to the iovecs already in r,
+ * so several packets can be rendered for a single writev() call.
+ *
+ * The packet should have its lengths set like for psyc_render().
+ *
+ * @return PSYC_RENDER_ERROR if iov or scratch is too small.
+ */
+PsycRenderRC
+psyc_render_iov (PsycPacket *packet, PsycRenderIov *r);
+
+/**
+ * Render a PSYC list into an iovec array without copying large elements.
+ *
+ * @see psyc_render_iov()
+ */
+PsycRenderRC
+psyc_render_list_iov (PsycList *list, PsycRenderIov *r);
+
+/**
+ * Render a PSYC dict into an iovec array without copying large keys & values.
+ *
+ * @see psyc_render_iov()
+ */
+PsycRenderRC
+psyc_render_dict_iov (PsycDict *dict, PsycRenderIov *r);
+
 size_t
 psyc_render_modifier (PsycModifier *mod, char *buffer);
 
@@ -0,0 +1,117 @@
+#ifndef PSYC_SKELETON_H
+#define PSYC_SKELETON_H
+
+/**
+ * @file psyc/skeleton.h
+ * @brief Interface for rendering packets from pre-rendered skeletons.
+ *
+ * Functions for producing packets that only differ in a few variables
+ * are defined here.
+ */
+
+/**
+ * @defgroup skeleton Packet skeletons
+ *
+ * Many packets sent differ only in a few variables, e.g. _counter, _target or
+ * a timestamp. A skeleton is a packet rendered once, with the positions and
+ * widths of these variables recorded. Subsequent packets are produced by
+ * copying the skeleton and storing the new values at their positions.
+ *
+ * When a value has a different width than in the skeleton, the packet is
+ * assembled from the parts of the skeleton between the variables instead,
+ * and the content length is recalculated if a variable in the content changed
+ * its width.
+ *
+ * @code
+ * PsycString names[] = { PSYC_C2STR("_counter"), PSYC_C2STR("_time_place") };
+ * PsycSkeletonField fields[2];
+ * PsycSkeleton skel;
+ * psyc_skeleton_init(&skel, &packet, names, 2, fields, skelbuf, sizeof(skelbuf));
+ *
+ * PsycString values[2] = { PSYC_C2STR("43"), PSYC_C2STR("1312") };
+ * psyc_skeleton_render(&skel, values, buffer, sizeof(buffer), &len);
+ * @endcode
+ * @{
+ */
+
+#include "packet.h"
+#include "render.h"
+
+/**
+ * Return codes for psyc_skeleton_init().
+ */
+typedef enum {
+    /// Error, a variable is not found in the packet,
+    /// or the variables are not in the order they appear in the packet.
+    PSYC_SKELETON_ERROR_FIELD = -2,
+    /// Error, packet could not be rendered into the buffer.
+    PSYC_SKELETON_ERROR = -1,
+    /// Skeleton is set up.
+    PSYC_SKELETON_SUCCESS = 0,
+} PsycSkeletonRC;
+
+/** Variable of a skeleton. */
+typedef struct {
+    PsycModifier mod;		///< Modifier of the variable in the skeleton.
+    size_t offset;		///< Offset of the modifier line in the skeleton.
+    size_t length;		///< Length of the modifier line.
+    size_t value;		///< Offset of the value in the modifier line.
+    uint8_t content;		///< Is the variable in the content?
+} PsycSkeletonField;
+
+/** Pre-rendered packet. */
+typedef struct {
+    char *data;			///< Rendered packet, buffer provided by the caller.
+    size_t length;		///< Length of the rendered packet.
+    size_t routinglen;		///< Length of the routing header.
+    size_t content;		///< Offset of the content.
+    size_t contentlen;		///< Length of the content.
+    PsycSkeletonField *fields;	///< Variables, array provided by the caller.
+    size_t num_fields;		///< Number of variables.
+} PsycSkeleton;
+
+/**
+ * Render a packet as a skeleton.
+ *
+ * @param s Skeleton to set up.
+ * @param p Packet to render, with its lengths set, e.g. by psyc_packet_init().
+ *          It can be reused once the skeleton is set up, only the names of the
+ *          variables have to stay valid.
+ * @param names Names of the variables to replace later,
+ *              in the order they appear in the packet.
+ * @param num_names Number of variables.
+ * @param fields Array of num_names fields.
+ * @param buffer Buffer for the skeleton.
+ * @param buflen Size of buffer, at least p->length.
+ */
+PsycSkeletonRC
+psyc_skeleton_init (PsycSkeleton *s, PsycPacket *p,
+		    PsycString *names, size_t num_names,
+		    PsycSkeletonField *fields, char *buffer, size_t buflen);
+
+/**
+ * Render a packet from a skeleton with new values for its variables.
+ *
+ * If the values have the same width as in the skeleton and still don't need a
+ * length, this is a copy of the skeleton and a copy of each value.
+ *
+ * Whether entity variables need a length is checked for each value.
+ * A content length is kept if the skeleton has one, and added if an entity
+ * variable needs a length.
+ *
+ * @param s Skeleton.
+ * @param values New values of the variables, in the order of the names passed
+ *               to psyc_skeleton_init().
+ * @param buffer Output buffer.
+ * @param buflen Size of buffer.
+ * @param length Set to the length of the packet.
+ *
+ * @return PSYC_RENDER_ERROR if the buffer is too small.
+ */
+PsycRenderRC
+psyc_skeleton_render (PsycSkeleton *s, PsycString *values,
+		      char *buffer, size_t buflen, size_t *length);
+
+/** @} */ // end of skeleton group
+
+#endif
@@ -16,6 +16,8 @@
  * @{
  */
 
+#include <sys/uio.h>
+
 /**
  * Return values for the text template parsing function.
  * @see psyc_text()
@@ -40,6 +42,21 @@ typedef enum {
     PSYC_TEXT_VALUE_FOUND = 0,
 } PsycTextValueRC;
 
+/**
+ * Escaping of substituted values.
+ * @see psyc_text_escape_set()
+ */
+typedef enum {
+    /// Values are copied as they are.
+    PSYC_TEXT_ESCAPE_NONE = 0,
+    /// & < > " ' are replaced by HTML entities.
+    PSYC_TEXT_ESCAPE_HTML = 1,
+    /// " \ and control characters are escaped for a JSON string.
+    PSYC_TEXT_ESCAPE_JSON = 2,
+    /// NUL, CR and LF are replaced by spaces, so values can't break IRC lines.
+    PSYC_TEXT_ESCAPE_IRC = 3,
+} PsycTextEscape;
+
 /**
  * Struct for keeping PSYC text parser state.
  */
@@ -50,6 +67,7 @@ typedef struct {
     PsycString buffer;		///< output buffer for rendered text
     PsycString open;
     PsycString close;
+    PsycTextEscape escape;	///< escaping of substituted values
 } PsycTextState;
 
 /**
@@ -89,6 +107,7 @@ psyc_text_state_init (PsycTextState *state,
     1, "["};
     state->close = (PsycString) {
     1, "]"};
+    state->escape = PSYC_TEXT_ESCAPE_NONE;
 }
 
 /**
@@ -121,6 +140,7 @@ psyc_text_state_init_custom (PsycTextState *state,
     openlen, open};
     state->close = (PsycString) {
     closelen, close};
+    state->escape = PSYC_TEXT_ESCAPE_NONE;
 }
 
 /**
@@ -134,6 +154,18 @@ psyc_text_buffer_set (PsycTextState *state, char *buffer, size_t length)
     state->written = 0;
 }
 
+/**
+ * Sets how substituted values are escaped, the template itself is not escaped.
+ *
+ * Values are scanned for characters that need escaping, values without them
+ * are copied as they are.
+ */
+static inline void
+psyc_text_escape_set (PsycTextState *state, PsycTextEscape escape)
+{
+    state->escape = escape;
+}
+
 static inline size_t
 psyc_text_bytes_written (PsycTextState *state)
 {
@@ -158,6 +190,163 @@ psyc_text_bytes_written (PsycTextState *state)
 PsycTextRC
 psyc_text (PsycTextState *state, PsycTextCB get_value, void *get_value_cls);
 
+/// Maximum number of variables in a built-in template.
+#define PSYC_TEXT_TEMPLATE_VARS 8
+
+/**
+ * Variable reference in a compiled text template.
+ *
+ * The literal text before it spans from the end of the previous variable
+ * (or the start of the template) to start.
+ */
+typedef struct {
+    size_t start;		///< offset of the opening brace
+    size_t end;			///< offset after the closing brace
+    PsycString name;		///< name of the variable
+} PsycTextVar;
+
+/**
+ * Compiled text template.
+ */
+typedef struct {
+    PsycString tmpl;		///< text template
+    PsycTextVar *vars;		///< variable references in the order they appear
+    size_t num_vars;		///< number of variables
+} PsycTextTemplate;
+
+/**
+ * Compiles a text template into a list of variable references.
+ *
+ * The template is scanned the same way psyc_text() does, once, so that
+ * psyc_text_compiled() does not have to look for braces again.
+ *
+ * @param t Compiled template to fill out.
+ * @param tmpl Text template, it has to stay valid as long as t is used.
+ * @param tmplen Length of template.
+ * @param open Opening brace.
+ * @param openlen Length of opening brace.
+ * @param close Closing brace.
+ * @param closelen Length of closing brace.
+ * @param vars Array for the variable references.
+ * @param maxvars Size of vars.
+ *
+ * @return Number of variables, or -1 if vars is too small.
+ */
+int
+psyc_text_compile (PsycTextTemplate *t, const char *tmpl, size_t tmplen,
+		   const char *open, size_t openlen,
+		   const char *close, size_t closelen,
+		   PsycTextVar *vars, size_t maxvars);
+
+/**
+ * Fills out a compiled text template by asking a callback for content.
+ *
+ * Same as psyc_text(), including the return values and continuing with a new
+ * buffer after PSYC_TEXT_INCOMPLETE. The state is initialized with
+ * psyc_text_state_init(), its template and braces are not used.
+ */
+PsycTextRC
+psyc_text_compiled (PsycTextState *state, const PsycTextTemplate *t,
+		    PsycTextCB get_value, void *get_value_cls);
+
+/// Maximum number of modifiers in an indexed header.
+#define PSYC_TEXT_INDEX_MAX 255
+
+/// Number of slots in the name hash table of an index, a power of 2.
+#define PSYC_TEXT_INDEX_SIZE 512
+
+/**
+ * Name index of a header, for filling out templates without a callback.
+ */
+typedef struct {
+    const PsycHeader *header;	///< indexed header
+    uint8_t slots[PSYC_TEXT_INDEX_SIZE]; ///< modifier number + 1, or 0 if empty
+} PsycTextIndex;
+
+/**
+ * Indexes the modifier names of a header.
+ *
+ * If a name occurs more than once, the last modifier is used.
+ * The header has to stay unchanged as long as the index is used.
+ *
+ * @return PSYC_FALSE if the header has more than PSYC_TEXT_INDEX_MAX modifiers.
+ */
+PsycBool
+psyc_text_index_init (PsycTextIndex *idx, const PsycHeader *h);
+
+/**
+ * Looks up a modifier by name in an index.
+ *
+ * @param idx Index.
+ * @param name Variable name.
+ * @param len Length of name.
+ * @param inherit If true and name is not found, fall back to the names it
+ *                inherits from, e.g. _nick_place to _nick.
+ *
+ * @return The modifier, or NULL if not found.
+ */
+const PsycModifier *
+psyc_text_index_get (const PsycTextIndex *idx, const char *name, size_t len,
+		     PsycBool inherit);
+
+/**
+ * Fills out a compiled text template with the values of an indexed header.
+ *
+ * Same as psyc_text_compiled(), but the variables are looked up in the index
+ * with psyc_text_index_get() instead of calling a callback for each of them.
+ * Variables not found in the header are left as is.
+ */
+PsycTextRC
+psyc_text_header (PsycTextState *state, const PsycTextTemplate *t,
+		  const PsycTextIndex *idx, PsycBool inherit);
+
+/**
+ * Number of iovec entries needed to fill out a compiled template in one call.
+ */
+#define PSYC_TEXT_IOV(t) (2 * (t)->num_vars + 1)
+
+/**
+ * Fills out a compiled text template as a list of segments, without copying.
+ *
+ * Same as psyc_text_compiled(), but the text is returned in iov: literal parts
+ * point into the template, substituted values to the strings returned by the
+ * callback, which have to stay valid until the segments are used, e.g. by
+ * writev(). Empty segments are left out. psyc_text_bytes_written() returns
+ * the length of the segments.
+ *
+ * Values that need escaping are escaped into the buffer of the state, which is
+ * advanced past them; if it's too small PSYC_TEXT_INCOMPLETE is returned.
+ * Without escaping the buffer is not used.
+ *
+ * PSYC_TEXT_INCOMPLETE is returned when iov is full, the function can be
+ * called again with a new iov array to continue. With PSYC_TEXT_IOV(t)
+ * entries and a large enough buffer for escaped values this does not happen.
+ *
+ * @param state Text state.
+ * @param t Compiled template.
+ * @param get_value Callback producing the values.
+ * @param get_value_cls Closure for the callback.
+ * @param iov Output iovec array.
+ * @param iovlen Size of iov.
+ * @param num Set to the number of entries written to iov.
+ */
+PsycTextRC
+psyc_text_iov (PsycTextState *state, const PsycTextTemplate *t,
+	       PsycTextCB get_value, void *get_value_cls,
+	       struct iovec *iov, size_t iovlen, size_t *num);
+
+/**
+ * Fills out a compiled text template with the values of an indexed header as
+ * a list of segments.
+ *
+ * @see psyc_text_header()
+ * @see psyc_text_iov()
+ */
+PsycTextRC
+psyc_text_header_iov (PsycTextState *state, const PsycTextTemplate *t,
+		      const PsycTextIndex *idx, PsycBool inherit,
+		      struct iovec *iov, size_t iovlen, size_t *num);
+
 extern const PsycTemplates psyc_templates;
 
 static inline const char *
@@ -168,6 +357,16 @@ psyc_template (PsycMethod mc, size_t *len) {
     return t.data;
 }
 
+/**
+ * Get the compiled built-in template of a method.
+ *
+ * All built-in templates are compiled when the library is loaded, so this can
+ * be called from multiple threads. With compilers other than GCC & clang they
+ * are compiled on the first call, which should be made from one thread.
+ */
+const PsycTextTemplate *
+psyc_template_compiled (PsycMethod mc);
+
 /** @} */ // end of text group
 
 #endif
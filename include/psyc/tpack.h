@@ -0,0 +1,182 @@
+#ifndef PSYC_TPACK_H
+#define PSYC_TPACK_H
+
+/**
+ * @file psyc/tpack.h
+ * @brief Interface for binary text template packs.
+ *
+ * Functions for loading text templates from memory-mapped files are defined
+ * here.
+ */
+
+/**
+ * @defgroup tpack Template packs
+ *
+ * A template pack holds the text templates of one language in a binary file:
+ * a header, an index by method ID, an index by method name sorted
+ * alphabetically, and a string pool. The file is mapped read-only, so all
+ * processes using the same pack share its pages, and templates are looked up
+ * without copying, as cheap as with psyc_template().
+ *
+ * Packs are built from source files with the tpack tool in src/:
+ *
+ * @verbatim
+ * # comment
+ * _notice_context_enter	[_nick] enters [_nick_place].
+ * _message_echo	You say:\n[_data]
+ * @endverbatim
+ *
+ * Each line has a method name, a tab and the template, with \\n, \\t and
+ * \\\\ as escapes.
+ *
+ * The current pack of the process can be replaced at runtime with
+ * psyc_tpack_swap(), e.g. after a new pack was installed by renaming it over
+ * the old file.
+ * @{
+ */
+
+#include <stdint.h>
+
+#include "method.h"
+
+/// Magic & version at the start of a pack.
+#define PSYC_TPACK_MAGIC "PSYCTPK1"
+
+/**
+ * Return codes for psyc_tpack_open() & psyc_tpack_load().
+ */
+typedef enum {
+    /// Error, the file is not a valid template pack.
+    PSYC_TPACK_ERROR_FORMAT = -2,
+    /// Error, the file could not be opened or mapped.
+    PSYC_TPACK_ERROR = -1,
+    /// Pack is loaded.
+    PSYC_TPACK_SUCCESS = 0,
+} PsycTemplatePackRC;
+
+/** String in the pool of a pack. */
+typedef struct {
+    uint32_t offset;		///< Offset in the string pool.
+    uint32_t length;		///< Length, without the terminating NUL.
+} PsycTemplatePackString;
+
+/** Entry of the name index. */
+typedef struct {
+    PsycTemplatePackString name; ///< Method name.
+    PsycTemplatePackString tmpl; ///< Template.
+} PsycTemplatePackName;
+
+/** Header of a pack file, followed by the method index. */
+typedef struct {
+    char magic[8];		///< PSYC_TPACK_MAGIC
+    char lang[8];		///< Language tag, padded with NULs.
+    uint32_t num_methods;	///< Number of entries in the method index.
+    uint32_t num_names;		///< Number of entries in the name index.
+    uint32_t names;		///< Offset of the name index.
+    uint32_t pool;		///< Offset of the string pool.
+    uint32_t poollen;		///< Length of the string pool.
+    uint32_t reserved;
+} PsycTemplatePackHeader;
+
+/** Loaded template pack. */
+typedef struct {
+    const char *data;		///< Contents of the pack.
+    size_t length;		///< Length of data.
+    uint8_t mapped;		///< Was data mapped by psyc_tpack_open()?
+    uint32_t num_methods;	///< Number of entries in the method index.
+    uint32_t num_names;		///< Number of entries in the name index.
+    const PsycTemplatePackString *methods; ///< Method index.
+    const PsycTemplatePackName *names; ///< Name index.
+    const char *pool;		///< String pool.
+    PsycString lang;		///< Language tag.
+} PsycTemplatePack;
+
+/** Template of a method for psyc_tpack_build(). */
+typedef struct {
+    PsycString name;		///< Method name.
+    PsycString tmpl;		///< Template.
+} PsycTemplatePackEntry;
+
+/**
+ * Map a pack file read-only.
+ */
+PsycTemplatePackRC
+psyc_tpack_open (PsycTemplatePack *pack, const char *path);
+
+/**
+ * Load a pack from memory, after checking that its indexes are in bounds.
+ *
+ * The data has to stay valid as long as the pack is used.
+ */
+PsycTemplatePackRC
+psyc_tpack_load (PsycTemplatePack *pack, const char *data, size_t length);
+
+/**
+ * Unmap a pack opened with psyc_tpack_open().
+ */
+void
+psyc_tpack_close (PsycTemplatePack *pack);
+
+/**
+ * Get the template of a method from a pack.
+ *
+ * @return The template, or NULL if the pack has none for the method.
+ */
+static inline const char *
+psyc_tpack_template (const PsycTemplatePack *pack, PsycMethod mc, size_t *len)
+{
+    const PsycTemplatePackString *t;
+
+    if ((uint32_t)mc >= pack->num_methods || !pack->methods[mc].length)
+	return NULL;
+
+    t = &pack->methods[mc];
+    if (len)
+	*len = t->length;
+    return pack->pool + t->offset;
+}
+
+/**
+ * Get the template of a method by name, also for methods without an ID.
+ *
+ * @return The template, or NULL if the pack has none for the method.
+ */
+const char *
+psyc_tpack_lookup (const PsycTemplatePack *pack,
+		   const char *name, size_t namelen, size_t *len);
+
+/**
+ * Build a pack.
+ *
+ * @param buffer Output buffer, or NULL to get the size of the pack.
+ * @param buflen Size of buffer.
+ * @param lang Language tag, up to 8 characters.
+ * @param langlen Length of lang.
+ * @param entries Templates, sorted by name without duplicates.
+ * @param num Number of entries.
+ *
+ * @return Size of the pack, nothing is written if it's larger than buflen.
+ *         0 if the entries are not sorted or too large for a pack.
+ */
+size_t
+psyc_tpack_build (char *buffer, size_t buflen, const char *lang, size_t langlen,
+		  const PsycTemplatePackEntry *entries, size_t num);
+
+/**
+ * Replace the current pack of the process atomically.
+ *
+ * The previous pack is returned, it can be closed once no other thread is
+ * using templates from it anymore.
+ */
+PsycTemplatePack *
+psyc_tpack_swap (PsycTemplatePack *pack);
+
+/**
+ * Get the current pack of the process, or NULL if none is set.
+ */
+PsycTemplatePack *
+psyc_tpack_current (void);
+
+/** @} */ // end of tpack group
+
+#endif
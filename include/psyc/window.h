@@ -0,0 +1,269 @@
+#ifndef PSYC_WINDOW_H
+#define PSYC_WINDOW_H
+
+/**
+ * @file psyc/window.h
+ * @brief Interface for duplicate suppression and packet reordering.
+ *
+ * Sliding windows over _counter values are defined here.
+ */
+
+/**
+ * @defgroup window Duplicate suppression and reordering
+ *
+ * This module keeps track of the _counter values received from each
+ * (context, source) pair, as identified by psyc_packet_id().
+ *
+ * PsycWindow is a bitmap based sliding window as used for anti-replay
+ * protection: it detects duplicates and gaps among the last
+ * PSYC_WINDOW_SIZE counters in O(1) and takes 16 bytes.
+ *
+ * PsycWindowTable maps (context, source) pairs to windows using open
+ * addressing over a caller provided array, with 32 bytes per entry.
+ * Only a 64-bit hash of the pair is stored, not the strings. The hash is
+ * SipHash keyed with a secret given at init, so that a sender can't pick a
+ * source whose hash collides with the one of another source and have its
+ * counters treated as duplicates.
+ *
+ * PsycReorder buffers packets that arrive out of order up to a bound and
+ * releases them in order. It is optional and can be attached to a table
+ * entry only while a gap is being waited for.
+ * @{
+ */
+
+#include "packet.h"
+
+/**
+ * Number of counters below the highest one remembered by a window.
+ */
+#define PSYC_WINDOW_SIZE 64
+
+/**
+ * Size of the secret key of a window table.
+ */
+#define PSYC_WINDOW_KEY_SIZE 16
+
+/**
+ * Return codes for psyc_window_update().
+ */
+typedef enum {
+    /// Error, counter is not numeric or the window table is full.
+    PSYC_WINDOW_ERROR = -3,
+    /// Counter has been seen already.
+    PSYC_WINDOW_DUPLICATE = -2,
+    /// Counter is older than the window, it can't be told if it's a duplicate.
+    PSYC_WINDOW_TOO_OLD = -1,
+    /// Counter is the next one in order.
+    PSYC_WINDOW_IN_ORDER = 0,
+    /// Counter is new, but the ones between the previous highest and it are
+    /// missing.
+    PSYC_WINDOW_GAP = 1,
+    /// Counter is new and fills a gap.
+    PSYC_WINDOW_LATE = 2,
+} PsycWindowRC;
+
+/**
+ * Return codes for psyc_reorder_push().
+ */
+typedef enum {
+    /// Error, counter is too far ahead to be buffered.
+    PSYC_REORDER_OVERFLOW = -2,
+    /// Counter has been delivered or buffered already.
+    PSYC_REORDER_DUPLICATE = -1,
+    /// Packet is the next one in order, deliver it then call
+    /// psyc_reorder_pop() for the ones buffered after it.
+    PSYC_REORDER_DELIVER = 0,
+    /// Packet is buffered until the ones before it arrive.
+    PSYC_REORDER_BUFFERED = 1,
+} PsycReorderRC;
+
+/** Sliding window over counters. */
+typedef struct {
+    uint64_t top;		///< Highest counter seen.
+    uint64_t bitmap;		///< Bit n is set if counter top - n was seen.
+} PsycWindow;
+
+/** Reorder buffer. */
+typedef struct {
+    void **slots;		///< Buffered packets, array provided by the caller.
+    size_t size;		///< Number of slots, a power of 2.
+    size_t pending;		///< Number of buffered packets.
+    uint64_t next;		///< Next counter to deliver.
+    uint8_t started;		///< Is next known yet?
+} PsycReorder;
+
+/** Window table entry. */
+typedef struct {
+    uint64_t key;		///< Keyed hash of context & source, 0 if unused.
+    PsycWindow window;		///< Window of the (context, source) pair.
+    PsycReorder *reorder;	///< Optional reorder buffer.
+} PsycWindowEntry;
+
+/** Table of windows for (context, source) pairs. */
+typedef struct {
+    PsycWindowEntry *entries;	///< Entries, array provided by the caller.
+    size_t size;		///< Number of entries, a power of 2.
+    size_t used;		///< Number of entries in use.
+    uint64_t k0, k1;		///< Secret hash key.
+} PsycWindowTable;
+
+/**
+ * Initialize a window.
+ */
+static inline void
+psyc_window_init (PsycWindow *w)
+{
+    w->top = 0;
+    w->bitmap = 0;
+}
+
+/**
+ * Check a counter against the window and mark it as seen.
+ *
+ * The first counter seen by a window is always in order.
+ */
+static inline PsycWindowRC
+psyc_window_update (PsycWindow *w, uint64_t counter)
+{
+    uint64_t diff;
+
+    if (!w->bitmap) {
+	w->top = counter;
+	w->bitmap = 1;
+	return PSYC_WINDOW_IN_ORDER;
+    }
+
+    if (counter > w->top) {
+	diff = counter - w->top;
+	w->bitmap = diff < PSYC_WINDOW_SIZE ? w->bitmap << diff | 1 : 1;
+	w->top = counter;
+	return diff == 1 ? PSYC_WINDOW_IN_ORDER : PSYC_WINDOW_GAP;
+    }
+
+    diff = w->top - counter;
+    if (diff >= PSYC_WINDOW_SIZE)
+	return PSYC_WINDOW_TOO_OLD;
+    if (w->bitmap & (uint64_t)1 << diff)
+	return PSYC_WINDOW_DUPLICATE;
+
+    w->bitmap |= (uint64_t)1 << diff;
+    return PSYC_WINDOW_LATE;
+}
+
+/**
+ * Initialize a reorder buffer.
+ *
+ * @param r Reorder buffer to initialize.
+ * @param slots Array for buffered packets.
+ * @param size Number of slots, should be a power of 2.
+ *             This is the maximum distance of a buffered counter from the next
+ *             one to deliver.
+ */
+void
+psyc_reorder_init (PsycReorder *r, void **slots, size_t size);
+
+/**
+ * Start delivering from the given counter.
+ *
+ * Without calling this, delivery starts at the first counter pushed.
+ */
+static inline void
+psyc_reorder_start (PsycReorder *r, uint64_t next)
+{
+    r->next = next;
+    r->started = PSYC_TRUE;
+}
+
+/**
+ * Push a received packet to the reorder buffer.
+ *
+ * @param r Reorder buffer.
+ * @param counter Counter of the packet.
+ * @param packet Packet to buffer, it's only stored if
+ *               PSYC_REORDER_BUFFERED is returned.
+ */
+PsycReorderRC
+psyc_reorder_push (PsycReorder *r, uint64_t counter, void *packet);
+
+/**
+ * Release the next buffered packet if it's in order.
+ *
+ * @return The packet, or NULL if the next one has not arrived yet.
+ */
+void *
+psyc_reorder_pop (PsycReorder *r);
+
+/**
+ * Give up waiting for missing packets, e.g. after a timeout.
+ *
+ * Skips to the first buffered packet, which can be released by
+ * psyc_reorder_pop() then.
+ *
+ * @return Number of counters skipped.
+ */
+uint64_t
+psyc_reorder_skip (PsycReorder *r);
+
+/**
+ * Initialize a window table.
+ *
+ * @param t Table to initialize.
+ * @param entries Array of entries.
+ * @param size Number of entries, should be a power of 2.
+ * @param key Secret key for hashing (context, source) pairs,
+ *            PSYC_WINDOW_KEY_SIZE random bytes, e.g. from /dev/urandom.
+ */
+void
+psyc_window_table_init (PsycWindowTable *t, PsycWindowEntry *entries,
+			size_t size, const uint8_t key[PSYC_WINDOW_KEY_SIZE]);
+
+/**
+ * Get the table entry of a (context, source) pair, add it if not found.
+ *
+ * @return The entry, or NULL if the table is full.
+ */
+PsycWindowEntry *
+psyc_window_table_get (PsycWindowTable *t,
+		       const char *context, size_t contextlen,
+		       const char *source, size_t sourcelen);
+
+/**
+ * Get the table entry for a packet ID.
+ *
+ * @param t Window table.
+ * @param id Packet ID as set up by psyc_packet_id().
+ * @see psyc_window_table_get()
+ */
+static inline PsycWindowEntry *
+psyc_window_table_get_id (PsycWindowTable *t, PsycList *id)
+{
+    return psyc_window_table_get(t,
+				 PSYC_S2ARG(id->elems[PSYC_PACKET_ID_CONTEXT].value),
+				 PSYC_S2ARG(id->elems[PSYC_PACKET_ID_SOURCE].value));
+}
+
+/**
+ * Remove an entry from the table.
+ *
+ * Entries returned earlier might move, look them up again after this.
+ */
+void
+psyc_window_table_remove (PsycWindowTable *t, PsycWindowEntry *entry);
+
+/**
+ * Check the counter of a packet ID against the window of its
+ * (context, source) pair and mark it as seen.
+ *
+ * @param t Window table.
+ * @param id Packet ID as set up by psyc_packet_id().
+ * @param entry If not NULL, set to the table entry of the packet.
+ *
+ * @return Result of psyc_window_update(), or PSYC_WINDOW_ERROR.
+ */
+PsycWindowRC
+psyc_window_table_update_id (PsycWindowTable *t, PsycList *id,
+			     PsycWindowEntry **entry);
+
+/** @} */ // end of window group
+
+#endif
@@ -0,0 +1,124 @@
+#include <stdlib.h>
+
+#include "lib.h"
+#include <psyc/arena.h>
+
+#define ALIGN(n) (((n) + PSYC_ARENA_ALIGN - 1) & ~(size_t)(PSYC_ARENA_ALIGN - 1))
+
+/**
+ * Allocate a new block of at least size bytes, the block header is stored in
+ * front of its data.
+ */
+static inline PsycArenaBlock *
+arena_block_new (PsycArena *arena, size_t size)
+{
+    PsycArenaBlock *block;
+
+    if (size < arena->block_size)
+	size = arena->block_size;
+
+    block = malloc(ALIGN(sizeof(PsycArenaBlock)) + size);
+    if (!block)
+	return NULL;
+
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    block->data = (char *)block + ALIGN(sizeof(PsycArenaBlock));
+    return block;
+}
+
+void *
+psyc_arena_alloc (PsycArena *arena, size_t size)
+{
+    PsycArenaBlock *block = arena->current, *next;
+    size_t used;
+    size = ALIGN(size ? size : 1);
+
+    // look for room in the current block, then in blocks kept by a reset
+    while (block) {
+	used = ALIGN(block->used);
+	if (used <= block->size && size <= block->size - used) {
+	    block->used = used + size;
+	    arena->current = block;
+	    return block->data + used;
+	}
+	block = block->next;
+    }
+
+    next = arena_block_new(arena, size);
+    if (!next)
+	return NULL;
+
+    // append after the current block, in front of any kept block too small
+    if (arena->current) {
+	next->next = arena->current->next;
+	arena->current->next = next;
+    } else
+	arena->first = next;
+
+    arena->current = next;
+    next->used = size;
+    return next->data;
+}
+
+void *
+psyc_arena_realloc (PsycArena *arena, void *ptr, size_t oldsize,
+		    size_t newsize)
+{
+    PsycArenaBlock *block = arena->current;
+    void *mem;
+
+    if (!ptr)
+	return psyc_arena_alloc(arena, newsize);
+
+    // grow the last allocation in place
+    if (block && (char *)ptr >= block->data
+	&& (char *)ptr + ALIGN(oldsize ? oldsize : 1) == block->data + block->used
+	&& newsize <= block->size - ((char *)ptr - block->data)) {
+	block->used = (char *)ptr - block->data + ALIGN(newsize);
+	if (block->used > block->size)
+	    block->used = block->size;
+	return ptr;
+    }
+
+    mem = psyc_arena_alloc(arena, newsize);
+    if (mem)
+	memcpy(mem, ptr, oldsize < newsize ? oldsize : newsize);
+    return mem;
+}
+
+void *
+psyc_arena_copy (PsycArena *arena, const void *data, size_t size)
+{
+    void *mem = psyc_arena_alloc(arena, size);
+
+    if (mem && size)
+	memcpy(mem, data, size);
+    return mem;
+}
+
+void
+psyc_arena_reset (PsycArena *arena)
+{
+    PsycArenaBlock *block;
+
+    for (block = arena->first; block; block = block->next)
+	block->used = 0;
+
+    arena->current = arena->first;
+}
+
+void
+psyc_arena_free (PsycArena *arena)
+{
+    PsycArenaBlock *block = arena->first, *next;
+
+    while (block) {
+	next = block->next;
+	free(block);
+	block = next;
+    }
+
+    arena->first = arena->current = NULL;
+}
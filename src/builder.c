@@ -0,0 +1,98 @@
+#include "lib.h"
+#include <psyc/packet.h>
+#include <psyc/render.h>
+#include <psyc/builder.h>
+
+/**
+ * Append a modifier to a header, growing its array in the arena.
+ */
+static inline PsycModifier *
+builder_add (PsycArena *arena, PsycHeader *header, size_t *max)
+{
+    PsycModifier *mods;
+    size_t size;
+
+    if (header->lines == *max) {
+	size = *max ? *max * 2 : 8;
+	mods = psyc_arena_realloc(arena, header->modifiers,
+				  sizeof(PsycModifier) * *max,
+				  sizeof(PsycModifier) * size);
+	if (!mods)
+	    return NULL;
+	header->modifiers = mods;
+	*max = size;
+    }
+
+    return &header->modifiers[header->lines++];
+}
+
+PsycModifier *
+psyc_builder_routing (PsycBuilder *b, PsycOperator oper,
+		      char *name, size_t namelen,
+		      char *value, size_t valuelen)
+{
+    PsycModifier *mod = builder_add(b->arena, &b->routing, &b->routingmax);
+
+    if (mod)
+	psyc_modifier_init(mod, oper, name, namelen, value, valuelen,
+			   PSYC_MODIFIER_ROUTING);
+    return mod;
+}
+
+PsycModifier *
+psyc_builder_entity (PsycBuilder *b, PsycOperator oper,
+		     char *name, size_t namelen,
+		     char *value, size_t valuelen)
+{
+    PsycModifier *mod = builder_add(b->arena, &b->entity, &b->entitymax);
+
+    if (mod)
+	psyc_modifier_init(mod, oper, name, namelen, value, valuelen,
+			   PSYC_MODIFIER_CHECK_LENGTH);
+    return mod;
+}
+
+PsycModifier *
+psyc_builder_list (PsycBuilder *b, PsycOperator oper,
+		   char *name, size_t namelen,
+		   PsycElem *elems, size_t num_elems)
+{
+    PsycList list;
+    char *value;
+
+    psyc_list_init(&list, elems, num_elems);
+    value = psyc_arena_alloc(b->arena, list.length);
+    if (!value)
+	return NULL;
+
+    psyc_render_list(&list, value, list.length);
+    return psyc_builder_entity(b, oper, name, namelen, value, list.length);
+}
+
+PsycModifier *
+psyc_builder_dict (PsycBuilder *b, PsycOperator oper,
+		   char *name, size_t namelen,
+		   PsycDictElem *elems, size_t num_elems)
+{
+    PsycDict dict;
+    char *value;
+
+    psyc_dict_init(&dict, elems, num_elems);
+    value = psyc_arena_alloc(b->arena, dict.length);
+    if (!value)
+	return NULL;
+
+    psyc_render_dict(&dict, value, dict.length);
+    return psyc_builder_entity(b, oper, name, namelen, value, dict.length);
+}
+
+void
+psyc_builder_packet (PsycBuilder *b, PsycPacket *packet,
+		     char *method, size_t methodlen,
+		     char *data, size_t datalen,
+		     char stateop, PsycPacketFlag flag)
+{
+    psyc_packet_init(packet, b->routing.modifiers, b->routing.lines,
+		     b->entity.modifiers, b->entity.lines,
+		     method, methodlen, data, datalen, stateop, flag);
+}
@@ -0,0 +1,123 @@
+#include "lib.h"
+#include <psyc/packet.h>
+#include <psyc/parse.h>
+#include <psyc/compact.h>
+
+/// Default aliases.
+const PsycAlias psyc_aliases[] = {
+    // routing variables
+    { PSYC_C2STRI("_context"),			PSYC_C2STRI("c") },
+    { PSYC_C2STRI("_source"),			PSYC_C2STRI("s") },
+    { PSYC_C2STRI("_target"),			PSYC_C2STRI("t") },
+    // entity variables
+    { PSYC_C2STRI("_degree_availability"),	PSYC_C2STRI("da") },
+    { PSYC_C2STRI("_subject"),			PSYC_C2STRI("j") },
+    { PSYC_C2STRI("_type_content"),		PSYC_C2STRI("tc") },
+    // methods
+    { PSYC_C2STRI("_message"),			PSYC_C2STRI("m") },
+    { PSYC_C2STRI("_notice_presence"),		PSYC_C2STRI("np") },
+};
+const size_t psyc_aliases_num = PSYC_NUM_ELEM(psyc_aliases);
+
+/**
+ * FNV-1a hash of a name.
+ */
+static inline uint32_t
+alias_hash (const char *name, size_t len)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	h = (h ^ (uint8_t)name[i]) * 16777619U;
+
+    return h;
+}
+
+PsycAliasRC
+psyc_alias_table_init (PsycAliasTable *t, const PsycAlias *aliases, size_t num)
+{
+    size_t i, h;
+    int slot;
+
+    t->aliases = aliases;
+    t->num = 0;
+    memset(t->compact, 0, sizeof(t->compact));
+    memset(t->name, 0, sizeof(t->name));
+
+    if (num > PSYC_ALIAS_MAX)
+	return PSYC_ALIAS_ERROR_FULL;
+
+    for (i = 0; i < num; i++) {
+	slot = psyc_alias_compact_slot(PSYC_S2ARG(aliases[i].compact));
+	if (slot < 0 || !aliases[i].name.length
+	    || aliases[i].name.data[0] != '_')
+	    return PSYC_ALIAS_ERROR_KEYWORD;
+	if (t->compact[slot]
+	    || psyc_alias_name_id(t, PSYC_S2ARG(aliases[i].name))
+	    != PSYC_ALIAS_NONE)
+	    return PSYC_ALIAS_ERROR_DUPLICATE;
+
+	// linear probing, the table is at least half empty
+	h = alias_hash(PSYC_S2ARG(aliases[i].name));
+	while (t->name[h & (PSYC_ALIAS_HASH_SIZE - 1)])
+	    h++;
+
+	t->name[h & (PSYC_ALIAS_HASH_SIZE - 1)] = i + 1;
+	t->compact[slot] = i + 1;
+	t->num++;
+    }
+
+    return PSYC_ALIAS_SUCCESS;
+}
+
+int
+psyc_alias_name_id (const PsycAliasTable *t, const char *name, size_t len)
+{
+    size_t h = alias_hash(name, len);
+    const PsycString *n;
+    uint8_t id;
+
+    while ((id = t->name[h & (PSYC_ALIAS_HASH_SIZE - 1)])) {
+	n = &t->aliases[id - 1].name;
+	if (n->length == len && memcmp(n->data, name, len) == 0)
+	    return id - 1;
+	h++;
+    }
+
+    return PSYC_ALIAS_NONE;
+}
+
+PsycParseRC
+psyc_parse_alias (PsycParseState *state, const PsycAliasTable *t, char *oper,
+		  PsycString *name, PsycString *value, int *id)
+{
+    PsycParseRC ret = psyc_parse(state, oper, name, value);
+    int i;
+
+    if (id)
+	*id = PSYC_ALIAS_NONE;
+
+    switch (ret) {
+    case PSYC_PARSE_ROUTING:
+    case PSYC_PARSE_ENTITY_START:
+    case PSYC_PARSE_ENTITY:
+	break;
+    case PSYC_PARSE_BODY_START:
+    case PSYC_PARSE_BODY:
+	// same values as CONTENT_START & CONTENT, which have no name
+	if (state->flags & PSYC_PARSE_ROUTING_ONLY)
+	    return ret;
+	break;
+    default:
+	return ret;
+    }
+
+    i = psyc_alias_id(t, PSYC_S2ARG(*name));
+    if (i != PSYC_ALIAS_NONE && name->data[0] != '_')
+	*name = t->aliases[i].name;
+    if (id)
+	*id = i;
+
+    return ret;
+}
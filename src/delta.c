@@ -0,0 +1,271 @@
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "lib.h"
+#include <psyc/packet.h>
+#include <psyc/variable.h>
+#include <psyc/delta.h>
+
+/**
+ * Variable value, linked into the garbage list of the state when replaced.
+ */
+typedef struct DeltaValue {
+    struct DeltaValue *next;
+    char data[];
+} DeltaValue;
+
+void
+psyc_delta_init (PsycDelta *delta, PsycDeltaVar *vars, size_t max_vars)
+{
+    *delta = (PsycDelta) {
+	.vars = vars,
+	.num_vars = 0,
+	.max_vars = max_vars,
+	.garbage = NULL,
+	.resync = PSYC_TRUE,
+    };
+}
+
+static inline char *
+delta_value_alloc (size_t length)
+{
+    DeltaValue *v = malloc(sizeof(DeltaValue) + length);
+    return v ? v->data : NULL;
+}
+
+/**
+ * Release a value that may still be referenced by the output of this diff,
+ * it is freed at the start of the next one.
+ */
+static inline void
+delta_value_release (PsycDelta *delta, char *data)
+{
+    if (!data)
+	return;
+
+    DeltaValue *v = (DeltaValue *)(data - offsetof(DeltaValue, data));
+    v->next = delta->garbage;
+    delta->garbage = v;
+}
+
+static inline void
+delta_garbage_free (PsycDelta *delta)
+{
+    DeltaValue *v, *next;
+    for (v = delta->garbage; v; v = next) {
+	next = v->next;
+	free(v);
+    }
+    delta->garbage = NULL;
+}
+
+static inline void
+delta_var_free (PsycDelta *delta, PsycDeltaVar *var)
+{
+    free(var->name.data);
+    delta_value_release(delta, var->value.data);
+    *var = (PsycDeltaVar) {{0, 0}, {0, 0}};
+}
+
+void
+psyc_delta_free (PsycDelta *delta)
+{
+    size_t i;
+    for (i = 0; i < delta->num_vars; i++)
+	delta_var_free(delta, &delta->vars[i]);
+    delta_garbage_free(delta);
+
+    delta->num_vars = 0;
+    delta->resync = PSYC_TRUE;
+}
+
+static inline PsycDeltaVar *
+delta_var_get (PsycDelta *delta, PsycString *name)
+{
+    size_t i;
+    for (i = 0; i < delta->num_vars; i++)
+	if (delta->vars[i].name.length == name->length
+	    && memcmp(delta->vars[i].name.data, name->data, name->length) == 0)
+	    return &delta->vars[i];
+
+    return NULL;
+}
+
+static inline void
+delta_var_remove (PsycDelta *delta, PsycDeltaVar *var)
+{
+    delta_var_free(delta, var);
+    if (var != &delta->vars[--delta->num_vars])
+	*var = delta->vars[delta->num_vars];
+}
+
+/**
+ * Replace the value of a variable, or add a new variable.
+ *
+ * The old value is kept on the garbage list until the next diff,
+ * since the diminish operation refers to it.
+ *
+ * @return The variable, or NULL if it could not be stored.
+ */
+static inline PsycDeltaVar *
+delta_var_set (PsycDelta *delta, PsycDeltaVar *var, PsycModifier *mod)
+{
+    char *value = NULL;
+
+    if (mod->value.length) {
+	value = delta_value_alloc(mod->value.length);
+	if (!value) {
+	    if (var)
+		delta_var_remove(delta, var);
+	    return NULL;
+	}
+	memcpy(value, mod->value.data, mod->value.length);
+    }
+
+    if (!var) {
+	char *name = NULL;
+	if (delta->num_vars >= delta->max_vars
+	    || !(name = malloc(mod->name.length))) {
+	    delta_value_release(delta, value);
+	    return NULL;
+	}
+	memcpy(name, mod->name.data, mod->name.length);
+
+	var = &delta->vars[delta->num_vars++];
+	*var = (PsycDeltaVar) {PSYC_STRING(name, mod->name.length), {0, 0}};
+    }
+
+    delta_value_release(delta, var->value.data);
+    var->value = PSYC_STRING(value, mod->value.length);
+    return var;
+}
+
+/**
+ * Check if a list value only grew or shrunk at the end.
+ *
+ * @return The length of the common prefix ending at an element boundary,
+ *         or 0 if there's none.
+ */
+static inline size_t
+delta_list_prefix (PsycString *a, PsycString *b)
+{
+    PsycString *s = a->length < b->length ? a : b;
+    PsycString *l = a->length < b->length ? b : a;
+
+    if (s->length == 0 || s->length == l->length
+	|| l->data[s->length] != PSYC_LIST_ELEM_START
+	|| memcmp(s->data, l->data, s->length) != 0)
+	return 0;
+
+    return s->length;
+}
+
+PsycDeltaRC
+psyc_delta_diff (PsycDelta *delta, PsycModifier *entity, size_t entitylen,
+		 PsycModifier *out, size_t outmax, size_t *outlen,
+		 PsycStateOp *stateop)
+{
+    size_t i, len = 0, prefix;
+    PsycModifier *mod;
+    PsycDeltaVar *var;
+    PsycString old;
+
+    if (outmax < entitylen)
+	return PSYC_DELTA_ERROR_OUTPUT;
+
+    // values replaced by the previous diff are not referenced anymore
+    delta_garbage_free(delta);
+
+    for (i = 0; i < entitylen; i++) {
+	mod = &entity[i];
+	var = delta_var_get(delta, &mod->name);
+
+	if (mod->oper != PSYC_OPERATOR_ASSIGN) {
+	    // The receiver changes its state in a way we don't keep track of,
+	    // so send the full value next time.
+	    if (var && mod->oper != PSYC_OPERATOR_SET)
+		delta_var_remove(delta, var);
+	    out[len++] = *mod;
+	    continue;
+	}
+
+	if (var && var->value.length == mod->value.length
+	    && memcmp(var->value.data, mod->value.data, mod->value.length) == 0)
+	    continue; // unchanged
+
+	if (!mod->value.length) { // empty assign removes the variable
+	    if (var)
+		delta_var_remove(delta, var);
+	    out[len++] = *mod;
+	    continue;
+	}
+
+	old = var ? var->value : (PsycString) {0, 0};
+	var = delta_var_set(delta, var, mod);
+
+	if (!var || delta->resync) {
+	    // Variables we can't keep track of are always sent in full,
+	    // on resync the whole state is added after the loop.
+	    if (!var)
+		out[len++] = *mod;
+	    continue;
+	}
+
+	prefix = psyc_var_is_list(PSYC_S2ARG(mod->name))
+	    ? delta_list_prefix(&old, &mod->value) : 0;
+
+	if (prefix && mod->value.length > old.length)
+	    psyc_modifier_init(&out[len++], PSYC_OPERATOR_AUGMENT,
+			       PSYC_S2ARG(mod->name),
+			       mod->value.data + prefix,
+			       mod->value.length - prefix,
+			       PSYC_MODIFIER_CHECK_LENGTH);
+	else if (prefix)
+	    psyc_modifier_init(&out[len++], PSYC_OPERATOR_DIMINISH,
+			       PSYC_S2ARG(mod->name),
+			       old.data + prefix, old.length - prefix,
+			       PSYC_MODIFIER_CHECK_LENGTH);
+	else
+	    out[len++] = *mod;
+    }
+
+    *stateop = PSYC_STATE_NOOP;
+
+    if (delta->resync) {
+	if (outmax < len + delta->num_vars)
+	    return PSYC_DELTA_ERROR_OUTPUT;
+
+	for (i = 0; i < delta->num_vars; i++)
+	    psyc_modifier_init(&out[len++], PSYC_OPERATOR_ASSIGN,
+			       PSYC_S2ARG(delta->vars[i].name),
+			       PSYC_S2ARG(delta->vars[i].value),
+			       PSYC_MODIFIER_CHECK_LENGTH);
+
+	*stateop = PSYC_STATE_RESET;
+	delta->resync = PSYC_FALSE;
+    }
+
+    *outlen = len;
+    return PSYC_DELTA_SUCCESS;
+}
+
+PsycDeltaRC
+psyc_delta_packet_init (PsycDelta *delta, PsycPacket *packet,
+			PsycModifier *routing, size_t routinglen,
+			PsycModifier *entity, size_t entitylen,
+			PsycModifier *out, size_t outmax,
+			char *method, size_t methodlen,
+			char *data, size_t datalen,
+			PsycPacketFlag flag)
+{
+    size_t outlen;
+    PsycStateOp stateop;
+    PsycDeltaRC ret = psyc_delta_diff(delta, entity, entitylen,
+				      out, outmax, &outlen, &stateop);
+    if (ret != PSYC_DELTA_SUCCESS)
+	return ret;
+
+    psyc_packet_init(packet, routing, routinglen, out, outlen,
+		     method, methodlen, data, datalen, stateop, flag);
+    return PSYC_DELTA_SUCCESS;
+}
@@ -0,0 +1,144 @@
+#ifdef __linux__
+# define _GNU_SOURCE // splice()
+# include <fcntl.h>
+#endif
+
+#include "lib.h"
+#include <psyc/packet.h>
+#include <psyc/parse.h>
+#include <psyc/render.h>
+#include <psyc/forward.h>
+
+/**
+ * Replace the routing modifiers with the same name as the rewrite modifiers,
+ * append the rest.
+ *
+ * @return PSYC_FALSE if they don't fit in the routing array.
+ */
+static inline PsycBool
+forward_rewrite (PsycModifier *routing, size_t *num, size_t max,
+		 PsycModifier *rewrite, size_t rewritelen)
+{
+    size_t i, j;
+
+    for (i = 0; i < rewritelen; i++) {
+	for (j = 0; j < *num; j++)
+	    if (routing[j].name.length == rewrite[i].name.length
+		&& memcmp(routing[j].name.data, rewrite[i].name.data,
+			  rewrite[i].name.length) == 0)
+		break;
+
+	if (j == *num && (*num)++ == max)
+	    return PSYC_FALSE;
+	routing[j] = rewrite[i];
+    }
+
+    return PSYC_TRUE;
+}
+
+PsycForwardRC
+psyc_forward (char *buffer, size_t buflen,
+	      PsycModifier *rewrite, size_t rewritelen,
+	      PsycModifier *routing, size_t routingmax,
+	      char *header, size_t headerlen,
+	      struct iovec *iov, size_t *consumed, size_t *remaining)
+{
+    PsycParseState state;
+    PsycPacket packet;
+    PsycString name, value;
+    char oper, *content = NULL;
+    size_t num = 0, contentlen = 0;
+    int ret;
+
+    psyc_parse_state_init(&state, PSYC_PARSE_ROUTING_ONLY);
+    psyc_parse_buffer_set(&state, buffer, buflen);
+
+    do {
+	ret = psyc_parse(&state, &oper, &name, &value);
+	switch (ret) {
+	case PSYC_PARSE_ROUTING:
+	    if (num == routingmax)
+		return PSYC_FORWARD_ERROR_HEADER;
+	    psyc_modifier_init(&routing[num++], oper, PSYC_S2ARG(name),
+			       PSYC_S2ARG(value), PSYC_MODIFIER_ROUTING);
+	    break;
+	case PSYC_PARSE_CONTENT_START:
+	case PSYC_PARSE_CONTENT:
+	    content = value.data;
+	    contentlen = state.contentlen_found ? state.contentlen : value.length;
+	    break;
+	case PSYC_PARSE_COMPLETE:
+	    if (!content) // no content, only the delimiter
+		content = buffer + state.cursor - 2;
+	    break;
+	case PSYC_PARSE_INSUFFICIENT:
+	    // With a content length it's enough to have the routing header.
+	    if (state.contentlen_found
+		&& (content || state.part == PSYC_PART_DATA)) {
+		if (!content) { // content starts at the end of the buffer
+		    content = buffer + buflen;
+		    contentlen = state.contentlen;
+		}
+		break;
+	    }
+	    return PSYC_FORWARD_INSUFFICIENT;
+	default:
+	    return PSYC_FORWARD_ERROR;
+	}
+    } while (ret == PSYC_PARSE_ROUTING || ret == PSYC_PARSE_CONTENT);
+
+    if (!forward_rewrite(routing, &num, routingmax, rewrite, rewritelen))
+	return PSYC_FORWARD_ERROR_HEADER;
+
+    psyc_packet_init_raw(&packet, routing, num, content, contentlen,
+			 state.contentlen_found
+			 ? PSYC_PACKET_NEED_LENGTH : PSYC_PACKET_NO_LENGTH);
+    if (psyc_render_routing(&packet, header, headerlen) != PSYC_RENDER_SUCCESS)
+	return PSYC_FORWARD_ERROR_HEADER;
+
+    iov[0] = (struct iovec) {header, packet.length - packet.contentlen - 2};
+
+    if (ret == PSYC_PARSE_COMPLETE) {
+	*consumed = state.cursor;
+	*remaining = 0;
+    } else {
+	*consumed = buflen;
+	*remaining = contentlen + 2 - (buffer + buflen - content);
+    }
+    iov[1] = (struct iovec) {content, buffer + *consumed - content};
+
+    return *remaining ? PSYC_FORWARD_INCOMPLETE : PSYC_FORWARD_COMPLETE;
+}
+
+#ifdef __linux__
+ssize_t
+psyc_forward_splice (int in, int out, int pipefd[2], size_t len, size_t *piped)
+{
+    size_t moved = 0;
+    ssize_t n;
+
+    while (moved < len) {
+	if (!*piped) {
+	    n = splice(in, NULL, pipefd[1], NULL, len - moved,
+		       SPLICE_F_MOVE | SPLICE_F_MORE);
+	    if (n == 0) // end of file
+		break;
+	    if (n < 0)
+		return moved ? (ssize_t)moved : -1;
+	    *piped = n;
+	}
+
+	// write out what's in the pipe before reading more
+	while (*piped) {
+	    n = splice(pipefd[0], NULL, out, NULL, *piped,
+		       SPLICE_F_MOVE | SPLICE_F_MORE);
+	    if (n <= 0)
+		return moved ? (ssize_t)moved : -1;
+	    *piped -= n;
+	    moved += n;
+	}
+    }
+
+    return moved;
+}
+#endif
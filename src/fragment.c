@@ -0,0 +1,158 @@
+#include "lib.h"
+#include <psyc/packet.h>
+#include <psyc/parse.h>
+#include <psyc/render.h>
+#include <psyc/fragment.h>
+
+PsycRenderRC
+psyc_fragment_split (PsycPacket *p, char *content, size_t contentlen,
+		     size_t fragsize, char *headers, size_t headerslen,
+		     struct iovec *iov, size_t iovlen, size_t *num)
+{
+    static char delim[] = {PSYC_PACKET_DELIMITER_CHAR, '\n'};
+    size_t i, n, cur = 0, len, off;
+
+    if (!fragsize)
+	return PSYC_RENDER_ERROR;
+
+    n = contentlen ? (contentlen + fragsize - 1) / fragsize : 1;
+    if (n * PSYC_FRAGMENT_IOV > iovlen || p->routinglen > headerslen)
+	return PSYC_RENDER_ERROR;
+
+    // Routing modifiers common to all fragments are rendered only once.
+    for (i = 0; i < p->routing.lines; i++) {
+	len = psyc_render_modifier(&p->routing.modifiers[i], headers + cur);
+	cur += len;
+	if (len <= 1)
+	    return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+    }
+    ASSERT(cur == p->routinglen);
+
+    for (i = 0, off = 0; i < n; i++, off += len) {
+	char *h = headers + cur;
+	len = contentlen - off < fragsize ? contentlen - off : fragsize;
+
+	if (cur + PSYC_FRAGMENT_HEADER_MAX > headerslen)
+	    return PSYC_RENDER_ERROR;
+
+	memcpy(headers + cur, ":_fragment\t", 11);
+	cur += 11;
+	cur += utoa(i, headers + cur);
+	memcpy(headers + cur, "\n:_amount_fragments\t", 20);
+	cur += 20;
+	cur += utoa(n, headers + cur);
+	headers[cur++] = '\n';
+	// always add the length, the slice may contain a delimiter
+	cur += utoa(len, headers + cur);
+	headers[cur++] = '\n';
+
+	iov[i * PSYC_FRAGMENT_IOV] = (struct iovec) {headers, p->routinglen};
+	iov[i * PSYC_FRAGMENT_IOV + 1] = (struct iovec) {h, headers + cur - h};
+	iov[i * PSYC_FRAGMENT_IOV + 2] = (struct iovec) {content + off, len};
+	iov[i * PSYC_FRAGMENT_IOV + 3] = (struct iovec) {delim, sizeof(delim)};
+    }
+
+    *num = n;
+    return PSYC_RENDER_SUCCESS;
+}
+
+void
+psyc_reassembly_init (PsycReassembly *r, struct iovec *iov,
+		      size_t max_fragments, size_t max_length,
+		      uint64_t timeout)
+{
+    *r = (PsycReassembly) {
+	.iov = iov,
+	.max_fragments = max_fragments,
+	.max_length = max_length,
+	.timeout = timeout,
+    };
+    memset(iov, 0, sizeof(struct iovec) * max_fragments);
+}
+
+void
+psyc_reassembly_reset (PsycReassembly *r)
+{
+    if (r->amount)
+	memset(r->iov, 0, sizeof(struct iovec) * r->amount);
+
+    r->amount = 0;
+    r->received = 0;
+    r->length = 0;
+    r->deadline = 0;
+}
+
+PsycReassemblyRC
+psyc_reassembly_add (PsycReassembly *r, uint64_t fragment, uint64_t amount,
+		     char *content, size_t contentlen, uint64_t now)
+{
+    if (psyc_reassembly_expired(r, now))
+	return PSYC_REASSEMBLY_ERROR_TIMEOUT;
+
+    if (!amount || amount > r->max_fragments || fragment >= amount
+	|| (r->amount && amount != r->amount))
+	return PSYC_REASSEMBLY_ERROR_FRAGMENT;
+
+    // an empty fragment is marked by a non-NULL base
+    if (r->iov[fragment].iov_base)
+	return PSYC_REASSEMBLY_DUPLICATE;
+
+    if (contentlen > r->max_length - r->length)
+	return PSYC_REASSEMBLY_ERROR_MEMORY;
+
+    if (!r->received) {
+	r->amount = amount;
+	r->deadline = now + r->timeout;
+    }
+
+    r->iov[fragment] = (struct iovec) {content ? content : "", contentlen};
+    r->received++;
+    r->length += contentlen;
+
+    return r->received == r->amount
+	? PSYC_REASSEMBLY_COMPLETE : PSYC_REASSEMBLY_INCOMPLETE;
+}
+
+PsycReassemblyRC
+psyc_reassembly_gather (PsycReassembly *r, char *buffer, size_t buflen)
+{
+    size_t i, cur = 0;
+
+    if (!r->amount || r->received != r->amount || r->length > buflen)
+	return PSYC_REASSEMBLY_ERROR;
+
+    for (i = 0; i < r->amount; i++) {
+	memcpy(buffer + cur, r->iov[i].iov_base, r->iov[i].iov_len);
+	cur += r->iov[i].iov_len;
+    }
+
+    return PSYC_REASSEMBLY_COMPLETE;
+}
+
+PsycReassemblyRC
+psyc_reassembly_parse_init (PsycReassembly *r, PsycParseState *state,
+			    char *buffer, size_t buflen)
+{
+    size_t i;
+    char *content;
+
+    if (!r->amount || r->received != r->amount)
+	return PSYC_REASSEMBLY_ERROR;
+
+    // parse in place if the fragments are adjacent, e.g. for a single one
+    content = r->iov[0].iov_base;
+    for (i = 1; i < r->amount; i++)
+	if ((char *)r->iov[i - 1].iov_base + r->iov[i - 1].iov_len
+	    != r->iov[i].iov_base)
+	    break;
+
+    if (i < r->amount) {
+	if (psyc_reassembly_gather(r, buffer, buflen) != PSYC_REASSEMBLY_COMPLETE)
+	    return PSYC_REASSEMBLY_ERROR;
+	content = buffer;
+    }
+
+    psyc_parse_state_init(state, PSYC_PARSE_START_AT_CONTENT);
+    psyc_parse_buffer_set(state, content, r->length);
+    return PSYC_REASSEMBLY_COMPLETE;
+}
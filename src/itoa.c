@@ -1,5 +1,17 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#include <psyc.h>
+
 #define ALPHANUMS "zyxwvutsrqponmlkjihgfedcba9876543210123456789abcdefghijklmnopqrstuvwxyz"
 
+static const char DIGITS2[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
 /**
  * Converts an integer to a string, using a base of 10 by default.
  *
@@ -42,23 +54,59 @@ itoa (int number, char *out, int base)
     return count;
 }
 
+/**
+ * Converts an unsigned integer to a decimal string.
+ *
+ * The number of digits is counted first, then two digits are written at a
+ * time from the end, so no reversal is needed.
+ * The output is not NUL terminated, it needs at most 20 bytes.
+ *
+ * @return Number of digits written.
+ */
+size_t
+utoa (uint64_t number, char *out)
+{
+    size_t len = psyc_num_length(number), i = len;
+    unsigned d;
+
+    while (number >= 100) {
+	d = (number % 100) * 2;
+	number /= 100;
+	out[--i] = DIGITS2[d + 1];
+	out[--i] = DIGITS2[d];
+    }
+
+    if (number >= 10) {
+	d = number * 2;
+	out[1] = DIGITS2[d + 1];
+	out[0] = DIGITS2[d];
+    } else
+	out[0] = '0' + number;
+
+    return len;
+}
+
 /* This little test program shows that itoa() is roughly 3 times faster
  * than sprintf  --lynX
+ * and utoa() is faster than both.
  */
 #ifdef CMDTOOL
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 int
 main (int argc, char **argv)
 {
     char out[4404];
     int in[44];
-    int c, i, j;
+    int c, i, j, m;
+    clock_t start;
+    const char *methods[] = {"sprintf", "itoa", "itoa count", "utoa"};
 
-    if (argc < 3 || argc > sizeof(in)) {
+    if (argc < 3 || argc > sizeof(in) / sizeof(*in)) {
 	printf("Usage: %s <times> <numbers>+\n\n"
 	       "Example: %s 999999 123 234 345 -49 -21892\n",
 	       argv[0], argv[0]);
@@ -69,26 +117,36 @@ main (int argc, char **argv)
 	in[j] = atoi(argv[j]);
 	//printf("Got %d: %d\n", j, in[j]);
     }
-    for (i = in[1]; i; i--) {
-	c = 0;
-	for (j = argc - 1; j > 1; j--) {
-#if 0
-	    // use good old sprintf
-	    c += sprintf(&out[c], " %d", in[j]);
-#else
-#if 1
-	    // use the itoa implementation
-	    out[c++] = ' ';
-	    c += itoa(in[j], &out[c], 10);
-#else
-	    // just count the needed space
-	    c += itoa(in[j], NULL, 10) + 1;
-#endif
-#endif
+    for (m = 0; m < 4; m++) {
+	start = clock();
+	for (i = in[1]; i; i--) {
+	    c = 0;
+	    for (j = argc - 1; j > 1; j--) {
+		switch (m) {
+		case 0: // use good old sprintf
+		    c += sprintf(&out[c], " %d", in[j]);
+		    break;
+		case 1: // use the itoa implementation
+		    out[c++] = ' ';
+		    c += itoa(in[j], &out[c], 10);
+		    break;
+		case 2: // just count the needed space
+		    c += itoa(in[j], NULL, 10) + 1;
+		    break;
+		case 3: // use the utoa implementation
+		    out[c++] = ' ';
+		    if (in[j] < 0)
+			out[c++] = '-';
+		    c += utoa(in[j] < 0 ? -(int64_t)in[j] : in[j], &out[c]);
+		    out[c] = '\0';
+		    break;
+		}
+	    }
 	}
+	printf("%-10s %d times, %d count, buffer len: %zu, %.3fs\n",
+	       methods[m], in[1], c, m == 2 ? 0 : strlen(out),
+	       (double)(clock() - start) / CLOCKS_PER_SEC);
     }
-    printf("%d times, %d count, buffer len: %d, buffer: %s\n",
-	   in[1], c, strlen(out), "<omitted>");	// out
     return 0;
 }
 #endif
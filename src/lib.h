@@ -15,8 +15,40 @@
 void * memmem(const void *l, size_t l_len, const void *s, size_t s_len);
 #endif
 
+void * psyc_memmem(const void *l, size_t l_len, const void *s, size_t s_len);
+
 #if !defined(__USE_GNU) && !(defined(__FBSDID) && defined(__BSD_VISIBLE))
 int itoa(int number, char* out, int base);
 #endif
 
+size_t utoa(uint64_t number, char *out);
+
+/**
+ * Get the name to render, the compact keyword if the policy has one for it.
+ */
+static inline PsycString
+policy_name (PsycString *name, const PsycRenderPolicy *policy)
+{
+    const PsycString *compact;
+
+    if (policy->aliases && name->length
+	&& (compact = psyc_alias_compact(policy->aliases, PSYC_S2ARG(*name))))
+	return *compact;
+
+    return *name;
+}
+
+/**
+ * Decide if a packet needs a content length according to a render policy.
+ *
+ * Shared by psyc_packet_length_check_policy() and psyc_render_append_policy()
+ * so that they always agree.
+ *
+ * @param need_length Does any entity modifier need a length?
+ * @param contentlen Rendered length of the content.
+ */
+PsycPacketFlag
+packet_length_policy (PsycPacket *p, PsycBool need_length, size_t contentlen,
+		      const PsycRenderPolicy *policy);
+
 #endif // PSYC_LIB_H
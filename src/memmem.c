@@ -28,6 +28,12 @@
 
 #include <string.h>
 
+#include "lib.h"
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 /*
  * Find the first occurrence of the byte string s in byte string l.
  */
@@ -59,3 +65,186 @@ memmem(const void *l, size_t l_len, const void *s, size_t s_len)
 
     return NULL;
 }
+
+/*
+ * Needles up to this length are searched for with a filter on their first
+ * and last byte, longer ones with the Two-Way algorithm.
+ */
+#define MEMMEM_SHORT 32
+
+/*
+ * Search for a needle of 2 to MEMMEM_SHORT bytes: find the positions where
+ * both its first and last byte match, then compare the bytes in between.
+ */
+static inline const char *
+memmem_short (const char *l, size_t l_len, const char *s, size_t s_len)
+{
+    size_t i = 0, end = l_len - s_len + 1; // number of possible positions
+
+#ifdef __SSE2__
+    __m128i first = _mm_set1_epi8(s[0]), last = _mm_set1_epi8(s[s_len - 1]);
+    __m128i a, b;
+    unsigned int mask;
+    int bit;
+
+    for (; i + 16 <= end; i += 16) {
+	a = _mm_loadu_si128((const __m128i *)(l + i));
+	b = _mm_loadu_si128((const __m128i *)(l + i + s_len - 1));
+	mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first),
+					       _mm_cmpeq_epi8(b, last)));
+	while (mask) {
+	    bit = __builtin_ctz(mask);
+	    if (memcmp(l + i + bit + 1, s + 1, s_len - 2) == 0)
+		return l + i + bit;
+	    mask &= mask - 1;
+	}
+    }
+#endif
+
+    for (; i < end; i++)
+	if (l[i] == s[0] && l[i + s_len - 1] == s[s_len - 1]
+	    && memcmp(l + i + 1, s + 1, s_len - 2) == 0)
+	    return l + i;
+
+    return NULL;
+}
+
+/*
+ * Compute the critical factorization of the needle for Two-Way:
+ * the start of the maximal suffix in either lexicographic order, whichever
+ * is longer, and the period of the right half.
+ */
+static size_t
+memmem_factorize (const unsigned char *s, size_t s_len, size_t *period)
+{
+    size_t max_suffix = SIZE_MAX, max_suffix_rev = SIZE_MAX, j, k, p;
+    unsigned char a, b;
+
+    j = 0;
+    k = p = 1;
+    while (j + k < s_len) {
+	a = s[j + k];
+	b = s[max_suffix + k];
+	if (a < b) {
+	    j += k;
+	    k = 1;
+	    p = j - max_suffix;
+	} else if (a == b) {
+	    if (k != p)
+		k++;
+	    else {
+		j += p;
+		k = 1;
+	    }
+	} else {
+	    max_suffix = j++;
+	    k = p = 1;
+	}
+    }
+    *period = p;
+
+    j = 0;
+    k = p = 1;
+    while (j + k < s_len) {
+	a = s[j + k];
+	b = s[max_suffix_rev + k];
+	if (b < a) {
+	    j += k;
+	    k = 1;
+	    p = j - max_suffix_rev;
+	} else if (a == b) {
+	    if (k != p)
+		k++;
+	    else {
+		j += p;
+		k = 1;
+	    }
+	} else {
+	    max_suffix_rev = j++;
+	    k = p = 1;
+	}
+    }
+
+    if (max_suffix_rev + 1 < max_suffix + 1)
+	return max_suffix + 1;
+
+    *period = p;
+    return max_suffix_rev + 1;
+}
+
+/*
+ * Two-Way string matching, linear time and constant space.
+ */
+static const char *
+memmem_twoway (const char *l, size_t l_len, const char *s, size_t s_len)
+{
+    const unsigned char *h = (const unsigned char *) l;
+    const unsigned char *n = (const unsigned char *) s;
+    size_t suffix, period, memory = 0, i, j = 0;
+
+    suffix = memmem_factorize(n, s_len, &period);
+
+    if (memcmp(n, n + period, suffix) == 0) {
+	// periodic needle, remember the part of the period already matched
+	while (j <= l_len - s_len) {
+	    i = suffix > memory ? suffix : memory;
+	    while (i < s_len && n[i] == h[i + j])
+		i++;
+	    if (i < s_len) {
+		j += i - suffix + 1;
+		memory = 0;
+		continue;
+	    }
+
+	    i = suffix - 1;
+	    while (memory < i + 1 && n[i] == h[i + j])
+		i--;
+	    if (i + 1 < memory + 1)
+		return l + j;
+
+	    j += period;
+	    memory = s_len - period;
+	}
+    } else {
+	// halves are distinct, any mismatch allows a maximal shift
+	period = (suffix > s_len - suffix ? suffix : s_len - suffix) + 1;
+	while (j <= l_len - s_len) {
+	    i = suffix;
+	    while (i < s_len && n[i] == h[i + j])
+		i++;
+	    if (i < s_len) {
+		j += i - suffix + 1;
+		continue;
+	    }
+
+	    i = suffix - 1;
+	    while (i != SIZE_MAX && n[i] == h[i + j])
+		i--;
+	    if (i == SIZE_MAX)
+		return l + j;
+
+	    j += period;
+	}
+    }
+
+    return NULL;
+}
+
+/*
+ * Find the first occurrence of the byte string s in byte string l,
+ * with a search method depending on the length of s.
+ */
+void *
+psyc_memmem (const void *l, size_t l_len, const void *s, size_t s_len)
+{
+    if (l_len == 0 || s_len == 0 || l_len < s_len)
+	return NULL;
+
+    if (s_len == 1)
+	return memchr(l, *(const char *) s, l_len);
+
+    if (s_len <= MEMMEM_SHORT)
+	return (void *) memmem_short(l, l_len, s, s_len);
+
+    return (void *) memmem_twoway(l, l_len, s, s_len);
+}
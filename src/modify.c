@@ -0,0 +1,278 @@
+#include "lib.h"
+#include <psyc/packet.h>
+#include <psyc/parse.h>
+#include <psyc/render.h>
+#include <psyc/modify.h>
+
+void
+psyc_modpacket_init (PsycModPacket *mp,
+		     PsycModifier *routing, PsycString *routing_raw,
+		     size_t routingmax,
+		     PsycModifier *entity, PsycString *entity_raw,
+		     size_t entitymax)
+{
+    *mp = (PsycModPacket) {
+	.packet = PSYC_PACKET(routing, 0, entity, 0, NULL, 0, NULL, 0,
+			      PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH),
+	.routing_raw = routing_raw,
+	.entity_raw = entity_raw,
+	.routingmax = routingmax,
+	.entitymax = entitymax,
+    };
+}
+
+/**
+ * Add a parsed modifier with its source bytes:
+ * oper name [SP length] TAB value NL
+ */
+static inline PsycBool
+modpacket_parsed (PsycHeader *h, PsycString *raw, size_t max, char oper,
+		  PsycString *name, PsycString *value, PsycModifierFlag flag)
+{
+    if (h->lines >= max)
+	return PSYC_FALSE;
+
+    h->modifiers[h->lines] = PSYC_MODIFIER(oper, *name, *value, flag);
+    raw[h->lines] = PSYC_STRING(name->data - 1,
+				value->data + value->length + 1
+				- (name->data - 1));
+    h->lines++;
+    return PSYC_TRUE;
+}
+
+PsycParseRC
+psyc_modpacket_parse (PsycModPacket *mp, char *buffer, size_t buflen,
+		      PsycParseFlag flags)
+{
+    PsycPacket *p = &mp->packet;
+    PsycParseState state;
+    PsycString name, value;
+    char oper;
+    PsycParseRC ret;
+
+    p->routing.lines = p->entity.lines = 0;
+    p->method = p->data = p->content = (PsycString) {0, 0};
+    p->stateop = PSYC_STATE_NOOP;
+
+    psyc_parse_state_init(&state, flags);
+    psyc_parse_buffer_set(&state, buffer, buflen);
+
+    for (;;) {
+	ret = psyc_parse(&state, &oper, &name, &value);
+
+	switch (ret) {
+	case PSYC_PARSE_ROUTING:
+	    if (!modpacket_parsed(&p->routing, mp->routing_raw, mp->routingmax,
+				  oper, &name, &value, PSYC_MODIFIER_ROUTING))
+		return PSYC_PARSE_ERROR;
+	    break;
+	case PSYC_PARSE_STATE_RESYNC:
+	case PSYC_PARSE_STATE_RESET:
+	    p->stateop = oper;
+	    break;
+	case PSYC_PARSE_ENTITY:
+	    if (!modpacket_parsed(&p->entity, mp->entity_raw, mp->entitymax,
+				  oper, &name, &value,
+				  psyc_parse_value_length_found(&state)
+				  ? PSYC_MODIFIER_NEED_LENGTH
+				  : PSYC_MODIFIER_NO_LENGTH))
+		return PSYC_PARSE_ERROR;
+	    break;
+	case PSYC_PARSE_BODY: // same as PSYC_PARSE_CONTENT
+	    if (flags & PSYC_PARSE_ROUTING_ONLY)
+		p->content = value;
+	    else {
+		p->method = name;
+		p->data = value;
+	    }
+	    break;
+	case PSYC_PARSE_COMPLETE:
+	    p->flag = psyc_parse_content_length_found(&state)
+		? PSYC_PACKET_NEED_LENGTH : PSYC_PACKET_NO_LENGTH;
+	    psyc_packet_length_set(p);
+	    return ret;
+	case PSYC_PARSE_ENTITY_START:
+	case PSYC_PARSE_ENTITY_CONT:
+	case PSYC_PARSE_ENTITY_END:
+	case PSYC_PARSE_BODY_START:
+	case PSYC_PARSE_BODY_CONT:
+	case PSYC_PARSE_BODY_END:
+	    // only happens with an incomplete buffer
+	    return PSYC_PARSE_INSUFFICIENT;
+	default:
+	    return ret;
+	}
+    }
+}
+
+PsycModifier *
+psyc_modpacket_find (PsycModPacket *mp, const char *name, size_t namelen)
+{
+    PsycHeader *h[] = {&mp->packet.routing, &mp->packet.entity};
+    size_t i, j;
+
+    for (i = 0; i < 2; i++)
+	for (j = 0; j < h[i]->lines; j++)
+	    if (h[i]->modifiers[j].name.length == namelen
+		&& memcmp(h[i]->modifiers[j].name.data, name, namelen) == 0)
+		return &h[i]->modifiers[j];
+
+    return NULL;
+}
+
+void
+psyc_modpacket_set (PsycModPacket *mp, PsycModifier *m,
+		    char *value, size_t valuelen)
+{
+    m->value = PSYC_STRING(value, valuelen);
+    if (!(m->flag & PSYC_MODIFIER_ROUTING))
+	m->flag = psyc_modifier_length_check(m);
+}
+
+PsycModifier *
+psyc_modpacket_add (PsycModPacket *mp, PsycOperator oper,
+		    char *name, size_t namelen,
+		    char *value, size_t valuelen, PsycModifierFlag flag)
+{
+    PsycHeader *h = &mp->packet.entity;
+    PsycString *raw = mp->entity_raw;
+    size_t max = mp->entitymax;
+
+    if (flag == PSYC_MODIFIER_ROUTING) {
+	h = &mp->packet.routing;
+	raw = mp->routing_raw;
+	max = mp->routingmax;
+    }
+
+    if (h->lines >= max)
+	return NULL;
+
+    raw[h->lines] = (PsycString) {0, 0};
+    psyc_modifier_init(&h->modifiers[h->lines], oper, name, namelen,
+		       value, valuelen, flag);
+    return &h->modifiers[h->lines++];
+}
+
+void
+psyc_modpacket_remove (PsycModPacket *mp, PsycModifier *m)
+{
+    PsycHeader *h = &mp->packet.entity;
+    PsycString *raw = mp->entity_raw;
+    size_t i;
+
+    if (m >= mp->packet.routing.modifiers
+	&& m < mp->packet.routing.modifiers + mp->packet.routing.lines) {
+	h = &mp->packet.routing;
+	raw = mp->routing_raw;
+    }
+
+    i = m - h->modifiers;
+    ASSERT(i < h->lines);
+
+    h->lines--;
+    memmove(&h->modifiers[i], &h->modifiers[i + 1],
+	    (h->lines - i) * sizeof(PsycModifier));
+    memmove(&raw[i], &raw[i + 1], (h->lines - i) * sizeof(PsycString));
+}
+
+/**
+ * Check if a modifier still matches its source bytes.
+ */
+static inline PsycBool
+modpacket_unchanged (PsycModifier *m, PsycString *raw)
+{
+    PsycBool has_length = m->value.length
+	&& (m->flag & PSYC_MODIFIER_NEED_LENGTH
+	    || m->flag == PSYC_MODIFIER_CHECK_LENGTH);
+
+    return raw->length
+	&& raw->data[0] == m->oper
+	&& raw->data + 1 == m->name.data
+	&& raw->data + raw->length == m->value.data + m->value.length + 1
+	&& (m->value.data > m->name.data + m->name.length + 1) == has_length;
+}
+
+/**
+ * Copy or render the modifiers of a header.
+ *
+ * @return Number of bytes written, or 0 if a modifier name is missing.
+ */
+static inline size_t
+modpacket_header (PsycHeader *h, PsycString *raw, char *buffer)
+{
+    size_t i, cur = 0, len;
+
+    for (i = 0; i < h->lines; i++) {
+	if (modpacket_unchanged(&h->modifiers[i], &raw[i])) {
+	    memcpy(buffer + cur, PSYC_S2ARG(raw[i]));
+	    cur += raw[i].length;
+	} else {
+	    len = psyc_render_modifier(&h->modifiers[i], buffer + cur);
+	    if (len <= 1)
+		return 0;
+	    cur += len;
+	}
+    }
+
+    return cur;
+}
+
+PsycRenderRC
+psyc_modpacket_render (PsycModPacket *mp, char *buffer, size_t buflen)
+{
+    PsycPacket *p = &mp->packet;
+    size_t cur, len;
+
+    if (p->flag != PSYC_PACKET_NEED_LENGTH
+	&& psyc_packet_length_check(p) == PSYC_PACKET_NEED_LENGTH)
+	p->flag = PSYC_PACKET_NEED_LENGTH;
+    psyc_packet_length_set(p);
+
+    if (p->length > buflen)
+	return PSYC_RENDER_ERROR;
+    if (p->data.length && !p->method.length)
+	return PSYC_RENDER_ERROR_METHOD_MISSING;
+
+    cur = modpacket_header(&p->routing, mp->routing_raw, buffer);
+    if (cur != p->routinglen)
+	return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+
+    if (p->contentlen) {
+	if (!(p->flag & PSYC_PACKET_NO_LENGTH))
+	    cur += utoa(p->contentlen, buffer + cur);
+	buffer[cur++] = '\n';
+    }
+
+    if (p->content.length) {
+	memcpy(buffer + cur, PSYC_S2ARG(p->content));
+	cur += p->content.length;
+    } else {
+	if (p->stateop) {
+	    buffer[cur++] = p->stateop;
+	    buffer[cur++] = '\n';
+	}
+
+	len = modpacket_header(&p->entity, mp->entity_raw, buffer + cur);
+	if (!len && p->entity.lines)
+	    return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+	cur += len;
+
+	if (p->method.length) {
+	    memcpy(buffer + cur, PSYC_S2ARG(p->method));
+	    cur += p->method.length;
+	    buffer[cur++] = '\n';
+
+	    if (p->data.length) {
+		memcpy(buffer + cur, PSYC_S2ARG(p->data));
+		cur += p->data.length;
+		buffer[cur++] = '\n';
+	    }
+	}
+    }
+
+    buffer[cur++] = PSYC_PACKET_DELIMITER_CHAR;
+    buffer[cur++] = '\n';
+
+    ASSERT(cur == p->length);
+    return PSYC_RENDER_SUCCESS;
+}
@@ -2,15 +2,23 @@
 #include <psyc/packet.h>
 
 inline PsycElemFlag
-psyc_elem_length_check (PsycString *value, const char end)
+psyc_elem_length_check_policy (PsycString *value, const char end,
+			       const PsycRenderPolicy *policy)
 {
-    if (value->length > PSYC_ELEM_SIZE_THRESHOLD
+    if (value->length > psyc_policy_threshold(policy, policy->elem_threshold)
 	|| memchr(value->data, (int)end, value->length))
 	return PSYC_ELEM_NEED_LENGTH;
 
     return PSYC_ELEM_NO_LENGTH;;
 }
 
+inline PsycElemFlag
+psyc_elem_length_check (PsycString *value, const char end)
+{
+    return psyc_elem_length_check_policy(value, end,
+					 &PSYC_RENDER_POLICY_DEFAULT);
+}
+
 inline size_t
 psyc_elem_length (PsycElem *elem)
 {
@@ -31,7 +39,7 @@ psyc_dict_key_length (PsycDictKey *elem)
 }
 
 inline size_t
-psyc_list_length_set (PsycList *list)
+psyc_list_length_set_policy (PsycList *list, const PsycRenderPolicy *policy)
 {
     size_t i;
     PsycElem *elem;
@@ -41,7 +49,7 @@ psyc_list_length_set (PsycList *list)
     for (i = 0; i < list->num_elems; i++) {
 	elem = &list->elems[i];
 	if (elem->flag == PSYC_ELEM_CHECK_LENGTH)
-	    elem->flag = psyc_elem_length_check(&elem->value, '|');
+	    elem->flag = psyc_elem_length_check_policy(&elem->value, '|', policy);
 	elem->length = psyc_elem_length(elem);
 	list->length += 1 + elem->length;
     }
@@ -50,7 +58,13 @@ psyc_list_length_set (PsycList *list)
 }
 
 inline size_t
-psyc_dict_length_set (PsycDict *dict)
+psyc_list_length_set (PsycList *list)
+{
+    return psyc_list_length_set_policy(list, &PSYC_RENDER_POLICY_DEFAULT);
+}
+
+inline size_t
+psyc_dict_length_set_policy (PsycDict *dict, const PsycRenderPolicy *policy)
 {
     size_t i;
     PsycDictKey *key;
@@ -63,9 +77,10 @@ psyc_dict_length_set (PsycDict *dict)
 	value = &dict->elems[i].value;
 
 	if (key->flag == PSYC_ELEM_CHECK_LENGTH)
-	    key->flag = psyc_elem_length_check(&key->value, '}');
+	    key->flag = psyc_elem_length_check_policy(&key->value, '}', policy);
 	if (value->flag == PSYC_ELEM_CHECK_LENGTH)
-	    value->flag = psyc_elem_length_check(&value->value, '{');
+	    value->flag = psyc_elem_length_check_policy(&value->value, '{',
+							   policy);
 
 	key->length = psyc_dict_key_length(key);
 	value->length = psyc_elem_length(value);
@@ -76,6 +91,12 @@ psyc_dict_length_set (PsycDict *dict)
     return dict->length;
 }
 
+inline size_t
+psyc_dict_length_set (PsycDict *dict)
+{
+    return psyc_dict_length_set_policy(dict, &PSYC_RENDER_POLICY_DEFAULT);
+}
+
 void
 psyc_list_init (PsycList *list, PsycElem *elems, size_t num_elems)
 {
@@ -112,29 +133,70 @@ psyc_modifier_length (PsycModifier *m)
     return length;
 }
 
-inline PsycPacketFlag
-psyc_packet_length_check (PsycPacket *p)
+PsycPacketFlag
+packet_length_policy (PsycPacket *p, PsycBool need_length, size_t contentlen,
+		      const PsycRenderPolicy *policy)
 {
+    // If any entity modifiers need length, it is possible they contain
+    // a packet terminator, thus the content should have a length as well.
+    if (need_length)
+	return PSYC_PACKET_NEED_LENGTH;
+
     if (p->data.length == 1 && p->data.data[0] == PSYC_PACKET_DELIMITER_CHAR)
 	return PSYC_PACKET_NEED_LENGTH;
 
-    if (p->data.length > PSYC_CONTENT_SIZE_THRESHOLD)
+    if (p->data.length > psyc_policy_threshold(policy,
+					       policy->content_threshold))
 	return PSYC_PACKET_NEED_LENGTH;
 
-    int i;
-    // If any entity modifiers need length, it is possible they contain
-    // a packet terminator, thus the content should have a length as well.
-    for (i = 0; i < p->entity.lines; i++)
-	if (p->entity.modifiers[i].flag & PSYC_MODIFIER_NEED_LENGTH
-	    || p->entity.modifiers[i].flag == PSYC_MODIFIER_CHECK_LENGTH)
-	    return PSYC_PACKET_NEED_LENGTH;
+    // Let routing-only receivers skip large content.
+    if (policy->mode == PSYC_POLICY_RECEIVER_COST
+	&& contentlen > policy->skip_size)
+	return PSYC_PACKET_NEED_LENGTH;
 
-    if (memmem(p->data.data, p->data.length, PSYC_C2ARG(PSYC_PACKET_DELIMITER)))
+    if (psyc_memmem(p->data.data, p->data.length, PSYC_C2ARG(PSYC_PACKET_DELIMITER)))
 	return PSYC_PACKET_NEED_LENGTH;
 
     return PSYC_PACKET_NO_LENGTH;
 }
 
+inline PsycPacketFlag
+psyc_packet_length_check_policy (PsycPacket *p, const PsycRenderPolicy *policy)
+{
+    PsycBool need_length = PSYC_FALSE;
+    PsycModifier m;
+    size_t i, contentlen = p->content.length;
+
+    // size the content as psyc_render_append_policy() renders it
+    if (!contentlen) {
+	if (p->stateop != PSYC_STATE_NOOP)
+	    contentlen += 2; // op\n
+
+	for (i = 0; i < p->entity.lines; i++) {
+	    m = p->entity.modifiers[i];
+	    if (m.flag == PSYC_MODIFIER_CHECK_LENGTH)
+		m.flag = psyc_modifier_length_check_policy(&m, policy);
+	    if (m.flag & PSYC_MODIFIER_NEED_LENGTH)
+		need_length = PSYC_TRUE;
+	    m.name = policy_name(&m.name, policy);
+	    contentlen += psyc_modifier_length(&m);
+	}
+
+	if (p->method.length)
+	    contentlen += policy_name(&p->method, policy).length + 1; // method\n
+	if (p->data.length)
+	    contentlen += p->data.length + 1; // data\n
+    }
+
+    return packet_length_policy(p, need_length, contentlen, policy);
+}
+
+inline PsycPacketFlag
+psyc_packet_length_check (PsycPacket *p)
+{
+    return psyc_packet_length_check_policy(p, &PSYC_RENDER_POLICY_DEFAULT);
+}
+
 inline size_t
 psyc_packet_length_set (PsycPacket *p)
 {
@@ -178,13 +240,19 @@ psyc_packet_length_set (PsycPacket *p)
 }
 
 inline void
-psyc_packet_init (PsycPacket *p,
-		  PsycModifier *routing, size_t routinglen,
-		  PsycModifier *entity, size_t entitylen,
-		  char *method, size_t methodlen,
-		  char *data, size_t datalen,
-		  char stateop, PsycPacketFlag flag)
+psyc_packet_init_policy (PsycPacket *p,
+			 PsycModifier *routing, size_t routinglen,
+			 PsycModifier *entity, size_t entitylen,
+			 char *method, size_t methodlen,
+			 char *data, size_t datalen,
+			 char stateop, PsycPacketFlag flag,
+			 const PsycRenderPolicy *policy)
 {
+    // psyc_render() doesn't use compact names, don't count them either
+    PsycRenderPolicy pol = *policy;
+    size_t i;
+    pol.aliases = NULL;
+
     *p = (PsycPacket) {
 	.routing = {routinglen, routing},
 	.entity = {entitylen, entity},
@@ -198,17 +266,35 @@ psyc_packet_init (PsycPacket *p,
 	.flag = flag,
     };
 
+    for (i = 0; i < entitylen; i++)
+	if (entity[i].flag == PSYC_MODIFIER_CHECK_LENGTH)
+	    entity[i].flag = psyc_modifier_length_check_policy(&entity[i], &pol);
+
     if (flag == PSYC_PACKET_CHECK_LENGTH) // find out if it needs length
-	p->flag = psyc_packet_length_check(p);
+	p->flag = psyc_packet_length_check_policy(p, &pol);
 
     psyc_packet_length_set(p);
 }
 
 inline void
-psyc_packet_init_raw (PsycPacket *p,
-		      PsycModifier *routing, size_t routinglen,
-		      char *content, size_t contentlen,
-		      PsycPacketFlag flag)
+psyc_packet_init (PsycPacket *p,
+		  PsycModifier *routing, size_t routinglen,
+		  PsycModifier *entity, size_t entitylen,
+		  char *method, size_t methodlen,
+		  char *data, size_t datalen,
+		  char stateop, PsycPacketFlag flag)
+{
+    psyc_packet_init_policy(p, routing, routinglen, entity, entitylen,
+			    method, methodlen, data, datalen, stateop, flag,
+			    &PSYC_RENDER_POLICY_DEFAULT);
+}
+
+inline void
+psyc_packet_init_raw_policy (PsycPacket *p,
+			     PsycModifier *routing, size_t routinglen,
+			     char *content, size_t contentlen,
+			     PsycPacketFlag flag,
+			     const PsycRenderPolicy *policy)
 {
     *p = (PsycPacket) {
 	.routing = {routinglen, routing},
@@ -224,11 +310,21 @@ psyc_packet_init_raw (PsycPacket *p,
     };
 
     if (flag == PSYC_PACKET_CHECK_LENGTH) // find out if it needs length
-	p->flag = psyc_packet_length_check(p);
+	p->flag = psyc_packet_length_check_policy(p, policy);
 
     psyc_packet_length_set(p);
 }
 
+inline void
+psyc_packet_init_raw (PsycPacket *p,
+		      PsycModifier *routing, size_t routinglen,
+		      char *content, size_t contentlen,
+		      PsycPacketFlag flag)
+{
+    psyc_packet_init_raw_policy(p, routing, routinglen, content, contentlen,
+				flag, &PSYC_RENDER_POLICY_DEFAULT);
+}
+
 void
 psyc_packet_id (PsycList *list, PsycElem *elems,
 		char *context, size_t contextlen,
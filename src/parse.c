@@ -198,13 +198,98 @@ psyc_parse_modifier (PsycParseState *state, char *oper,
 	return PSYC_PARSE_ERROR_MOD_TAB;
 }
 
-/** Parse PSYC packets. */
-#ifdef __INLINE_PSYC_PARSE
-static inline
+#ifdef PSYC_PARSE_STATS
+static PsycParseStats parse_stats;
+
+# define STATS_ADD(field, n)						\
+    do {								\
+	state->stats.field += (n);					\
+	__atomic_fetch_add(&parse_stats.field, (n), __ATOMIC_RELAXED);	\
+    } while (0)
+
+/**
+ * Count the bytes scanned in the current part up to end.
+ */
+static inline void
+parse_stats_scanned (PsycParseState *state, size_t end)
+{
+    if (state->stats_part != PSYC_PART_RESET && end > state->stats_cursor)
+	STATS_ADD(bytes[state->stats_part], end - state->stats_cursor);
+    state->stats_cursor = end;
+}
+
+/**
+ * Update the counters after psyc_parse() returned.
+ */
+static inline void
+parse_stats_count (PsycParseState *state, PsycParseRC ret)
+{
+    size_t end = state->cursor;
+
+    switch (ret) {
+    case PSYC_PARSE_INSUFFICIENT:
+	// the cursor was rewound, but the rest of the buffer was scanned
+	end = state->buffer.length;
+	STATS_ADD(rewinds, 1);
+	if (end > state->cursor)
+	    STATS_ADD(rescanned, end - state->cursor);
+	break;
+    case PSYC_PARSE_ROUTING:
+    case PSYC_PARSE_ENTITY_START:
+    case PSYC_PARSE_ENTITY:
+	if (state->valuelen_found)
+	    STATS_ADD(binary, 1);
+	else
+	    STATS_ADD(simple, 1);
+	break;
+    case PSYC_PARSE_BODY_START:
+    case PSYC_PARSE_BODY:
+	if (state->contentlen_found)
+	    STATS_ADD(binary, 1);
+	else
+	    STATS_ADD(simple, 1);
+	break;
+    default:
+	if (ret < 0 && -ret < PSYC_PARSE_STATS_ERRORS)
+	    STATS_ADD(errors[-ret], 1);
+    }
+
+    parse_stats_scanned(state, end);
+}
+
+void
+psyc_parse_stats_global (PsycParseStats *stats)
+{
+    const size_t *src = (const size_t *) &parse_stats;
+    size_t *dst = (size_t *) stats, i;
+
+    for (i = 0; i < sizeof(PsycParseStats) / sizeof(size_t); i++)
+	dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+}
+
+void
+psyc_parse_stats_global_reset (void)
+{
+    size_t *dst = (size_t *) &parse_stats, i;
+
+    for (i = 0; i < sizeof(PsycParseStats) / sizeof(size_t); i++)
+	__atomic_store_n(&dst[i], 0, __ATOMIC_RELAXED);
+}
+
+/// Count the following bytes for part p, without changing the state.
+# define STATS_PART(p) (parse_stats_scanned(state, state->cursor),	\
+			state->stats_part = (p))
+/// Set the part being parsed, counting the bytes scanned in the previous one.
+# define PART_SET(p) (STATS_PART(p), state->part = (p))
+#else
+# define STATS_PART(p)
+# define PART_SET(p) (state->part = (p))
 #endif
-PsycParseRC
-psyc_parse (PsycParseState *state, char *oper,
-	    PsycString *name, PsycString *value)
+
+/** Parse PSYC packets. */
+static inline PsycParseRC
+parse_packet (PsycParseState *state, char *oper,
+	      PsycString *name, PsycString *value)
 {
 #ifdef DEBUG
     if (state->flags & PSYC_PARSE_ROUTING_ONLY &&
@@ -235,7 +320,7 @@ psyc_parse (PsycParseState *state, char *oper,
 	state->content_parsed = 0;
 	state->contentlen = 0;
 	state->contentlen_found = 0;
-	state->part = PSYC_PART_ROUTING;
+	PART_SET(PSYC_PART_ROUTING);
 	// fall thru
 
     case PSYC_PART_ROUTING:
@@ -253,7 +338,7 @@ psyc_parse (PsycParseState *state, char *oper,
 	    state->routinglen += state->cursor - pos;
 	    return ret == PARSE_SUCCESS ? PSYC_PARSE_ROUTING : ret;
 	} else { // not a glyph
-	    state->part = PSYC_PART_LENGTH;
+	    PART_SET(PSYC_PART_LENGTH);
 	    state->startc = state->cursor;
 	    // fall thru
 	}
@@ -273,6 +358,8 @@ psyc_parse (PsycParseState *state, char *oper,
 	}
 
 	if (state->buffer.data[state->cursor] == '\n') { // start of content
+	    // The newline is still counted as length, the stats of the next
+	    // part start after it.
 	    // If we need to parse the header only and we know the content length,
 	    // then skip content parsing.
 	    if (state->flags & PSYC_PARSE_ROUTING_ONLY) {
@@ -287,7 +374,7 @@ psyc_parse (PsycParseState *state, char *oper,
 	    if (state->contentlen_found)
 		return PSYC_PARSE_ERROR_LENGTH;
 
-	    state->part = PSYC_PART_END;
+	    PART_SET(PSYC_PART_END);
 	    goto PSYC_PART_END;
 	}
 
@@ -296,6 +383,7 @@ psyc_parse (PsycParseState *state, char *oper,
 	// fall thru
 
     case PSYC_PART_CONTENT:
+	STATS_PART(PSYC_PART_CONTENT);
 	// In case of an incomplete binary variable resume parsing it.
 	if (state->value_parsed < state->valuelen) {
 	    ret = parse_binary((ParseState*)state, state->valuelen, value,
@@ -351,7 +439,7 @@ psyc_parse (PsycParseState *state, char *oper,
 	} else {
 	    state->content_parsed += state->cursor - pos;
 	    state->startc = state->cursor;
-	    state->part = PSYC_PART_METHOD;
+	    PART_SET(PSYC_PART_METHOD);
 	    // fall thru
 	}
 
@@ -375,12 +463,12 @@ psyc_parse (PsycParseState *state, char *oper,
 		state->cursor++;
 		state->startc = state->cursor;
 		state->content_parsed += state->cursor - pos;
-		state->part = PSYC_PART_DATA;
+		PART_SET(PSYC_PART_DATA);
 	    } else { // Otherwise keep it at the beginning of method.
 		ADVANCE_CURSOR_OR_RETURN(PSYC_PARSE_INSUFFICIENT);
 	    }
 	} else { // No method, which means the packet should end now.
-	    state->part = PSYC_PART_END;
+	    PART_SET(PSYC_PART_END);
 	    state->startc = state->cursor;
 	    goto PSYC_PART_END;
 	}
@@ -388,6 +476,9 @@ psyc_parse (PsycParseState *state, char *oper,
 
     case PSYC_PART_DATA:
     PSYC_PART_DATA:
+	// without a length the part stays at the method, so that parsing
+	// resumes there, but the data is counted as data
+	STATS_PART(PSYC_PART_DATA);
 	value->data = state->buffer.data + state->cursor;
 	value->length = 0;
 
@@ -408,7 +499,7 @@ psyc_parse (PsycParseState *state, char *oper,
 			? PSYC_PARSE_BODY_START : PSYC_PARSE_BODY_CONT;
 	    }
 
-	    state->part = PSYC_PART_END;
+	    PART_SET(PSYC_PART_END);
 	    return state->valuelen == value->length ?
 		PSYC_PARSE_BODY : PSYC_PARSE_BODY_END;
 	} else { // Search for the terminator.
@@ -434,7 +525,7 @@ psyc_parse (PsycParseState *state, char *oper,
 
 			state->content_parsed += state->cursor - pos;
 			state->cursor += nl;
-			state->part = PSYC_PART_END;
+			PART_SET(PSYC_PART_END);
 			return PSYC_PARSE_BODY;
 		    }
 		}
@@ -466,16 +557,37 @@ psyc_parse (PsycParseState *state, char *oper,
 	    && state->buffer.data[state->cursor + 1] == '\n') {
 	    // Packet ends here.
 	    state->cursor += 2;
-	    state->part = PSYC_PART_RESET;
+	    PART_SET(PSYC_PART_RESET);
 	    return PSYC_PARSE_COMPLETE;
 	} else { // Packet should've ended here, return error.
-	    state->part = PSYC_PART_RESET;
+	    PART_SET(PSYC_PART_RESET);
 	    return PSYC_PARSE_ERROR_END;
 	}
     }
     return PSYC_PARSE_ERROR; // should not be reached
 }
 
+#ifdef __INLINE_PSYC_PARSE
+static inline
+#endif
+PsycParseRC
+psyc_parse (PsycParseState *state, char *oper,
+	    PsycString *name, PsycString *value)
+{
+#ifdef PSYC_PARSE_STATS
+    PsycParseRC ret;
+
+    state->stats_cursor = state->cursor;
+    state->stats_part = state->part;
+    ret = parse_packet(state, oper, name, value);
+    parse_stats_count(state, ret);
+
+    return ret;
+#else
+    return parse_packet(state, oper, name, value);
+#endif
+}
+
 /**
  * Parse list.
  *
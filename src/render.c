@@ -1,8 +1,14 @@
 #include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
 
 #include "lib.h"
 #include <psyc/packet.h>
 #include <psyc/render.h>
+#include <psyc/compact.h>
 
 inline PsycRenderRC
 psyc_render_elem (PsycElem *elem, char *buffer, size_t buflen)
@@ -21,7 +27,7 @@ psyc_render_elem (PsycElem *elem, char *buffer, size_t buflen)
     if (elem->value.length && !(elem->flag & PSYC_ELEM_NO_LENGTH)) {
 	if (elem->type.length)
 	    buffer[cur++] = ':';
-	cur += itoa(elem->value.length, buffer + cur, 10);
+	cur += utoa(elem->value.length, buffer + cur);
     }
 
     if (elem->value.length) {
@@ -44,7 +50,7 @@ psyc_render_dict_key (PsycDictKey *elem, char *buffer, size_t buflen)
 	return PSYC_RENDER_ERROR;
 
     if (elem->value.length && !(elem->flag & PSYC_ELEM_NO_LENGTH))
-	cur += itoa(elem->value.length, buffer + cur, 10);
+	cur += utoa(elem->value.length, buffer + cur);
 
     if (elem->value.length) {
 	buffer[cur++] = ' ';
@@ -130,7 +136,7 @@ psyc_render_modifier (PsycModifier *mod, char *buffer)
 	&& (mod->flag & PSYC_MODIFIER_NEED_LENGTH
 	    || mod->flag == PSYC_MODIFIER_CHECK_LENGTH)) {
 	buffer[cur++] = ' ';
-	cur += itoa(mod->value.length, buffer + cur, 10);
+	cur += utoa(mod->value.length, buffer + cur);
     }
 
     buffer[cur++] = '\t';
@@ -141,32 +147,46 @@ psyc_render_modifier (PsycModifier *mod, char *buffer)
     return cur;
 }
 
-#ifdef __INLINE_PSYC_RENDER
-static inline
-#endif
-PsycRenderRC
-psyc_render (PsycPacket *p, char *buffer, size_t buflen)
+/**
+ * Render the routing header, the content length and the NL starting the content.
+ *
+ * @param routing Routing header to render instead of the one of the packet.
+ *
+ * @return Number of bytes written, or 0 if a modifier name is missing.
+ */
+static inline size_t
+render_routing (const PsycPacket *p, const PsycHeader *routing, char *buffer)
 {
     size_t i, cur = 0, len;
 
-    if (p->length > buflen) // return error if packet doesn't fit in buffer
-	return PSYC_RENDER_ERROR;
-
     // render routing modifiers
-    for (i = 0; i < p->routing.lines; i++) {
-	len = psyc_render_modifier(&p->routing.modifiers[i], buffer + cur);
+    for (i = 0; i < routing->lines; i++) {
+	len = psyc_render_modifier(&routing->modifiers[i], buffer + cur);
 	cur += len;
 	if (len <= 1)
-	    return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+	    return 0;
     }
 
     // add length if needed
     if (p->contentlen && !(p->flag & PSYC_PACKET_NO_LENGTH))
-	cur += itoa(p->contentlen, buffer + cur, 10);
+	cur += utoa(p->contentlen, buffer + cur);
 
     if (p->contentlen)
 	buffer[cur++] = '\n'; // start of content part if there's content or length
 
+    return cur;
+}
+
+/**
+ * Render the content and the packet delimiter.
+ *
+ * @return Number of bytes written, or 0 if the method is missing.
+ */
+static inline size_t
+render_content (PsycPacket *p, char *buffer)
+{
+    size_t i, cur = 0;
+
     if (p->content.length) { // render raw content if present
 	memcpy(buffer + cur, p->content.data, p->content.length);
 	cur += p->content.length;
@@ -191,14 +211,907 @@ psyc_render (PsycPacket *p, char *buffer, size_t buflen)
 		buffer[cur++] = '\n';
 	    }
 	} else if (p->data.length)	// error, we have data but no modifier
-	    return PSYC_RENDER_ERROR_METHOD_MISSING;
+	    return 0;
     }
 
     // add packet delimiter
     buffer[cur++] = PSYC_PACKET_DELIMITER_CHAR;
     buffer[cur++] = '\n';
 
+    return cur;
+}
+
+#ifdef __INLINE_PSYC_RENDER
+static inline
+#endif
+PsycRenderRC
+psyc_render (PsycPacket *p, char *buffer, size_t buflen)
+{
+    size_t cur, len;
+
+    if (p->length > buflen) // return error if packet doesn't fit in buffer
+	return PSYC_RENDER_ERROR;
+
+    cur = render_routing(p, &p->routing, buffer);
+    if (!cur && p->routing.lines)
+	return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+
+    len = render_content(p, buffer + cur);
+    if (!len)
+	return PSYC_RENDER_ERROR_METHOD_MISSING;
+    cur += len;
+
     // actual length should be equal to pre-calculated length at this point
     ASSERT(cur == p->length);
     return PSYC_RENDER_SUCCESS;
 }
+
+PsycRenderRC
+psyc_render_routing (PsycPacket *p, char *buffer, size_t buflen)
+{
+    if (p->length - p->contentlen - 2 > buflen)
+	return PSYC_RENDER_ERROR;
+
+    if (!render_routing(p, &p->routing, buffer) && p->routing.lines)
+	return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+PsycRenderRC
+psyc_render_content (PsycPacket *p, char *buffer, size_t buflen)
+{
+    if (p->contentlen + 2 > buflen)
+	return PSYC_RENDER_ERROR;
+
+    if (!render_content(p, buffer))
+	return PSYC_RENDER_ERROR_METHOD_MISSING;
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+PsycRenderRC
+psyc_render_fanout (PsycPacket *p, PsycHeader *recipients, size_t num,
+		    char *content, size_t contentlen,
+		    char *headers, size_t headerslen,
+		    struct iovec *iov, size_t iovlen)
+{
+    PsycRenderRC ret;
+    const PsycHeader *common = &p->routing, *rcpt;
+    size_t i, j, cur, len;
+    // content length & NL after the routing header
+    size_t lenlen = p->length - p->routinglen - p->contentlen - 2;
+
+    if (num * PSYC_FANOUT_IOV > iovlen)
+	return PSYC_RENDER_ERROR;
+
+    ret = psyc_render_content(p, content, contentlen);
+    if (ret != PSYC_RENDER_SUCCESS)
+	return ret;
+
+    // Routing modifiers common to all recipients are rendered only once.
+    if (p->routinglen > headerslen)
+	return PSYC_RENDER_ERROR;
+
+    for (i = 0, cur = 0; i < common->lines; i++) {
+	len = psyc_render_modifier(&common->modifiers[i], headers + cur);
+	cur += len;
+	if (len <= 1)
+	    return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+    }
+    ASSERT(cur == p->routinglen);
+
+    // Recipient specific routing modifiers and the content length.
+    for (i = 0; i < num; i++) {
+	rcpt = &recipients[i];
+	len = lenlen;
+	for (j = 0; j < rcpt->lines; j++)
+	    len += psyc_modifier_length(&rcpt->modifiers[j]);
+
+	if (cur + len > headerslen)
+	    return PSYC_RENDER_ERROR;
+	if (!render_routing(p, rcpt, headers + cur) && rcpt->lines)
+	    return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+
+	iov[i * PSYC_FANOUT_IOV] = (struct iovec) {headers, p->routinglen};
+	iov[i * PSYC_FANOUT_IOV + 1] = (struct iovec) {headers + cur, len};
+	iov[i * PSYC_FANOUT_IOV + 2] = (struct iovec) {content, p->contentlen + 2};
+	cur += len;
+    }
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+/**
+ * Output function for the render walkers below.
+ *
+ * @param out Output state.
+ * @param data Part of the rendered packet.
+ * @param len Length of data.
+ * @param value Is it a value that may be referenced instead of copied?
+ *
+ * @return PSYC_FALSE if the output is full.
+ */
+typedef PsycBool (*RenderPut) (void *out, const char *data, size_t len,
+			       PsycBool value);
+
+#define PUT_OR_RETURN(...)				\
+    if (!put(out, __VA_ARGS__))				\
+	return PSYC_RENDER_ERROR
+
+#define PUT_NUM_OR_RETURN(n)				\
+    PUT_OR_RETURN(num, utoa(n, num), PSYC_FALSE)
+
+/**
+ * Render a modifier part by part.
+ */
+static inline PsycRenderRC
+walk_modifier (PsycModifier *mod, RenderPut put, void *out)
+{
+    char num[24];
+
+    if (!mod->name.length)
+	return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+
+    PUT_OR_RETURN(&mod->oper, 1, PSYC_FALSE);
+    PUT_OR_RETURN(PSYC_S2ARG(mod->name), PSYC_FALSE);
+
+    if (mod->value.length
+	&& (mod->flag & PSYC_MODIFIER_NEED_LENGTH
+	    || mod->flag == PSYC_MODIFIER_CHECK_LENGTH)) {
+	PUT_OR_RETURN(" ", 1, PSYC_FALSE);
+	PUT_NUM_OR_RETURN(mod->value.length);
+    }
+
+    PUT_OR_RETURN("\t", 1, PSYC_FALSE);
+    PUT_OR_RETURN(PSYC_S2ARG(mod->value), PSYC_TRUE);
+    PUT_OR_RETURN("\n", 1, PSYC_FALSE);
+    return PSYC_RENDER_SUCCESS;
+}
+
+/**
+ * Render a packet part by part, the same way as psyc_render() does.
+ */
+static inline PsycRenderRC
+walk_packet (PsycPacket *p, RenderPut put, void *out)
+{
+    PsycRenderRC ret;
+    size_t i;
+    char num[24], stateop = p->stateop;
+
+    for (i = 0; i < p->routing.lines; i++)
+	if ((ret = walk_modifier(&p->routing.modifiers[i], put, out)))
+	    return ret;
+
+    if (p->contentlen && !(p->flag & PSYC_PACKET_NO_LENGTH))
+	PUT_NUM_OR_RETURN(p->contentlen);
+    if (p->contentlen)
+	PUT_OR_RETURN("\n", 1, PSYC_FALSE);
+
+    if (p->content.length) {
+	PUT_OR_RETURN(PSYC_S2ARG(p->content), PSYC_TRUE);
+    } else {
+	if (p->stateop) {
+	    PUT_OR_RETURN(&stateop, 1, PSYC_FALSE);
+	    PUT_OR_RETURN("\n", 1, PSYC_FALSE);
+	}
+
+	for (i = 0; i < p->entity.lines; i++)
+	    if ((ret = walk_modifier(&p->entity.modifiers[i], put, out)))
+		return ret;
+
+	if (p->method.length) {
+	    PUT_OR_RETURN(PSYC_S2ARG(p->method), PSYC_FALSE);
+	    PUT_OR_RETURN("\n", 1, PSYC_FALSE);
+	    if (p->data.length) {
+		PUT_OR_RETURN(PSYC_S2ARG(p->data), PSYC_TRUE);
+		PUT_OR_RETURN("\n", 1, PSYC_FALSE);
+	    }
+	} else if (p->data.length)
+	    return PSYC_RENDER_ERROR_METHOD_MISSING;
+    }
+
+    PUT_OR_RETURN("|\n", 2, PSYC_FALSE);
+    return PSYC_RENDER_SUCCESS;
+}
+
+/**
+ * Render a list element part by part.
+ */
+static inline PsycRenderRC
+walk_elem (PsycElem *elem, RenderPut put, void *out)
+{
+    char num[24];
+
+    if (elem->type.length) {
+	PUT_OR_RETURN("=", 1, PSYC_FALSE);
+	PUT_OR_RETURN(PSYC_S2ARG(elem->type), PSYC_FALSE);
+    }
+
+    if (elem->value.length && !(elem->flag & PSYC_ELEM_NO_LENGTH)) {
+	if (elem->type.length)
+	    PUT_OR_RETURN(":", 1, PSYC_FALSE);
+	PUT_NUM_OR_RETURN(elem->value.length);
+    }
+
+    if (elem->value.length) {
+	PUT_OR_RETURN(" ", 1, PSYC_FALSE);
+	PUT_OR_RETURN(PSYC_S2ARG(elem->value), PSYC_TRUE);
+    }
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+/**
+ * Render a list part by part.
+ */
+static inline PsycRenderRC
+walk_list (PsycList *list, RenderPut put, void *out)
+{
+    size_t i;
+
+    PUT_OR_RETURN(PSYC_S2ARG(list->type), PSYC_FALSE);
+
+    for (i = 0; i < list->num_elems; i++) {
+	PUT_OR_RETURN("|", 1, PSYC_FALSE);
+	if (walk_elem(&list->elems[i], put, out))
+	    return PSYC_RENDER_ERROR;
+    }
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+/**
+ * Render a dict part by part.
+ */
+static inline PsycRenderRC
+walk_dict (PsycDict *dict, RenderPut put, void *out)
+{
+    size_t i;
+    char num[24];
+    PsycDictKey *key;
+
+    PUT_OR_RETURN(PSYC_S2ARG(dict->type), PSYC_FALSE);
+
+    for (i = 0; i < dict->num_elems; i++) {
+	key = &dict->elems[i].key;
+	PUT_OR_RETURN("{", 1, PSYC_FALSE);
+	if (key->value.length && !(key->flag & PSYC_ELEM_NO_LENGTH))
+	    PUT_NUM_OR_RETURN(key->value.length);
+	if (key->value.length) {
+	    PUT_OR_RETURN(" ", 1, PSYC_FALSE);
+	    PUT_OR_RETURN(PSYC_S2ARG(key->value), PSYC_TRUE);
+	}
+	PUT_OR_RETURN("}", 1, PSYC_FALSE);
+	if (walk_elem(&dict->elems[i].value, put, out))
+	    return PSYC_RENDER_ERROR;
+    }
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+/**
+ * Add a part to an iovec array: reference values of at least the threshold
+ * length, copy everything else to the scratch buffer.
+ */
+static PsycBool
+iov_put (void *out, const char *data, size_t len, PsycBool value)
+{
+    PsycRenderIov *r = out;
+    struct iovec *last = r->iovcnt ? &r->iov[r->iovcnt - 1] : NULL;
+    char *s = r->scratch + r->scratchused;
+
+    if (!len)
+	return PSYC_TRUE;
+
+    if (value && len >= r->threshold) {
+	if (r->iovcnt == r->iovlen)
+	    return PSYC_FALSE;
+	r->iov[r->iovcnt++] = (struct iovec) {(char *)data, len};
+	return PSYC_TRUE;
+    }
+
+    if (len > r->scratchlen - r->scratchused)
+	return PSYC_FALSE;
+    memcpy(s, data, len);
+    r->scratchused += len;
+
+    // extend the last entry if it ends where this part starts
+    if (last && (char *)last->iov_base + last->iov_len == s) {
+	last->iov_len += len;
+	return PSYC_TRUE;
+    }
+
+    if (r->iovcnt == r->iovlen)
+	return PSYC_FALSE;
+    r->iov[r->iovcnt++] = (struct iovec) {s, len};
+    return PSYC_TRUE;
+}
+
+PsycRenderRC
+psyc_render_iov (PsycPacket *packet, PsycRenderIov *r)
+{
+    return walk_packet(packet, iov_put, r);
+}
+
+PsycRenderRC
+psyc_render_list_iov (PsycList *list, PsycRenderIov *r)
+{
+    return walk_list(list, iov_put, r);
+}
+
+PsycRenderRC
+psyc_render_dict_iov (PsycDict *dict, PsycRenderIov *r)
+{
+    return walk_dict(dict, iov_put, r);
+}
+
+/**
+ * Parts of a packet in the order psyc_render_stream() renders them.
+ */
+typedef enum {
+    STREAM_ROUTING,
+    STREAM_LENGTH,
+    STREAM_CONTENT,
+    STREAM_STATEOP,
+    STREAM_ENTITY,
+    STREAM_METHOD,
+    STREAM_END,
+    STREAM_DONE,
+} StreamPart;
+
+/// Number of fields of a modifier: oper name SP length TAB value NL
+#define STREAM_MODIFIER_FIELDS 7
+
+/**
+ * Get the field of the packet the stream is at.
+ *
+ * @param num Buffer for rendering numbers and single characters.
+ *
+ * @return PSYC_RENDER_SUCCESS, or an error if the packet is invalid.
+ *         An empty piece is returned for fields not rendered.
+ */
+static inline PsycRenderRC
+stream_piece (PsycRenderState *state, PsycString *piece, char *num)
+{
+    PsycPacket *p = state->packet;
+    PsycModifier *mod;
+
+    *piece = (PsycString) {0, 0};
+
+    switch (state->part) {
+    case STREAM_ROUTING:
+    case STREAM_ENTITY:
+	mod = state->part == STREAM_ROUTING
+	    ? &p->routing.modifiers[state->index]
+	    : &p->entity.modifiers[state->index];
+
+	switch (state->field) {
+	case 0:
+	    if (!mod->name.length)
+		return PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+	    *piece = (PsycString) {1, &mod->oper};
+	    break;
+	case 1:
+	    *piece = mod->name;
+	    break;
+	case 2:
+	case 3:
+	    if (mod->value.length
+		&& (mod->flag & PSYC_MODIFIER_NEED_LENGTH
+		    || mod->flag == PSYC_MODIFIER_CHECK_LENGTH))
+		*piece = state->field == 2 ? PSYC_C2STR(" ")
+		    : (PsycString) {utoa(mod->value.length, num), num};
+	    break;
+	case 4:
+	    *piece = PSYC_C2STR("\t");
+	    break;
+	case 5:
+	    *piece = mod->value;
+	    break;
+	case 6:
+	    *piece = PSYC_C2STR("\n");
+	    break;
+	}
+	break;
+
+    case STREAM_LENGTH:
+	if (!p->contentlen)
+	    break;
+	if (state->field == 0 && !(p->flag & PSYC_PACKET_NO_LENGTH))
+	    *piece = (PsycString) {utoa(p->contentlen, num), num};
+	else if (state->field == 1)
+	    *piece = PSYC_C2STR("\n");
+	break;
+
+    case STREAM_CONTENT:
+	*piece = p->content;
+	break;
+
+    case STREAM_STATEOP:
+	if (!p->stateop)
+	    break;
+	num[0] = p->stateop;
+	*piece = state->field == 0 ? (PsycString) {1, num} : PSYC_C2STR("\n");
+	break;
+
+    case STREAM_METHOD:
+	if (!p->method.length) {
+	    if (p->data.length)
+		return PSYC_RENDER_ERROR_METHOD_MISSING;
+	    break;
+	}
+	if (state->field == 0)
+	    *piece = p->method;
+	else if (state->field == 1 || p->data.length)
+	    *piece = state->field == 2 ? p->data : PSYC_C2STR("\n");
+	break;
+
+    case STREAM_END:
+	*piece = PSYC_C2STR("|\n");
+	break;
+    }
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+/**
+ * Move the stream to the next field of the packet, skipping empty parts.
+ */
+static inline void
+stream_next (PsycRenderState *state)
+{
+    PsycPacket *p = state->packet;
+    static const uint8_t fields[] = {
+	[STREAM_ROUTING] = STREAM_MODIFIER_FIELDS,
+	[STREAM_LENGTH] = 2,
+	[STREAM_CONTENT] = 1,
+	[STREAM_STATEOP] = 2,
+	[STREAM_ENTITY] = STREAM_MODIFIER_FIELDS,
+	[STREAM_METHOD] = 4,
+	[STREAM_END] = 1,
+    };
+
+    state->pos = 0;
+    if (++state->field < fields[state->part])
+	return;
+    state->field = 0;
+
+    if ((state->part == STREAM_ROUTING || state->part == STREAM_ENTITY)
+	&& ++state->index < (state->part == STREAM_ROUTING
+			     ? p->routing.lines : p->entity.lines))
+	return;
+    state->index = 0;
+
+    switch (state->part) {
+    case STREAM_LENGTH:
+	state->part = p->content.length ? STREAM_CONTENT : STREAM_STATEOP;
+	break;
+    case STREAM_CONTENT:
+	state->part = STREAM_END;
+	break;
+    default:
+	state->part++;
+    }
+
+    // skip modifier parts without modifiers
+    if ((state->part == STREAM_ROUTING && !p->routing.lines)
+	|| (state->part == STREAM_ENTITY && !p->entity.lines))
+	state->part++;
+}
+
+PsycRenderRC
+psyc_render_stream (PsycRenderState *state)
+{
+    PsycRenderRC ret;
+    PsycString piece;
+    char num[24];
+    size_t n;
+
+    if (!state->buffer.length)
+	return PSYC_RENDER_ERROR;
+
+    // the state starts at the first routing modifier, skip it if there's none
+    if (state->part == STREAM_ROUTING && !state->packet->routing.lines)
+	state->part = STREAM_LENGTH;
+
+    // Continue at the field where the previous call stopped,
+    // parts before it are not looked at again.
+    while (state->part != STREAM_DONE) {
+	if ((ret = stream_piece(state, &piece, num)))
+	    return ret;
+
+	if (state->pos < piece.length) {
+	    n = state->buffer.length - state->written;
+	    if (!n)
+		return PSYC_RENDER_INCOMPLETE;
+	    if (n > piece.length - state->pos)
+		n = piece.length - state->pos;
+
+	    memcpy(state->buffer.data + state->written,
+		   piece.data + state->pos, n);
+	    state->written += n;
+	    state->offset += n;
+	    state->pos += n;
+	    if (state->pos < piece.length)
+		return PSYC_RENDER_INCOMPLETE;
+	}
+
+	stream_next(state);
+    }
+
+    ASSERT(state->offset == state->packet->length);
+    return PSYC_RENDER_SUCCESS;
+}
+
+void
+psyc_buffer_free (PsycBuffer *buf)
+{
+    free(buf->data);
+    *buf = (PsycBuffer) {0, 0, 0};
+}
+
+/**
+ * Make sure there's room for len more bytes in the buffer.
+ */
+static inline PsycBool
+buffer_reserve (PsycBuffer *buf, size_t len)
+{
+    size_t size;
+    char *data;
+
+    if (buf->size - buf->length >= len)
+	return PSYC_TRUE;
+
+    size = buf->size ? buf->size : 512;
+    while (size - buf->length < len)
+	size *= 2;
+
+    data = realloc(buf->data, size);
+    if (!data)
+	return PSYC_FALSE;
+
+    buf->data = data;
+    buf->size = size;
+    return PSYC_TRUE;
+}
+
+/**
+ * Decide if a modifier needs a length and append it to the buffer.
+ *
+ * @return Length of the modifier, or 0 on error.
+ */
+static inline size_t
+append_modifier (PsycModifier *mod, PsycBuffer *buf, PsycBool *need_length,
+		 const PsycRenderPolicy *policy)
+{
+    PsycModifier m = *mod;
+    size_t len;
+
+    if (m.flag == PSYC_MODIFIER_CHECK_LENGTH)
+	m.flag = psyc_modifier_length_check_policy(&m, policy);
+    m.name = policy_name(&mod->name, policy);
+    if (m.flag & PSYC_MODIFIER_NEED_LENGTH)
+	*need_length = PSYC_TRUE;
+
+    // oper name SP length TAB value NL
+    if (!buffer_reserve(buf, m.name.length + m.value.length + 24))
+	return 0;
+
+    len = psyc_render_modifier(&m, buf->data + buf->length);
+    if (len <= 1)
+	return 0;
+
+    buf->length += len;
+    return len;
+}
+
+static inline PsycRenderRC
+append_packet (PsycPacket *p, PsycBuffer *buf, PsycString *out,
+	       const PsycRenderPolicy *policy)
+{
+    size_t i, start = buf->length, routing, content, gap, cur;
+    PsycBool need_length = PSYC_FALSE, unused;
+    PsycString method;
+
+    if (!buffer_reserve(buf, PSYC_RENDER_LENGTH_MAX))
+	return PSYC_RENDER_ERROR;
+    buf->length += PSYC_RENDER_LENGTH_MAX;
+    routing = buf->length;
+
+    for (i = 0; i < p->routing.lines; i++)
+	if (!append_modifier(&p->routing.modifiers[i], buf, &unused, policy))
+	    return p->routing.modifiers[i].name.length
+		? PSYC_RENDER_ERROR : PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+
+    content = buf->length;
+
+    if (p->content.length) {
+	if (!buffer_reserve(buf, p->content.length))
+	    return PSYC_RENDER_ERROR;
+	memcpy(buf->data + buf->length, PSYC_S2ARG(p->content));
+	buf->length += p->content.length;
+    } else {
+	if (p->stateop) {
+	    if (!buffer_reserve(buf, 2))
+		return PSYC_RENDER_ERROR;
+	    buf->data[buf->length++] = p->stateop;
+	    buf->data[buf->length++] = '\n';
+	}
+
+	for (i = 0; i < p->entity.lines; i++)
+	    if (!append_modifier(&p->entity.modifiers[i], buf, &need_length,
+				 policy))
+		return p->entity.modifiers[i].name.length
+		    ? PSYC_RENDER_ERROR : PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING;
+
+	if (p->method.length) {
+	    method = policy_name(&p->method, policy);
+	    if (!buffer_reserve(buf, method.length + p->data.length + 2))
+		return PSYC_RENDER_ERROR;
+	    memcpy(buf->data + buf->length, PSYC_S2ARG(method));
+	    buf->length += method.length;
+	    buf->data[buf->length++] = '\n';
+
+	    if (p->data.length) {
+		memcpy(buf->data + buf->length, PSYC_S2ARG(p->data));
+		buf->length += p->data.length;
+		buf->data[buf->length++] = '\n';
+	    }
+	} else if (p->data.length)
+	    return PSYC_RENDER_ERROR_METHOD_MISSING;
+    }
+
+    if (!buffer_reserve(buf, 2))
+	return PSYC_RENDER_ERROR;
+    buf->data[buf->length++] = PSYC_PACKET_DELIMITER_CHAR;
+    buf->data[buf->length++] = '\n';
+
+    p->routinglen = content - routing;
+    p->contentlen = buf->length - content - 2;
+
+    if (p->flag == PSYC_PACKET_CHECK_LENGTH)
+	p->flag = packet_length_policy(p, need_length, p->contentlen, policy);
+
+    // Move the routing header back to make room for the content length & NL
+    // right in front of the content.
+    gap = PSYC_RENDER_LENGTH_MAX;
+    if (p->contentlen) {
+	gap--;
+	if (!(p->flag & PSYC_PACKET_NO_LENGTH))
+	    gap -= psyc_num_length(p->contentlen);
+    }
+    memmove(buf->data + start + gap, buf->data + routing, p->routinglen);
+
+    cur = start + gap + p->routinglen;
+    if (p->contentlen) {
+	if (!(p->flag & PSYC_PACKET_NO_LENGTH))
+	    cur += utoa(p->contentlen, buf->data + cur);
+	buf->data[cur++] = '\n';
+    }
+    ASSERT(cur == content);
+
+    p->length = buf->length - start - gap;
+    *out = PSYC_STRING(buf->data + start + gap, p->length);
+    return PSYC_RENDER_SUCCESS;
+}
+
+PsycRenderRC
+psyc_render_append_policy (PsycPacket *p, PsycBuffer *buf, PsycString *out,
+			   const PsycRenderPolicy *policy)
+{
+    size_t start = buf->length;
+    PsycRenderRC ret = append_packet(p, buf, out, policy);
+
+    if (ret != PSYC_RENDER_SUCCESS)
+	buf->length = start;
+    return ret;
+}
+
+PsycRenderRC
+psyc_render_append (PsycPacket *p, PsycBuffer *buf, PsycString *out)
+{
+    return psyc_render_append_policy(p, buf, out, &PSYC_RENDER_POLICY_DEFAULT);
+}
+
+/**
+ * Copy len bytes from src to dst and check if c occurs in them,
+ * in a single pass over the data.
+ */
+static inline PsycBool
+copy_scan (char *dst, const char *src, size_t len, char c)
+{
+#ifdef __SSE2__
+    __m128i needle = _mm_set1_epi8(c), found = _mm_setzero_si128(), v;
+    size_t i;
+    int hit;
+
+    for (i = 0; i + 16 <= len; i += 16) {
+	v = _mm_loadu_si128((const __m128i *)(src + i));
+	_mm_storeu_si128((__m128i *)(dst + i), v);
+	found = _mm_or_si128(found, _mm_cmpeq_epi8(v, needle));
+    }
+
+    hit = _mm_movemask_epi8(found);
+    for (; i < len; i++)
+	hit |= (dst[i] = src[i]) == c;
+
+    return hit ? PSYC_TRUE : PSYC_FALSE;
+#else
+    memcpy(dst, src, len);
+    return memchr(dst, c, len) ? PSYC_TRUE : PSYC_FALSE;
+#endif
+}
+
+/**
+ * Append a value to the buffer, preceded by its length if needed:
+ * [prefix length] SP value
+ *
+ * Values above the threshold of the policy always get a length and are only
+ * copied. Smaller ones are scanned for the end character while copying, if
+ * it's found the value is moved to make room for the length.
+ *
+ * Room for the value, the prefix and the length is reserved by the caller.
+ *
+ * @param prefix Character in front of the length, or 0.
+ */
+static inline void
+append_value (PsycString *value, PsycElemFlag *flag, char prefix, char end,
+	      PsycBuffer *buf, size_t threshold)
+{
+    char *cur = buf->data + buf->length;
+    size_t len;
+
+    if (!value->length) {
+	if (*flag == PSYC_ELEM_CHECK_LENGTH)
+	    *flag = PSYC_ELEM_NO_LENGTH;
+	return;
+    }
+
+    if (*flag == PSYC_ELEM_CHECK_LENGTH) {
+	if (value->length > threshold)
+	    *flag = PSYC_ELEM_NEED_LENGTH;
+	else {
+	    *cur = ' ';
+	    if (!copy_scan(cur + 1, PSYC_S2ARG(*value), end)) {
+		*flag = PSYC_ELEM_NO_LENGTH;
+		buf->length += 1 + value->length;
+		return;
+	    }
+
+	    // back-patch: move the value behind the length
+	    *flag = PSYC_ELEM_NEED_LENGTH;
+	    len = (prefix ? 1 : 0) + psyc_num_length(value->length);
+	    memmove(cur + len, cur, 1 + value->length);
+	    if (prefix)
+		*cur++ = prefix;
+	    utoa(value->length, cur);
+	    buf->length += len + 1 + value->length;
+	    return;
+	}
+    }
+
+    if (!(*flag & PSYC_ELEM_NO_LENGTH)) {
+	if (prefix)
+	    *cur++ = prefix;
+	cur += utoa(value->length, cur);
+    }
+    *cur++ = ' ';
+    memcpy(cur, PSYC_S2ARG(*value));
+    buf->length = cur + value->length - buf->data;
+}
+
+/**
+ * Append a list/dict element: [=type] [[:]length] SP value
+ *
+ * @return PSYC_FALSE if memory could not be allocated.
+ */
+static inline PsycBool
+append_elem (PsycElem *elem, char end, PsycBuffer *buf, size_t threshold)
+{
+    size_t start;
+
+    // =type :length SP value
+    if (!buffer_reserve(buf, elem->type.length + elem->value.length
+			+ PSYC_RENDER_LENGTH_MAX + 3))
+	return PSYC_FALSE;
+    start = buf->length;
+
+    if (elem->type.length) {
+	buf->data[buf->length++] = '=';
+	memcpy(buf->data + buf->length, PSYC_S2ARG(elem->type));
+	buf->length += elem->type.length;
+    }
+
+    append_value(&elem->value, &elem->flag, elem->type.length ? ':' : 0, end,
+		 buf, threshold);
+    elem->length = buf->length - start;
+    return PSYC_TRUE;
+}
+
+static inline PsycRenderRC
+append_list (PsycList *list, PsycBuffer *buf, const PsycRenderPolicy *policy)
+{
+    size_t i, threshold = psyc_policy_threshold(policy, policy->elem_threshold);
+
+    if (!buffer_reserve(buf, list->type.length))
+	return PSYC_RENDER_ERROR;
+    memcpy(buf->data + buf->length, PSYC_S2ARG(list->type));
+    buf->length += list->type.length;
+
+    for (i = 0; i < list->num_elems; i++) {
+	if (!buffer_reserve(buf, 1))
+	    return PSYC_RENDER_ERROR;
+	buf->data[buf->length++] = PSYC_LIST_ELEM_START;
+
+	if (!append_elem(&list->elems[i], PSYC_LIST_ELEM_START, buf, threshold))
+	    return PSYC_RENDER_ERROR;
+    }
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+static inline PsycRenderRC
+append_dict (PsycDict *dict, PsycBuffer *buf, const PsycRenderPolicy *policy)
+{
+    size_t i, start, threshold =
+	psyc_policy_threshold(policy, policy->elem_threshold);
+    PsycDictKey *key;
+
+    if (!buffer_reserve(buf, dict->type.length))
+	return PSYC_RENDER_ERROR;
+    memcpy(buf->data + buf->length, PSYC_S2ARG(dict->type));
+    buf->length += dict->type.length;
+
+    for (i = 0; i < dict->num_elems; i++) {
+	key = &dict->elems[i].key;
+
+	// { length SP key }
+	if (!buffer_reserve(buf, key->value.length + PSYC_RENDER_LENGTH_MAX + 3))
+	    return PSYC_RENDER_ERROR;
+	buf->data[buf->length++] = PSYC_DICT_KEY_START;
+	start = buf->length;
+	append_value(&key->value, &key->flag, 0, PSYC_DICT_KEY_END,
+		     buf, threshold);
+	key->length = buf->length - start;
+	buf->data[buf->length++] = PSYC_DICT_KEY_END;
+
+	if (!append_elem(&dict->elems[i].value, PSYC_DICT_VALUE_END,
+			 buf, threshold))
+	    return PSYC_RENDER_ERROR;
+    }
+
+    return PSYC_RENDER_SUCCESS;
+}
+
+PsycRenderRC
+psyc_render_list_append (PsycList *list, PsycBuffer *buf, PsycString *out,
+			 const PsycRenderPolicy *policy)
+{
+    size_t start = buf->length;
+
+    if (append_list(list, buf, policy) != PSYC_RENDER_SUCCESS) {
+	buf->length = start;
+	return PSYC_RENDER_ERROR;
+    }
+
+    list->length = buf->length - start;
+    *out = PSYC_STRING(buf->data + start, list->length);
+    return PSYC_RENDER_SUCCESS;
+}
+
+PsycRenderRC
+psyc_render_dict_append (PsycDict *dict, PsycBuffer *buf, PsycString *out,
+			 const PsycRenderPolicy *policy)
+{
+    size_t start = buf->length;
+
+    if (append_dict(dict, buf, policy) != PSYC_RENDER_SUCCESS) {
+	buf->length = start;
+	return PSYC_RENDER_ERROR;
+    }
+
+    dict->length = buf->length - start;
+    *out = PSYC_STRING(buf->data + start, dict->length);
+    return PSYC_RENDER_SUCCESS;
+}
@@ -0,0 +1,203 @@
+#include "lib.h"
+#include <psyc/packet.h>
+#include <psyc/render.h>
+#include <psyc/skeleton.h>
+
+/**
+ * Does a modifier get rendered with a length?
+ */
+static inline PsycBool
+modifier_has_length (PsycModifier *m)
+{
+    return m->value.length && (m->flag & PSYC_MODIFIER_NEED_LENGTH
+			       || m->flag == PSYC_MODIFIER_CHECK_LENGTH);
+}
+
+/**
+ * Record the variables in a header.
+ *
+ * @return Offset after the header.
+ */
+static inline size_t
+skeleton_header (PsycSkeleton *s, PsycHeader *h, size_t pos,
+		 PsycString *names, size_t num_names, uint8_t content)
+{
+    PsycSkeletonField *f;
+    PsycModifier *m;
+    size_t i, len;
+
+    for (i = 0; i < h->lines; i++) {
+	m = &h->modifiers[i];
+	len = psyc_modifier_length(m);
+
+	if (s->num_fields < num_names
+	    && m->name.length == names[s->num_fields].length
+	    && memcmp(m->name.data, names[s->num_fields].data,
+		      m->name.length) == 0) {
+	    f = &s->fields[s->num_fields];
+	    *f = (PsycSkeletonField) {
+		.mod = *m,
+		.offset = pos,
+		.length = len,
+		.value = 1 + m->name.length + 1,
+		.content = content,
+	    };
+	    if (modifier_has_length(m))
+		f->value += 1 + psyc_num_length(m->value.length);
+
+	    f->mod.name = names[s->num_fields];
+	    f->mod.value = PSYC_STRING(s->data + pos + f->value, m->value.length);
+	    s->num_fields++;
+	}
+	pos += len;
+    }
+
+    return pos;
+}
+
+PsycSkeletonRC
+psyc_skeleton_init (PsycSkeleton *s, PsycPacket *p,
+		    PsycString *names, size_t num_names,
+		    PsycSkeletonField *fields, char *buffer, size_t buflen)
+{
+    size_t pos;
+
+    *s = (PsycSkeleton) {
+	.data = buffer,
+	.length = p->length,
+	.routinglen = p->routinglen,
+	.contentlen = p->contentlen,
+	.fields = fields,
+    };
+
+    if (psyc_render(p, buffer, buflen) != PSYC_RENDER_SUCCESS)
+	return PSYC_SKELETON_ERROR;
+
+    pos = skeleton_header(s, &p->routing, 0, names, num_names, PSYC_FALSE);
+    ASSERT(pos == p->routinglen);
+
+    if (p->contentlen) {
+	if (!(p->flag & PSYC_PACKET_NO_LENGTH))
+	    pos += psyc_num_length(p->contentlen);
+	pos++;
+    }
+    s->content = pos;
+
+    if (!p->content.length) {
+	if (p->stateop)
+	    pos += 2;
+	skeleton_header(s, &p->entity, pos, names, num_names, PSYC_TRUE);
+    }
+
+    return s->num_fields == num_names
+	? PSYC_SKELETON_SUCCESS : PSYC_SKELETON_ERROR_FIELD;
+}
+
+/**
+ * Get the modifier of a variable with a new value.
+ */
+static inline PsycModifier
+field_modifier (PsycSkeletonField *f, PsycString *value)
+{
+    PsycModifier m = f->mod;
+
+    m.value = *value;
+    if (!(m.flag & PSYC_MODIFIER_ROUTING))
+	m.flag = psyc_modifier_length_check(&m);
+
+    return m;
+}
+
+/**
+ * Copy the skeleton from prev up to the variable, then render the variable.
+ *
+ * @return Offset in the skeleton after the variable.
+ */
+static inline size_t
+field_render (PsycSkeleton *s, PsycSkeletonField *f, PsycString *value,
+	      size_t prev, char *buffer, size_t *cur)
+{
+    PsycModifier m = field_modifier(f, value);
+
+    memcpy(buffer + *cur, s->data + prev, f->offset - prev);
+    *cur += f->offset - prev;
+    *cur += psyc_render_modifier(&m, buffer + *cur);
+
+    return f->offset + f->length;
+}
+
+PsycRenderRC
+psyc_skeleton_render (PsycSkeleton *s, PsycString *values,
+		      char *buffer, size_t buflen, size_t *length)
+{
+    size_t i, len, cur, prev, contentlen = s->contentlen, total;
+    PsycBool same = PSYC_TRUE, need_length = s->content > s->routinglen + 1;
+    PsycSkeletonField *f;
+    PsycModifier m;
+
+    for (i = 0; i < s->num_fields; i++) {
+	f = &s->fields[i];
+	m = field_modifier(f, &values[i]);
+	len = psyc_modifier_length(&m);
+
+	if (values[i].length != f->mod.value.length
+	    || modifier_has_length(&m) != modifier_has_length(&f->mod))
+	    same = PSYC_FALSE;
+	if (f->content) {
+	    contentlen += len - f->length;
+	    if (m.flag & PSYC_MODIFIER_NEED_LENGTH)
+		need_length = PSYC_TRUE;
+	}
+    }
+
+    if (same) {
+	if (s->length > buflen)
+	    return PSYC_RENDER_ERROR;
+
+	memcpy(buffer, s->data, s->length);
+	for (i = 0; i < s->num_fields; i++) {
+	    f = &s->fields[i];
+	    memcpy(buffer + f->offset + f->value, PSYC_S2ARG(values[i]));
+	}
+
+	*length = s->length;
+	return PSYC_RENDER_SUCCESS;
+    }
+
+    // routing header, content length & NL, content, delimiter
+    total = s->routinglen + contentlen + 2;
+    for (i = 0; i < s->num_fields; i++)
+	if (!s->fields[i].content) {
+	    m = field_modifier(&s->fields[i], &values[i]);
+	    total += psyc_modifier_length(&m) - s->fields[i].length;
+	}
+    if (contentlen)
+	total += 1 + (need_length ? psyc_num_length(contentlen) : 0);
+
+    if (total > buflen)
+	return PSYC_RENDER_ERROR;
+
+    cur = prev = 0;
+    for (i = 0; i < s->num_fields && !s->fields[i].content; i++)
+	prev = field_render(s, &s->fields[i], &values[i], prev, buffer, &cur);
+
+    memcpy(buffer + cur, s->data + prev, s->routinglen - prev);
+    cur += s->routinglen - prev;
+
+    if (contentlen) {
+	if (need_length)
+	    cur += utoa(contentlen, buffer + cur);
+	buffer[cur++] = '\n';
+    }
+
+    prev = s->content;
+    for (; i < s->num_fields; i++)
+	prev = field_render(s, &s->fields[i], &values[i], prev, buffer, &cur);
+
+    memcpy(buffer + cur, s->data + prev, s->length - prev);
+    cur += s->length - prev;
+
+    ASSERT(cur == total);
+    *length = cur;
+    return PSYC_RENDER_SUCCESS;
+}
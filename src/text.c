@@ -1,10 +1,230 @@
 #include "lib.h"
 #include <psyc/text.h>
 
+#ifdef __SSE2__
+# include <emmintrin.h>
+#endif
+
 const PsycTemplates psyc_templates = { .s = {
 #include "templates.h"
 }};
 
+/**
+ * Does a character need escaping?
+ */
+static inline PsycBool
+text_special (PsycTextEscape escape, char c)
+{
+    switch (escape) {
+    case PSYC_TEXT_ESCAPE_HTML:
+	return c == '&' || c == '<' || c == '>' || c == '"' || c == '\'';
+    case PSYC_TEXT_ESCAPE_JSON:
+	return c == '"' || c == '\\' || (uint8_t)c < 0x20;
+    case PSYC_TEXT_ESCAPE_IRC:
+	return c == '\0' || c == '\r' || c == '\n';
+    default:
+	return PSYC_FALSE;
+    }
+}
+
+/**
+ * Find the first character that needs escaping.
+ *
+ * @return Its offset, or len if there's none.
+ */
+static inline size_t
+text_escape_scan (PsycTextEscape escape, const char *data, size_t len)
+{
+    size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i v, m;
+    int mask;
+
+    for (; i + 16 <= len; i += 16) {
+	v = _mm_loadu_si128((const __m128i *)(data + i));
+	switch (escape) {
+	case PSYC_TEXT_ESCAPE_HTML:
+	    m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('&')),
+					  _mm_cmpeq_epi8(v, _mm_set1_epi8('<'))),
+			     _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('>')),
+					  _mm_cmpeq_epi8(v, _mm_set1_epi8('"'))));
+	    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\'')));
+	    break;
+	case PSYC_TEXT_ESCAPE_JSON:
+	    // control characters: max(v, 0x1f) == 0x1f
+	    m = _mm_cmpeq_epi8(_mm_max_epu8(v, _mm_set1_epi8(0x1f)),
+			       _mm_set1_epi8(0x1f));
+	    m = _mm_or_si128(m, _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('"')),
+					     _mm_cmpeq_epi8(v, _mm_set1_epi8('\\'))));
+	    break;
+	case PSYC_TEXT_ESCAPE_IRC:
+	    m = _mm_or_si128(_mm_cmpeq_epi8(v, _mm_setzero_si128()),
+			     _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\r')),
+					  _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'))));
+	    break;
+	default:
+	    return len;
+	}
+
+	if ((mask = _mm_movemask_epi8(m)))
+	    return i + __builtin_ctz(mask);
+    }
+#endif
+
+    for (; i < len; i++)
+	if (text_special(escape, data[i]))
+	    return i;
+
+    return len;
+}
+
+/**
+ * Write the escape sequence of a character to out, at most 6 bytes.
+ *
+ * @return Length of the escape sequence.
+ */
+static inline size_t
+text_escape_char (PsycTextEscape escape, char c, char *out)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    switch (escape) {
+    case PSYC_TEXT_ESCAPE_HTML:
+	switch (c) {
+	case '&':
+	    memcpy(out, "&amp;", 5);
+	    return 5;
+	case '<':
+	    memcpy(out, "&lt;", 4);
+	    return 4;
+	case '>':
+	    memcpy(out, "&gt;", 4);
+	    return 4;
+	case '"':
+	    memcpy(out, "&quot;", 6);
+	    return 6;
+	default:
+	    memcpy(out, "&#39;", 5);
+	    return 5;
+	}
+    case PSYC_TEXT_ESCAPE_JSON:
+	out[0] = '\\';
+	switch (c) {
+	case '"':
+	case '\\':
+	    out[1] = c;
+	    return 2;
+	case '\n':
+	    out[1] = 'n';
+	    return 2;
+	case '\r':
+	    out[1] = 'r';
+	    return 2;
+	case '\t':
+	    out[1] = 't';
+	    return 2;
+	case '\b':
+	    out[1] = 'b';
+	    return 2;
+	case '\f':
+	    out[1] = 'f';
+	    return 2;
+	default:
+	    memcpy(out + 1, "u00", 3);
+	    out[4] = hex[(uint8_t)c >> 4];
+	    out[5] = hex[(uint8_t)c & 0xf];
+	    return 6;
+	}
+    default: // IRC
+	out[0] = ' ';
+	return 1;
+    }
+}
+
+/**
+ * Copy a value to dst, escaping it.
+ * Parts without special characters are copied with memcpy().
+ *
+ * @return Length written, or SIZE_MAX if it does not fit in dstlen.
+ */
+static inline size_t
+text_escape (PsycTextEscape escape, char *dst, size_t dstlen,
+	     const char *src, size_t len)
+{
+    size_t i = 0, j = 0, n;
+    char esc[6];
+
+    for (;;) {
+	n = text_escape_scan(escape, src + i, len - i);
+	if (j + n > dstlen)
+	    return SIZE_MAX;
+	memcpy(dst + j, src + i, n);
+	i += n;
+	j += n;
+
+	if (i == len)
+	    return j;
+
+	n = text_escape_char(escape, src[i++], esc);
+	if (j + n > dstlen)
+	    return SIZE_MAX;
+	memcpy(dst + j, esc, n);
+	j += n;
+    }
+}
+
+/**
+ * Output a part of the text: copy it to the buffer, or add it to iov if given.
+ *
+ * In iov mode, parts that need escaping are escaped into the buffer, and the
+ * buffer is advanced past them.
+ *
+ * @return PSYC_FALSE if there's no room for it.
+ */
+static inline PsycBool
+text_out (PsycTextState *state, struct iovec *iov, size_t iovlen, size_t *num,
+	  const char *data, size_t len, PsycTextEscape escape)
+{
+    size_t n;
+
+    if (iov) {
+	if (!len)
+	    return PSYC_TRUE;
+	if (*num >= iovlen)
+	    return PSYC_FALSE;
+
+	if (escape && text_escape_scan(escape, data, len) < len) {
+	    n = text_escape(escape, PSYC_S2ARG(state->buffer), data, len);
+	    if (n == SIZE_MAX)
+		return PSYC_FALSE;
+
+	    iov[(*num)++] = (struct iovec) {state->buffer.data, n};
+	    state->buffer.data += n;
+	    state->buffer.length -= n;
+	    state->written += n;
+	    return PSYC_TRUE;
+	}
+
+	iov[(*num)++] = (struct iovec) {(void *) data, len};
+    } else if (escape) {
+	n = text_escape(escape, state->buffer.data + state->written,
+			state->buffer.length - state->written, data, len);
+	if (n == SIZE_MAX)
+	    return PSYC_FALSE;
+
+	state->written += n;
+	return PSYC_TRUE;
+    } else {
+	if (state->written + len > state->buffer.length)
+	    return PSYC_FALSE;
+	memcpy((void *) (state->buffer.data + state->written), data, len);
+    }
+
+    state->written += len;
+    return PSYC_TRUE;
+}
+
 PsycTextRC
 psyc_text (PsycTextState *state, PsycTextCB get_value, void *get_value_cls)
 {
@@ -16,9 +236,9 @@ psyc_text (PsycTextState *state, PsycTextCB get_value, void *get_value_cls)
     uint8_t no_subst = (state->cursor == 0); // whether we can return NO_SUBST
 
     while (state->cursor < state->tmpl.length) {
-	start = memmem(state->tmpl.data + state->cursor,
-		       state->tmpl.length - state->cursor,
-		       state->open.data, state->open.length);
+	start = psyc_memmem(state->tmpl.data + state->cursor,
+			    state->tmpl.length - state->cursor,
+			    state->open.data, state->open.length);
 	if (!start)
 	    break;
 
@@ -26,9 +246,9 @@ psyc_text (PsycTextState *state, PsycTextCB get_value, void *get_value_cls)
 	if (state->cursor >= state->tmpl.length)
 	    break; // [ at the end
 
-	end = memmem(state->tmpl.data + state->cursor,
-		     state->tmpl.length - state->cursor,
-		     state->close.data, state->close.length);
+	end = psyc_memmem(state->tmpl.data + state->cursor,
+			  state->tmpl.length - state->cursor,
+			  state->close.data, state->close.length);
 	state->cursor = (end - state->tmpl.data) + state->close.length;
 
 	if (!end)
@@ -56,15 +276,11 @@ psyc_text (PsycTextState *state, PsycTextCB get_value, void *get_value_cls)
 	state->written += len;
 
 	// Now substitute the value if there's enough buffer space.
-	if (state->written + value.length > state->buffer.length) {
+	if (!text_out(state, NULL, 0, NULL, PSYC_S2ARG(value), state->escape)) {
 	    state->cursor = start - state->tmpl.data;
 	    return PSYC_TEXT_INCOMPLETE;
 	}
 
-	memcpy((void *) (state->buffer.data + state->written), value.data,
-	       value.length);
-	state->written += value.length;
-
 	// Mark the start of the next chunk of text in the template.
 	prev = state->tmpl.data + state->cursor;
 	no_subst = 0;
@@ -83,3 +299,247 @@ psyc_text (PsycTextState *state, PsycTextCB get_value, void *get_value_cls)
 
     return PSYC_TEXT_COMPLETE;
 }
+
+int
+psyc_text_compile (PsycTextTemplate *t, const char *tmpl, size_t tmplen,
+		   const char *open, size_t openlen,
+		   const char *close, size_t closelen,
+		   PsycTextVar *vars, size_t maxvars)
+{
+    const char *start, *end; // start & end of variable name
+    size_t cursor = 0;
+
+    t->tmpl = PSYC_STRING((char *) tmpl, tmplen);
+    t->vars = vars;
+    t->num_vars = 0;
+
+    while (cursor < tmplen) {
+	start = psyc_memmem(tmpl + cursor, tmplen - cursor, open, openlen);
+	if (!start)
+	    break;
+
+	cursor = (start - tmpl) + openlen;
+	if (cursor >= tmplen)
+	    break; // [ at the end
+
+	end = psyc_memmem(tmpl + cursor, tmplen - cursor, close, closelen);
+	if (!end)
+	    break; // ] not found
+
+	cursor = (end - tmpl) + closelen;
+	if (start + openlen == end) {
+	    cursor += closelen;
+	    continue; // [] is invalid, name can't be empty
+	}
+
+	if (t->num_vars >= maxvars)
+	    return -1;
+
+	vars[t->num_vars++] = (PsycTextVar) {
+	    .start = start - tmpl,
+	    .end = cursor,
+	    .name = PSYC_STRING((char *) start + openlen, end - start - openlen),
+	};
+    }
+
+    return t->num_vars;
+}
+
+/**
+ * FNV-1a hash of a name.
+ */
+static inline uint32_t
+text_hash (const char *name, size_t len)
+{
+    uint32_t h = 2166136261U;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+	h = (h ^ (uint8_t)name[i]) * 16777619U;
+
+    return h;
+}
+
+PsycBool
+psyc_text_index_init (PsycTextIndex *idx, const PsycHeader *h)
+{
+    const PsycString *n;
+    size_t i, slot;
+    uint8_t id;
+
+    idx->header = h;
+    memset(idx->slots, 0, sizeof(idx->slots));
+
+    if (h->lines > PSYC_TEXT_INDEX_MAX)
+	return PSYC_FALSE;
+
+    for (i = 0; i < h->lines; i++) {
+	// linear probing, the table is at least half empty
+	slot = text_hash(PSYC_S2ARG(h->modifiers[i].name));
+	while ((id = idx->slots[slot & (PSYC_TEXT_INDEX_SIZE - 1)])) {
+	    n = &h->modifiers[id - 1].name;
+	    if (n->length == h->modifiers[i].name.length
+		&& memcmp(n->data, PSYC_S2ARG(h->modifiers[i].name)) == 0)
+		break; // replace earlier modifier with the same name
+	    slot++;
+	}
+	idx->slots[slot & (PSYC_TEXT_INDEX_SIZE - 1)] = i + 1;
+    }
+
+    return PSYC_TRUE;
+}
+
+const PsycModifier *
+psyc_text_index_get (const PsycTextIndex *idx, const char *name, size_t len,
+		     PsycBool inherit)
+{
+    const PsycModifier *m;
+    size_t slot;
+    uint8_t id;
+
+    for (;;) {
+	slot = text_hash(name, len);
+	while ((id = idx->slots[slot & (PSYC_TEXT_INDEX_SIZE - 1)])) {
+	    m = &idx->header->modifiers[id - 1];
+	    if (m->name.length == len && memcmp(m->name.data, name, len) == 0)
+		return m;
+	    slot++;
+	}
+
+	if (!inherit)
+	    return NULL;
+
+	// _nick_place -> _nick
+	while (--len > 0 && name[len] != '_');
+	if (len == 0)
+	    return NULL;
+    }
+}
+
+/**
+ * Fills out a compiled template, values are looked up in idx if given,
+ * otherwise get_value is called. The text is written to the buffer of the
+ * state, or to iov if given.
+ */
+static inline PsycTextRC
+text_exec (PsycTextState *state, const PsycTextTemplate *t,
+	   PsycTextCB get_value, void *get_value_cls,
+	   const PsycTextIndex *idx, PsycBool inherit,
+	   struct iovec *iov, size_t iovlen, size_t *num)
+{
+    const PsycTextVar *var = t->vars, *last = t->vars + t->num_vars;
+    const PsycModifier *m;
+    size_t prev = state->cursor;
+    PsycString value;
+    uint8_t no_subst = (state->cursor == 0); // whether we can return NO_SUBST
+
+    // Skip the variables before the position we continue from.
+    while (var < last && var->start < prev)
+	var++;
+
+    for (; var < last; var++) {
+	if (idx) {
+	    m = psyc_text_index_get(idx, PSYC_S2ARG(var->name), inherit);
+	    if (!m)
+		continue; // value not found, no substitution
+	    value = m->value;
+	} else if (get_value(get_value_cls, PSYC_S2ARG(var->name), &value) < 0)
+	    continue; // value not found, no substitution
+
+	if (!text_out(state, iov, iovlen, num, t->tmpl.data + prev,
+		      var->start - prev, PSYC_TEXT_ESCAPE_NONE)) {
+	    state->cursor = prev;
+	    return PSYC_TEXT_INCOMPLETE;
+	}
+
+	if (!text_out(state, iov, iovlen, num, PSYC_S2ARG(value),
+		      state->escape)) {
+	    state->cursor = var->start;
+	    return PSYC_TEXT_INCOMPLETE;
+	}
+
+	prev = var->end;
+	no_subst = 0;
+    }
+
+    if (no_subst)
+	return PSYC_TEXT_NO_SUBST;
+
+    if (!text_out(state, iov, iovlen, num, t->tmpl.data + prev,
+		  t->tmpl.length - prev, PSYC_TEXT_ESCAPE_NONE)) {
+	state->cursor = prev;
+	return PSYC_TEXT_INCOMPLETE;
+    }
+
+    state->cursor = t->tmpl.length;
+    return PSYC_TEXT_COMPLETE;
+}
+
+PsycTextRC
+psyc_text_compiled (PsycTextState *state, const PsycTextTemplate *t,
+		    PsycTextCB get_value, void *get_value_cls)
+{
+    return text_exec(state, t, get_value, get_value_cls, NULL, PSYC_FALSE,
+		     NULL, 0, NULL);
+}
+
+PsycTextRC
+psyc_text_header (PsycTextState *state, const PsycTextTemplate *t,
+		  const PsycTextIndex *idx, PsycBool inherit)
+{
+    return text_exec(state, t, NULL, NULL, idx, inherit, NULL, 0, NULL);
+}
+
+PsycTextRC
+psyc_text_iov (PsycTextState *state, const PsycTextTemplate *t,
+	       PsycTextCB get_value, void *get_value_cls,
+	       struct iovec *iov, size_t iovlen, size_t *num)
+{
+    *num = 0;
+    state->written = 0;
+    return text_exec(state, t, get_value, get_value_cls, NULL, PSYC_FALSE,
+		     iov, iovlen, num);
+}
+
+PsycTextRC
+psyc_text_header_iov (PsycTextState *state, const PsycTextTemplate *t,
+		      const PsycTextIndex *idx, PsycBool inherit,
+		      struct iovec *iov, size_t iovlen, size_t *num)
+{
+    *num = 0;
+    state->written = 0;
+    return text_exec(state, t, NULL, NULL, idx, inherit, iov, iovlen, num);
+}
+
+static PsycTextTemplate templates_compiled[PSYC_METHODS_NUM];
+static PsycTextVar templates_vars[PSYC_METHODS_NUM][PSYC_TEXT_TEMPLATE_VARS];
+static PsycBool templates_ready;
+
+// Compile the built-in templates when the library is loaded, so that
+// psyc_template_compiled() only reads them and can be called from any thread.
+#ifdef __GNUC__
+static void templates_compile (void) __attribute__((constructor));
+#endif
+
+static void
+templates_compile (void)
+{
+    int mc;
+
+    // built-in templates have less than PSYC_TEXT_TEMPLATE_VARS variables
+    for (mc = 0; mc < PSYC_METHODS_NUM; mc++)
+	psyc_text_compile(&templates_compiled[mc],
+			  PSYC_S2ARG(psyc_templates.a[mc]),
+			  PSYC_C2ARG("["), PSYC_C2ARG("]"),
+			  templates_vars[mc], PSYC_TEXT_TEMPLATE_VARS);
+    templates_ready = PSYC_TRUE;
+}
+
+const PsycTextTemplate *
+psyc_template_compiled (PsycMethod mc)
+{
+    // without constructor support, compile them on first use
+    if (!templates_ready)
+	templates_compile();
+    return &templates_compiled[mc];
+}
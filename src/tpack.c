@@ -0,0 +1,350 @@
+#include "lib.h"
+#include <psyc/tpack.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static PsycTemplatePack *tpack_current;
+
+/**
+ * Compare two names, in the order of the name index.
+ */
+static inline int
+tpack_cmp (const char *a, size_t alen, const char *b, size_t blen)
+{
+    int r = memcmp(a, b, alen < blen ? alen : blen);
+    return r ? r : (alen > blen) - (alen < blen);
+}
+
+/**
+ * Check that a string is in the pool and terminated.
+ */
+static inline PsycBool
+tpack_string_valid (const PsycTemplatePackString *s, const char *pool,
+		    uint32_t poollen)
+{
+    return (uint64_t)s->offset + s->length < poollen
+	&& pool[s->offset + s->length] == '\0';
+}
+
+PsycTemplatePackRC
+psyc_tpack_load (PsycTemplatePack *pack, const char *data, size_t length)
+{
+    const PsycTemplatePackHeader *h = (const PsycTemplatePackHeader *) data;
+    size_t i, methods = sizeof(PsycTemplatePackHeader);
+    const char *lang;
+
+    memset(pack, 0, sizeof(*pack));
+
+    if (length < methods || (uintptr_t)data % sizeof(uint32_t)
+	|| memcmp(h->magic, PSYC_TPACK_MAGIC, sizeof(h->magic))
+	|| methods + (uint64_t)h->num_methods * sizeof(PsycTemplatePackString)
+	> length
+	|| h->names % sizeof(uint32_t)
+	|| h->names + (uint64_t)h->num_names * sizeof(PsycTemplatePackName)
+	> length
+	|| (uint64_t)h->pool + h->poollen > length)
+	return PSYC_TPACK_ERROR_FORMAT;
+
+    *pack = (PsycTemplatePack) {
+	.data = data,
+	.length = length,
+	.num_methods = h->num_methods,
+	.num_names = h->num_names,
+	.methods = (const PsycTemplatePackString *) (data + methods),
+	.names = (const PsycTemplatePackName *) (data + h->names),
+	.pool = data + h->pool,
+	.lang = PSYC_STRING((char *) h->lang, sizeof(h->lang)),
+    };
+
+    if ((lang = memchr(h->lang, '\0', sizeof(h->lang))))
+	pack->lang.length = lang - h->lang;
+
+    for (i = 0; i < pack->num_methods; i++)
+	if (pack->methods[i].length
+	    && !tpack_string_valid(&pack->methods[i], pack->pool, h->poollen))
+	    return PSYC_TPACK_ERROR_FORMAT;
+
+    for (i = 0; i < pack->num_names; i++)
+	if (!tpack_string_valid(&pack->names[i].name, pack->pool, h->poollen)
+	    || !tpack_string_valid(&pack->names[i].tmpl, pack->pool, h->poollen))
+	    return PSYC_TPACK_ERROR_FORMAT;
+
+    return PSYC_TPACK_SUCCESS;
+}
+
+PsycTemplatePackRC
+psyc_tpack_open (PsycTemplatePack *pack, const char *path)
+{
+    struct stat st;
+    PsycTemplatePackRC ret;
+    void *data;
+    int fd;
+
+    memset(pack, 0, sizeof(*pack));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return PSYC_TPACK_ERROR;
+
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+	close(fd);
+	return PSYC_TPACK_ERROR;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+	return PSYC_TPACK_ERROR;
+
+    ret = psyc_tpack_load(pack, data, st.st_size);
+    if (ret != PSYC_TPACK_SUCCESS) {
+	munmap(data, st.st_size);
+	return ret;
+    }
+
+    pack->mapped = PSYC_TRUE;
+    return PSYC_TPACK_SUCCESS;
+}
+
+void
+psyc_tpack_close (PsycTemplatePack *pack)
+{
+    if (pack->mapped)
+	munmap((void *) pack->data, pack->length);
+
+    memset(pack, 0, sizeof(*pack));
+}
+
+const char *
+psyc_tpack_lookup (const PsycTemplatePack *pack,
+		   const char *name, size_t namelen, size_t *len)
+{
+    const PsycTemplatePackName *n;
+    size_t lo = 0, hi = pack->num_names, mid;
+    int r;
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	n = &pack->names[mid];
+	r = tpack_cmp(name, namelen,
+		      pack->pool + n->name.offset, n->name.length);
+	if (r == 0) {
+	    if (len)
+		*len = n->tmpl.length;
+	    return pack->pool + n->tmpl.offset;
+	}
+	if (r < 0)
+	    hi = mid;
+	else
+	    lo = mid + 1;
+    }
+
+    return NULL;
+}
+
+/**
+ * Copy a string to the pool of a pack being built.
+ */
+static inline PsycTemplatePackString
+tpack_pool_add (char *pool, uint32_t *poollen, const PsycString *s)
+{
+    PsycTemplatePackString ps = {*poollen, s->length};
+
+    memcpy(pool + *poollen, s->data, s->length);
+    pool[*poollen + s->length] = '\0';
+    *poollen += s->length + 1;
+
+    return ps;
+}
+
+size_t
+psyc_tpack_build (char *buffer, size_t buflen, const char *lang, size_t langlen,
+		  const PsycTemplatePackEntry *entries, size_t num)
+{
+    PsycTemplatePackHeader h = {PSYC_TPACK_MAGIC};
+    PsycTemplatePackString *methods;
+    PsycTemplatePackName n;
+    uint64_t size, poollen = 0;
+    uint32_t pos = 0;
+    size_t i;
+    int mc;
+
+    for (i = 0; i < num; i++) {
+	if (i && tpack_cmp(PSYC_S2ARG(entries[i - 1].name),
+			   PSYC_S2ARG(entries[i].name)) >= 0)
+	    return 0;
+	poollen += entries[i].name.length + 1 + entries[i].tmpl.length + 1;
+    }
+
+    h.num_methods = PSYC_METHODS_NUM;
+    h.num_names = num;
+    h.names = sizeof(h) + h.num_methods * sizeof(PsycTemplatePackString);
+    size = h.names + (uint64_t)num * sizeof(PsycTemplatePackName);
+    h.pool = size;
+    h.poollen = poollen;
+    size += poollen;
+
+    if (size > UINT32_MAX || langlen > sizeof(h.lang))
+	return 0;
+    if (!buffer || size > buflen)
+	return size;
+
+    memcpy(h.lang, lang, langlen);
+    memcpy(buffer, &h, sizeof(h));
+
+    methods = (PsycTemplatePackString *) (buffer + sizeof(h));
+    memset(methods, 0, h.num_methods * sizeof(PsycTemplatePackString));
+
+    for (i = 0; i < num; i++) {
+	n.name = tpack_pool_add(buffer + h.pool, &pos, &entries[i].name);
+	n.tmpl = tpack_pool_add(buffer + h.pool, &pos, &entries[i].tmpl);
+	memcpy(buffer + h.names + i * sizeof(n), &n, sizeof(n));
+
+	mc = psyc_map_lookup_int(psyc_methods, psyc_methods_num,
+				 PSYC_S2ARG(entries[i].name), PSYC_NO);
+	if (mc > PSYC_MC_UNKNOWN && mc < PSYC_METHODS_NUM)
+	    methods[mc] = n.tmpl;
+    }
+
+    return size;
+}
+
+PsycTemplatePack *
+psyc_tpack_swap (PsycTemplatePack *pack)
+{
+    return __atomic_exchange_n(&tpack_current, pack, __ATOMIC_ACQ_REL);
+}
+
+PsycTemplatePack *
+psyc_tpack_current (void)
+{
+    return __atomic_load_n(&tpack_current, __ATOMIC_ACQUIRE);
+}
+
+#ifdef CMDTOOL
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Unescape \n, \t and \\ in place.
+ *
+ * @return New length.
+ */
+static size_t
+tpack_unescape (char *s, size_t len)
+{
+    size_t i, j;
+
+    for (i = j = 0; i < len; i++, j++) {
+	if (s[i] == '\\' && i + 1 < len) {
+	    switch (s[++i]) {
+	    case 'n':
+		s[j] = '\n';
+		continue;
+	    case 't':
+		s[j] = '\t';
+		continue;
+	    case '\\':
+		s[j] = '\\';
+		continue;
+	    }
+	    i--;
+	}
+	s[j] = s[i];
+    }
+
+    return j;
+}
+
+static int
+tpack_entry_cmp (const void *a, const void *b)
+{
+    const PsycString *x = &((const PsycTemplatePackEntry *) a)->name;
+    const PsycString *y = &((const PsycTemplatePackEntry *) b)->name;
+    return tpack_cmp(PSYC_S2ARG(*x), PSYC_S2ARG(*y));
+}
+
+int
+main (int argc, char **argv)
+{
+    PsycTemplatePackEntry *entries;
+    char *src, *line, *end, *tab, *pack, tmp[4096];
+    size_t srclen, num = 0, max = 64, size;
+    FILE *f;
+
+    if (argc != 4) {
+	printf("Usage: %s <lang> <source> <pack>\n\n"
+	       "Builds a template pack from a source file with lines of\n"
+	       "_method<TAB>template\n\n"
+	       "Example: %s en templates.en en.psyt\n", argv[0], argv[0]);
+	return -1;
+    }
+
+    if (!(f = fopen(argv[2], "r"))) {
+	perror(argv[2]);
+	return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    srclen = ftell(f);
+    rewind(f);
+    src = malloc(srclen + 1);
+    entries = malloc(max * sizeof(*entries));
+    if (!src || !entries || fread(src, 1, srclen, f) != srclen) {
+	perror(argv[2]);
+	return 1;
+    }
+    fclose(f);
+    src[srclen] = '\n';
+
+    for (line = src; line < src + srclen; line = end + 1) {
+	end = memchr(line, '\n', src + srclen + 1 - line);
+	if (end == line || line[0] == '#')
+	    continue;
+
+	if (line[0] != '_' || !(tab = memchr(line, '\t', end - line))) {
+	    fprintf(stderr, "%s: invalid line: %.*s\n", argv[2],
+		    (int)(end - line), line);
+	    return 2;
+	}
+
+	if (num == max && !(entries = realloc(entries,
+					      (max *= 2) * sizeof(*entries)))) {
+	    perror("realloc");
+	    return 1;
+	}
+	entries[num].name = PSYC_STRING(line, tab - line);
+	entries[num].tmpl = PSYC_STRING(tab + 1, tpack_unescape(tab + 1,
+								end - tab - 1));
+	num++;
+    }
+
+    qsort(entries, num, sizeof(*entries), tpack_entry_cmp);
+
+    size = psyc_tpack_build(NULL, 0, argv[1], strlen(argv[1]), entries, num);
+    if (!size) {
+	fprintf(stderr, "%s: duplicate methods, or language tag too long\n",
+		argv[2]);
+	return 2;
+    }
+    if (!(pack = malloc(size))) {
+	perror("malloc");
+	return 1;
+    }
+    psyc_tpack_build(pack, size, argv[1], strlen(argv[1]), entries, num);
+
+    // write to a temporary file and rename it, processes that have the old
+    // pack mapped keep using it until they switch to the new one
+    snprintf(tmp, sizeof(tmp), "%s.tmp", argv[3]);
+    if (!(f = fopen(tmp, "w")) || fwrite(pack, 1, size, f) != size
+	|| fclose(f) || rename(tmp, argv[3])) {
+	perror(argv[3]);
+	return 1;
+    }
+
+    printf("%s: %zu templates, %zu bytes\n", argv[3], num, size);
+    return 0;
+}
+#endif
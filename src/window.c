@@ -0,0 +1,255 @@
+#include "lib.h"
+#include <psyc/packet.h>
+#include <psyc/parse.h>
+#include <psyc/window.h>
+
+static inline uint64_t
+window_le64 (const uint8_t *p)
+{
+    uint64_t v = 0;
+    int i;
+    for (i = 7; i >= 0; i--)
+	v = v << 8 | p[i];
+    return v;
+}
+
+static inline void
+window_le64_put (uint8_t *p, uint64_t v)
+{
+    int i;
+    for (i = 0; i < 8; i++, v >>= 8)
+	p[i] = v & 0xff;
+}
+
+void
+psyc_reorder_init (PsycReorder *r, void **slots, size_t size)
+{
+    *r = (PsycReorder) {
+	.slots = slots,
+	.size = size,
+    };
+    memset(slots, 0, sizeof(void *) * size);
+}
+
+PsycReorderRC
+psyc_reorder_push (PsycReorder *r, uint64_t counter, void *packet)
+{
+    void **slot;
+
+    if (!r->started)
+	psyc_reorder_start(r, counter);
+
+    if (counter < r->next)
+	return PSYC_REORDER_DUPLICATE;
+
+    if (counter == r->next && !r->slots[counter & (r->size - 1)]) {
+	r->next++;
+	return PSYC_REORDER_DELIVER;
+    }
+
+    if (counter - r->next >= r->size)
+	return PSYC_REORDER_OVERFLOW;
+
+    slot = &r->slots[counter & (r->size - 1)];
+    if (*slot)
+	return PSYC_REORDER_DUPLICATE;
+
+    *slot = packet;
+    r->pending++;
+    return PSYC_REORDER_BUFFERED;
+}
+
+void *
+psyc_reorder_pop (PsycReorder *r)
+{
+    void **slot = &r->slots[r->next & (r->size - 1)];
+    void *packet = *slot;
+
+    if (!packet)
+	return NULL;
+
+    *slot = NULL;
+    r->pending--;
+    r->next++;
+    return packet;
+}
+
+uint64_t
+psyc_reorder_skip (PsycReorder *r)
+{
+    uint64_t skipped = 0;
+
+    if (!r->pending)
+	return 0;
+
+    while (!r->slots[r->next & (r->size - 1)]) {
+	r->next++;
+	skipped++;
+    }
+
+    return skipped;
+}
+
+void
+psyc_window_table_init (PsycWindowTable *t, PsycWindowEntry *entries,
+			size_t size, const uint8_t key[PSYC_WINDOW_KEY_SIZE])
+{
+    *t = (PsycWindowTable) {
+	.entries = entries,
+	.size = size,
+	.used = 0,
+	.k0 = window_le64(key),
+	.k1 = window_le64(key + 8),
+    };
+    memset(entries, 0, sizeof(PsycWindowEntry) * size);
+}
+
+/**
+ * Incremental SipHash-2-4 state.
+ */
+typedef struct {
+    uint64_t v0, v1, v2, v3;
+    uint64_t m;			///< Bytes of the current block.
+    size_t len;			///< Number of bytes hashed.
+} WindowSip;
+
+#define ROTL(x, b) ((x) << (b) | (x) >> (64 - (b)))
+
+static inline void
+window_sip_round (WindowSip *s)
+{
+    s->v0 += s->v1; s->v1 = ROTL(s->v1, 13); s->v1 ^= s->v0;
+    s->v0 = ROTL(s->v0, 32);
+    s->v2 += s->v3; s->v3 = ROTL(s->v3, 16); s->v3 ^= s->v2;
+    s->v0 += s->v3; s->v3 = ROTL(s->v3, 21); s->v3 ^= s->v0;
+    s->v2 += s->v1; s->v1 = ROTL(s->v1, 17); s->v1 ^= s->v2;
+    s->v2 = ROTL(s->v2, 32);
+}
+
+static inline void
+window_sip_block (WindowSip *s, uint64_t m)
+{
+    s->v3 ^= m;
+    window_sip_round(s);
+    window_sip_round(s);
+    s->v0 ^= m;
+}
+
+static inline void
+window_sip_update (WindowSip *s, const uint8_t *data, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+	s->m |= (uint64_t)data[i] << 8 * (s->len++ & 7);
+	if (!(s->len & 7)) {
+	    window_sip_block(s, s->m);
+	    s->m = 0;
+	}
+    }
+}
+
+/**
+ * Keyed hash of the length-prefixed context & source, never 0.
+ *
+ * The lengths keep pairs like ("a|", "b") and ("a", "|b") apart, the key keeps
+ * senders from computing collisions with the entry of another source.
+ */
+static inline uint64_t
+window_key (PsycWindowTable *t, const char *context, size_t contextlen,
+	    const char *source, size_t sourcelen)
+{
+    WindowSip s = {
+	.v0 = t->k0 ^ 0x736f6d6570736575ULL,
+	.v1 = t->k1 ^ 0x646f72616e646f6dULL,
+	.v2 = t->k0 ^ 0x6c7967656e657261ULL,
+	.v3 = t->k1 ^ 0x7465646279746573ULL,
+    };
+    uint8_t len[8];
+    uint64_t h;
+
+    window_le64_put(len, contextlen);
+    window_sip_update(&s, len, sizeof(len));
+    window_sip_update(&s, (const uint8_t *)context, contextlen);
+    window_le64_put(len, sourcelen);
+    window_sip_update(&s, len, sizeof(len));
+    window_sip_update(&s, (const uint8_t *)source, sourcelen);
+
+    window_sip_block(&s, s.m | (uint64_t)s.len << 56);
+    s.v2 ^= 0xff;
+    window_sip_round(&s);
+    window_sip_round(&s);
+    window_sip_round(&s);
+    window_sip_round(&s);
+    h = s.v0 ^ s.v1 ^ s.v2 ^ s.v3;
+
+    return h ? h : 1;
+}
+
+PsycWindowEntry *
+psyc_window_table_get (PsycWindowTable *t,
+		       const char *context, size_t contextlen,
+		       const char *source, size_t sourcelen)
+{
+    uint64_t key = window_key(t, context, contextlen, source, sourcelen);
+    size_t mask = t->size - 1, i = key & mask;
+
+    // linear probing
+    while (t->entries[i].key) {
+	if (t->entries[i].key == key)
+	    return &t->entries[i];
+	i = (i + 1) & mask;
+    }
+
+    // keep at least one free entry so that lookups terminate
+    if (t->used + 1 >= t->size)
+	return NULL;
+
+    t->used++;
+    t->entries[i].key = key;
+    psyc_window_init(&t->entries[i].window);
+    t->entries[i].reorder = NULL;
+    return &t->entries[i];
+}
+
+void
+psyc_window_table_remove (PsycWindowTable *t, PsycWindowEntry *entry)
+{
+    size_t mask = t->size - 1, i = entry - t->entries, j = i, home;
+
+    // backward shift deletion, no tombstones needed
+    for (;;) {
+	t->entries[i].key = 0;
+	do {
+	    j = (j + 1) & mask;
+	    if (!t->entries[j].key) {
+		t->used--;
+		return;
+	    }
+	    home = t->entries[j].key & mask;
+	} while (i <= j ? (i < home && home <= j) : (i < home || home <= j));
+
+	t->entries[i] = t->entries[j];
+	i = j;
+    }
+}
+
+PsycWindowRC
+psyc_window_table_update_id (PsycWindowTable *t, PsycList *id,
+			     PsycWindowEntry **entry)
+{
+    PsycString *c = &id->elems[PSYC_PACKET_ID_COUNTER].value;
+    PsycWindowEntry *e;
+    uint64_t counter;
+
+    if (!c->length || psyc_parse_uint(PSYC_S2ARG(*c), &counter) != c->length)
+	return PSYC_WINDOW_ERROR;
+
+    e = psyc_window_table_get_id(t, id);
+    if (entry)
+	*entry = e;
+    if (!e)
+	return PSYC_WINDOW_ERROR;
+
+    return psyc_window_update(&e->window, counter);
+}
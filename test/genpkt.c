@@ -0,0 +1,144 @@
+/**
+ * Generates packets with pseudo-random binary data for the benchmarks.
+ *
+ * The data comes from a seeded generator instead of /dev/urandom, so the same
+ * arguments always produce the same file, and all codecs get the same data.
+ *
+ * Usage:
+ *   genpkt psyc <header> <content> <size> [seed]
+ *	header, length of content + data, content, data, end of packet
+ *   genpkt b64 <header> <footer> <size> [seed]
+ *	header, data encoded in base64, footer
+ *
+ * The packet is written to stdout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define CHUNK (3 * 4096)
+
+uint64_t seed = 0x5053594301;
+
+/**
+ * xorshift64* generator.
+ */
+static inline uint64_t
+rnd (void)
+{
+    seed ^= seed >> 12;
+    seed ^= seed << 25;
+    seed ^= seed >> 27;
+    return seed * 0x2545F4914F6CDD1DULL;
+}
+
+void
+fill (uint8_t *buf, size_t len)
+{
+    uint64_t r;
+    size_t i;
+
+    for (i = 0; i + 8 <= len; i += 8) {
+	r = rnd();
+	memcpy(buf + i, &r, 8);
+    }
+    if (i < len) {
+	r = rnd();
+	memcpy(buf + i, &r, len - i);
+    }
+}
+
+size_t
+base64 (char *out, const uint8_t *in, size_t len)
+{
+    static const char enc[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    size_t i, o = 0;
+    uint32_t v;
+
+    for (i = 0; i + 3 <= len; i += 3) {
+	v = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+	out[o++] = enc[v >> 18];
+	out[o++] = enc[v >> 12 & 63];
+	out[o++] = enc[v >> 6 & 63];
+	out[o++] = enc[v & 63];
+    }
+    if (i < len) {
+	v = in[i] << 16 | (i + 1 < len ? in[i + 1] << 8 : 0);
+	out[o++] = enc[v >> 18];
+	out[o++] = enc[v >> 12 & 63];
+	out[o++] = i + 1 < len ? enc[v >> 6 & 63] : '=';
+	out[o++] = '=';
+    }
+    return o;
+}
+
+int
+copy (const char *file)
+{
+    char buf[4096];
+    size_t n;
+    FILE *f = fopen(file, "r");
+
+    if (!f) {
+	perror(file);
+	return -1;
+    }
+    while ((n = fread(buf, 1, sizeof(buf), f)))
+	fwrite(buf, 1, n, stdout);
+    fclose(f);
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    uint8_t data[CHUNK];
+    char b64[CHUNK / 3 * 4];
+    struct stat st;
+    size_t size, n;
+    int psyc;
+
+    if (argc < 5 || argc > 6
+	|| (!(psyc = !strcmp(argv[1], "psyc")) && strcmp(argv[1], "b64"))) {
+	fprintf(stderr, "Usage: %s psyc <header> <content> <size> [seed]\n"
+		"       %s b64 <header> <footer> <size> [seed]\n",
+		argv[0], argv[0]);
+	return 1;
+    }
+    size = strtoull(argv[4], NULL, 10);
+    if (argc == 6)
+	seed = strtoull(argv[5], NULL, 0) | 1; // state must not be 0
+
+    if (copy(argv[2]))
+	return 1;
+
+    if (psyc) {
+	if (stat(argv[3], &st)) {
+	    perror(argv[3]);
+	    return 1;
+	}
+	printf("%zu\n", (size_t)st.st_size + size + 1);
+	if (copy(argv[3]))
+	    return 1;
+    }
+
+    for (; size; size -= n) {
+	n = size < CHUNK ? size : CHUNK;
+	fill(data, n);
+	if (psyc)
+	    fwrite(data, 1, n, stdout);
+	else
+	    fwrite(b64, 1, base64(b64, data, n), stdout);
+    }
+
+    if (psyc)
+	fputs("\n|\n", stdout);
+    else if (copy(argv[3]))
+	return 1;
+
+    return ferror(stdout) || fflush(stdout) ? 1 : 0;
+}
@@ -0,0 +1,528 @@
+/**
+ * Generates a stream of PSYC packets for load testing.
+ *
+ * The stream mixes presence notices, chat messages, profile updates with
+ * lists & dicts, state resets & resyncs and packets with binary bodies.
+ * Senders & recipients are chosen from a pool of users with a skewed
+ * distribution, sizes from configurable ranges with a log-uniform
+ * distribution, so that small packets are common and large ones rare.
+ * The same seed always produces the same stream.
+ *
+ * The packets are written to stdout or a file, to a directory with one packet
+ * per file, which can be used with test_psyc_speed -f, or sent to a TCP port.
+ */
+
+#if !defined(_GNU_SOURCE) && !defined(_POSIX_C_SOURCE)
+# define _POSIX_C_SOURCE 200112L // getaddrinfo()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#include <psyc.h>
+
+#define ROUTING_LINES 4
+#define ENTITY_LINES 8
+#define MAX_ELEMS 64
+#define TEXT_SIZE 4096
+
+typedef enum {
+    GEN_PRESENCE,
+    GEN_CHAT,
+    GEN_PROFILE,
+    GEN_STATE,
+    GEN_BINARY,
+    GEN_TYPES,
+} GenType;
+
+const char *type_names[] = {"presence", "chat", "profile", "state", "binary"};
+
+// cmd line args
+uint64_t seed = 1;
+size_t count = 1000, users = 1000;
+unsigned weights[GEN_TYPES] = {40, 40, 10, 5, 5};
+size_t text_min = 1, text_max = 400;
+size_t bin_min = 64, bin_max = 65536;
+char *outfile, *dir, *host;
+
+uint64_t rnd_state;
+
+/**
+ * xorshift64* generator.
+ */
+static inline uint64_t
+rnd (void)
+{
+    rnd_state ^= rnd_state >> 12;
+    rnd_state ^= rnd_state << 25;
+    rnd_state ^= rnd_state >> 27;
+    return rnd_state * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Random number in [0, n).
+ */
+static inline size_t
+rnd_n (size_t n)
+{
+    return n ? rnd() % n : 0;
+}
+
+/**
+ * Random number in [min, max], log-uniformly distributed:
+ * each power of 2 range is picked with the same probability.
+ */
+size_t
+rnd_size (size_t min, size_t max)
+{
+    size_t lo = min ? min : 1, hi, ranges = 0;
+
+    for (hi = lo; hi <= max / 2; hi *= 2)
+	ranges++;
+    lo <<= rnd_n(ranges + 1);
+    hi = lo * 2 - 1 < max ? lo * 2 - 1 : max;
+
+    return lo + rnd_n(hi - lo + 1);
+}
+
+/**
+ * Pick a user, lower numbers are picked more often.
+ */
+size_t
+rnd_user (void)
+{
+    return rnd_n(rnd_n(users) + 1);
+}
+
+const char *words[] = {
+    "the", "of", "and", "to", "a", "in", "is", "you", "that", "it", "he",
+    "was", "for", "on", "are", "as", "with", "his", "they", "at", "be", "this",
+    "have", "from", "or", "one", "had", "by", "word", "but", "not", "what",
+    "all", "were", "we", "when", "your", "can", "said", "there", "use", "an",
+    "each", "which", "she", "do", "how", "their", "if", "will", "up", "other",
+    "about", "out", "many", "then", "them", "these", "so", "some", "her",
+    "would", "make", "like", "him", "into", "time", "has", "look", "two",
+    "more", "write", "go", "see", "number", "no", "way", "could", "people",
+    "my", "than", "first", "water", "been", "call", "who", "oil", "its",
+    "now", "find", "long", "down", "day", "did", "get", "come", "made", "may",
+    "part", "Romeo", "Juliet", "Montague", "Capulet", ":)", "|", "\n", "\t",
+};
+
+/**
+ * Write random words up to len bytes.
+ */
+size_t
+text (char *buf, size_t len)
+{
+    size_t n = 0, w;
+    const char *word;
+
+    while (n < len) {
+	word = words[rnd_n(rnd_n(PSYC_NUM_ELEM(words)) + 1)];
+	w = strlen(word);
+	if (n + w + 1 > len)
+	    w = len - n - 1;
+	memcpy(buf + n, word, w);
+	n += w;
+	if (n < len)
+	    buf[n++] = ' ';
+    }
+    return n;
+}
+
+size_t
+uniform (char *buf, size_t len, size_t user)
+{
+    return snprintf(buf, len, "psyc://host%zu.example.net/~user%zu",
+		    user % 97, user);
+}
+
+typedef struct {
+    PsycModifier routing[ROUTING_LINES];
+    PsycModifier entity[ENTITY_LINES];
+    PsycElem elems[MAX_ELEMS];
+    PsycDictElem delems[MAX_ELEMS];
+    PsycList list;
+    PsycDict dict;
+    PsycPacket packet;
+    char source[64], target[64], nick[32], counter[24];
+    char uniforms[MAX_ELEMS][64];
+    char values[MAX_ELEMS][32];
+    char list_buf[MAX_ELEMS * 72], dict_buf[MAX_ELEMS * 72];
+    char text[TEXT_SIZE];
+    char *bin;
+} Gen;
+
+const PsycString presence[] = {
+    PSYC_C2STRI("here"), PSYC_C2STRI("away"), PSYC_C2STRI("busy"),
+    PSYC_C2STRI("vacation"), PSYC_C2STRI("offline"),
+};
+
+const PsycString profile_keys[] = {
+    PSYC_C2STRI("_name"), PSYC_C2STRI("_email"), PSYC_C2STRI("_city"),
+    PSYC_C2STRI("_country"), PSYC_C2STRI("_language"), PSYC_C2STRI("_page"),
+    PSYC_C2STRI("_color"), PSYC_C2STRI("_date_birth"),
+};
+
+static inline void
+add (PsycModifier *m, char oper, char *name, size_t namelen, PsycString value)
+{
+    psyc_modifier_init(m, oper, name, namelen, PSYC_S2ARG(value),
+		       PSYC_MODIFIER_CHECK_LENGTH);
+}
+
+#define ADD(h, lines, op, name, value)				\
+    add(&(h)[(lines)++], op, PSYC_C2ARG(name), value)
+
+/**
+ * Generate the next packet.
+ */
+PsycPacket *
+gen (Gen *g, size_t num, GenType *t)
+{
+    unsigned total = 0, r, i;
+    size_t rlines = 0, elines = 0, n, len, src = rnd_user(), dst = rnd_user();
+    PsycString method = {0}, data = {0}, s;
+    char stateop = PSYC_STATE_NOOP;
+    GenType type;
+
+    for (i = 0; i < GEN_TYPES; i++)
+	total += weights[i];
+    r = rnd_n(total);
+    for (type = 0; r >= weights[type]; type++)
+	r -= weights[type];
+    *t = type;
+
+    len = uniform(g->source, sizeof(g->source), src);
+    psyc_modifier_init(&g->routing[rlines++], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_source"), g->source, len,
+		       PSYC_MODIFIER_ROUTING);
+    if (type != GEN_PRESENCE && type != GEN_PROFILE) {
+	len = uniform(g->target, sizeof(g->target), dst);
+	psyc_modifier_init(&g->routing[rlines++], PSYC_OPERATOR_SET,
+			   PSYC_C2ARG("_target"), g->target, len,
+			   PSYC_MODIFIER_ROUTING);
+    }
+    len = snprintf(g->counter, sizeof(g->counter), "%zu", num);
+    psyc_modifier_init(&g->routing[rlines++], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_counter"), g->counter, len,
+		       PSYC_MODIFIER_ROUTING);
+
+    s.data = g->nick;
+    s.length = snprintf(g->nick, sizeof(g->nick), "user%zu", src);
+
+    switch (type) {
+    case GEN_PRESENCE:
+	ADD(g->entity, elines, PSYC_OPERATOR_SET, "_nick", s);
+	ADD(g->entity, elines, PSYC_OPERATOR_ASSIGN, "_degree_availability",
+	    presence[rnd_n(PSYC_NUM_ELEM(presence))]);
+	if (rnd_n(2)) {
+	    s = PSYC_STRING(g->text, text(g->text, rnd_size(1, 60)));
+	    ADD(g->entity, elines, PSYC_OPERATOR_ASSIGN,
+		"_description_presence", s);
+	}
+	method = PSYC_C2STR("_notice_presence");
+	break;
+
+    case GEN_CHAT:
+	ADD(g->entity, elines, PSYC_OPERATOR_SET, "_nick", s);
+	method = rnd_n(10) ? PSYC_C2STR("_message_private")
+	    : PSYC_C2STR("_message_action");
+	data = PSYC_STRING(g->text, text(g->text, rnd_size(text_min, text_max)));
+	break;
+
+    case GEN_PROFILE:
+	ADD(g->entity, elines, PSYC_OPERATOR_ASSIGN, "_nick", s);
+
+	n = rnd_size(1, MAX_ELEMS);
+	for (i = 0; i < n; i++) {
+	    len = uniform(g->uniforms[i], sizeof(g->uniforms[i]), rnd_user());
+	    g->elems[i] = PSYC_ELEM_VF(g->uniforms[i], len,
+				       PSYC_ELEM_CHECK_LENGTH);
+	}
+	psyc_list_init(&g->list, g->elems, n);
+	psyc_render_list(&g->list, g->list_buf, g->list.length);
+	s = PSYC_STRING(g->list_buf, g->list.length);
+	ADD(g->entity, elines, rnd_n(4) ? PSYC_OPERATOR_ASSIGN
+	    : PSYC_OPERATOR_AUGMENT, "_list_friends", s);
+
+	n = rnd_size(1, PSYC_NUM_ELEM(profile_keys));
+	for (i = 0; i < n; i++) {
+	    len = text(g->values[i], rnd_size(1, sizeof(g->values[i])));
+	    g->delems[i] = PSYC_DICT_ELEM(
+		PSYC_DICT_KEY(profile_keys[i].data, profile_keys[i].length,
+			      PSYC_ELEM_CHECK_LENGTH),
+		PSYC_ELEM_VF(g->values[i], len, PSYC_ELEM_CHECK_LENGTH));
+	}
+	psyc_dict_init(&g->dict, g->delems, n);
+	psyc_render_dict(&g->dict, g->dict_buf, g->dict.length);
+	s = PSYC_STRING(g->dict_buf, g->dict.length);
+	ADD(g->entity, elines, PSYC_OPERATOR_ASSIGN, "_dict_profile", s);
+
+	method = PSYC_C2STR("_notice_set");
+	break;
+
+    case GEN_STATE:
+	if (rnd_n(2)) {
+	    // reset, followed by the new state
+	    stateop = PSYC_STATE_RESET;
+	    ADD(g->entity, elines, PSYC_OPERATOR_ASSIGN, "_nick", s);
+	    ADD(g->entity, elines, PSYC_OPERATOR_ASSIGN, "_degree_availability",
+		presence[rnd_n(PSYC_NUM_ELEM(presence))]);
+	    method = PSYC_C2STR("_notice_set");
+	} else {
+	    stateop = PSYC_STATE_RESYNC;
+	    method = PSYC_C2STR("_request_sync");
+	}
+	break;
+
+    case GEN_BINARY:
+	ADD(g->entity, elines, PSYC_OPERATOR_SET, "_nick", s);
+	n = rnd_size(bin_min, bin_max);
+	for (i = 0; i < n; i++)
+	    g->bin[i] = rnd();
+	s = PSYC_C2STR("application/octet-stream");
+	ADD(g->entity, elines, PSYC_OPERATOR_SET, "_type", s);
+	method = PSYC_C2STR("_notice_file");
+	data = PSYC_STRING(g->bin, n);
+	break;
+
+    default:
+	return NULL;
+    }
+
+    psyc_packet_init(&g->packet, g->routing, rlines, g->entity, elines,
+		     PSYC_S2ARG(method), PSYC_S2ARG(data),
+		     stateop, PSYC_PACKET_CHECK_LENGTH);
+    return &g->packet;
+}
+
+/**
+ * Parse a range: min:max or a single number.
+ */
+int
+parse_range (char *arg, size_t *min, size_t *max)
+{
+    char *end;
+
+    *min = *max = strtoul(arg, &end, 10);
+    if (*end == ':')
+	*max = strtoul(end + 1, &end, 10);
+
+    return *end || *min > *max || !*max ? -1 : 0;
+}
+
+int
+parse_weights (char *arg)
+{
+    char *end = arg;
+    int i;
+
+    for (i = 0; i < GEN_TYPES; i++) {
+	weights[i] = strtoul(end, &end, 10);
+	if (*end != (i < GEN_TYPES - 1 ? ',' : '\0'))
+	    return -1;
+	end++;
+    }
+    return 0;
+}
+
+int
+connect_to (char *host)
+{
+    struct addrinfo hints = {.ai_socktype = SOCK_STREAM}, *res, *ai;
+    char *port = strrchr(host, ':');
+    int fd = -1;
+
+    if (!port)
+	return -1;
+    *port++ = '\0';
+
+    if (getaddrinfo(host, port, &hints, &res)) {
+	fprintf(stderr, "%s: unknown host\n", host);
+	return -1;
+    }
+    for (ai = res; ai; ai = ai->ai_next) {
+	fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+	if (fd >= 0 && connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+	    break;
+	if (fd >= 0)
+	    close(fd);
+	fd = -1;
+    }
+    freeaddrinfo(res);
+
+    if (fd < 0)
+	perror("connect");
+    return fd;
+}
+
+int
+write_all (int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len) {
+	if ((n = write(fd, buf, len)) <= 0) {
+	    perror("write");
+	    return -1;
+	}
+	buf += n;
+	len -= n;
+    }
+    return 0;
+}
+
+void
+usage (char *name)
+{
+    printf("Usage: %s [-s seed] [-n count] [-u users] [-m weights] [-t min:max]"
+	   " [-b min:max] [-o file | -d dir | -p host:port]\n\n"
+	   "  -s\tseed, default 1\n"
+	   "  -n\tnumber of packets, default 1000\n"
+	   "  -u\tnumber of users, default 1000\n"
+	   "  -m\tweights of presence,chat,profile,state,binary packets, "
+	   "default 40,40,10,5,5\n"
+	   "  -t\tsize range of chat messages, default 1:400\n"
+	   "  -b\tsize range of binary bodies, default 64:65536\n"
+	   "  -o\twrite packets to file, default stdout\n"
+	   "  -d\twrite each packet to a file in dir, e.g. for test_psyc_speed -f\n"
+	   "  -p\tsend packets to host:port\n"
+	   "  -v\tprint statistics to stderr\n", name);
+}
+
+int
+main (int argc, char **argv)
+{
+    Gen g;
+    GenType type;
+    PsycPacket *p;
+    size_t i, buflen = 0, nums[GEN_TYPES] = {0}, bytes = 0;
+    char *buf = NULL, path[4096];
+    int c, fd = 1, verbose = 0;
+    FILE *f, *out = NULL;
+
+    while ((c = getopt(argc, argv, "s:n:u:m:t:b:o:d:p:vh")) != -1) {
+	switch (c) {
+	case 's':
+	    seed = strtoull(optarg, NULL, 0);
+	    break;
+	case 'n':
+	    count = strtoul(optarg, NULL, 10);
+	    break;
+	case 'u':
+	    users = strtoul(optarg, NULL, 10);
+	    break;
+	case 'm':
+	    if (parse_weights(optarg)) {
+		fprintf(stderr, "-m: expected 5 comma separated numbers\n");
+		return 1;
+	    }
+	    break;
+	case 't':
+	    if (parse_range(optarg, &text_min, &text_max)
+		|| text_max > TEXT_SIZE) {
+		fprintf(stderr, "-t: expected min:max, max <= %d\n", TEXT_SIZE);
+		return 1;
+	    }
+	    break;
+	case 'b':
+	    if (parse_range(optarg, &bin_min, &bin_max)) {
+		fprintf(stderr, "-b: expected min:max\n");
+		return 1;
+	    }
+	    break;
+	case 'o':
+	    outfile = optarg;
+	    break;
+	case 'd':
+	    dir = optarg;
+	    break;
+	case 'p':
+	    host = optarg;
+	    break;
+	case 'v':
+	    verbose = 1;
+	    break;
+	case 'h':
+	    usage(argv[0]);
+	    return 0;
+	default:
+	    usage(argv[0]);
+	    return 1;
+	}
+    }
+
+    for (i = c = 0; i < GEN_TYPES; i++)
+	c += weights[i];
+    if (!c || !users) {
+	fprintf(stderr, "no packets to generate\n");
+	return 1;
+    }
+
+    rnd_state = seed ? seed : 0x5053594301; // state must not be 0
+    if (!(g.bin = malloc(bin_max))) {
+	perror("malloc");
+	return 1;
+    }
+
+    if (host && (fd = connect_to(host)) < 0)
+	return 1;
+    if (outfile) {
+	if (!(out = fopen(outfile, "w"))) {
+	    perror(outfile);
+	    return 1;
+	}
+	fd = fileno(out);
+    }
+
+    for (i = 0; i < count; i++) {
+	p = gen(&g, i, &type);
+	psyc_packet_length_set(p);
+
+	if (p->length > buflen && !(buf = realloc(buf, buflen = p->length))) {
+	    perror("realloc");
+	    return 1;
+	}
+	if (psyc_render(p, buf, p->length) != PSYC_RENDER_SUCCESS) {
+	    fprintf(stderr, "render error\n");
+	    return 2;
+	}
+
+	if (dir) {
+	    snprintf(path, sizeof(path), "%s/%06zu.psyc", dir, i);
+	    if (!(f = fopen(path, "w")) || fwrite(buf, 1, p->length, f)
+		!= p->length || fclose(f)) {
+		perror(path);
+		return 1;
+	    }
+	} else if (write_all(fd, buf, p->length))
+	    return 1;
+
+	bytes += p->length;
+	nums[type]++;
+    }
+
+    if (out && fclose(out)) {
+	perror(outfile);
+	return 1;
+    }
+    if (host)
+	close(fd);
+
+    if (verbose) {
+	fprintf(stderr, "%zu packets, %zu bytes:", count, bytes);
+	for (i = 0; i < GEN_TYPES; i++)
+	    fprintf(stderr, " %s %zu", type_names[i], nums[i]);
+	fprintf(stderr, "\n");
+    }
+
+    return 0;
+}
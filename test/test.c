@@ -114,7 +114,11 @@ test_file (const char* filename, size_t count, size_t recv_buf_size)
 
     if (stats) {
 	gettimeofday(&end, NULL);
-	printf("%ld\n", (end.tv_sec * 1000000 + end.tv_usec - start.tv_sec * 1000000 - start.tv_usec) / 1000);
+	long usec = end.tv_sec * 1000000 + end.tv_usec - start.tv_sec * 1000000 - start.tv_usec;
+	if (stats > 1)
+	    printf("%ld us\n", usec);
+	else
+	    printf("%ld\n", usec / 1000);
     }
 }
 
@@ -22,7 +22,7 @@
 #define CASE_m case 'm': multiple = 1; break;
 #define CASE_q case 'q': quiet = 1; break;
 #define CASE_r case 'r': routing_only = 1; break;
-#define CASE_s case 's': stats = 1; break;
+#define CASE_s case 's': stats++; break;
 #define CASE_v case 'v': verbose++; break;
 #define CASE_P case 'P': progress = 1; break;
 #define CASE_S case 'S': single = 1; break;
@@ -37,7 +37,7 @@
 #define HELP_q "  -q\t\t\tQuiet mode, don't output rendered string\n"
 #define HELP_r "  -r\t\t\tParse routing header only\n"
 #define HELP_S "  -S\t\t\tSingle packet mode, close connection after parsing one packet\n"
-#define HELP_s "  -s\t\t\tShow statistics at the end\n"
+#define HELP_s "  -s\t\t\tShow statistics at the end, in microseconds if specified twice\n"
 #define HELP_v "  -v\t\t\tVerbose, can be specified multiple times for more verbosity\n"
 #define HELP_P "  -P\t\t\tShow progress\n"
 #define HELP_h "  -h\t\t\tShow this help\n"
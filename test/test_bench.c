@@ -0,0 +1,598 @@
+/**
+ * Microbenchmarks for the parser, renderer, text templates, uniforms and
+ * keyword matching.
+ *
+ * Each benchmark is warmed up, its iteration count calibrated to take about
+ * the given time per repetition, then repeated. The median, minimum and
+ * spread of ns/op are reported, with bytes/s, and cycles & instructions per
+ * op where perf_event_open() is available.
+ *
+ * Usage: test_bench [-r reps] [-t ms] [-b filter] [-C] [file.psyc ...]
+ */
+
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE // clock_gettime(), syscall()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <math.h>
+#include <time.h>
+
+#ifdef __linux__
+# include <linux/perf_event.h>
+# include <sys/ioctl.h>
+# include <sys/syscall.h>
+#endif
+
+#include <psyc.h>
+
+#define ROUTING_LINES 16
+#define ENTITY_LINES 32
+#define MAX_REPS 100
+
+// cmd line args
+uint8_t verbose, counters = 1;
+size_t reps = 7;
+double rep_ms = 20;
+char *filter;
+
+/// Sink for results, so that the compiler can't drop the benchmarked code.
+volatile size_t sink;
+
+typedef struct {
+    char name[64];
+    /// Run n iterations, return a checksum or SIZE_MAX on error.
+    size_t (*run) (void *arg, size_t n);
+    void *arg;
+    size_t bytes;		///< bytes processed per op, or 0
+} Bench;
+
+typedef struct {
+    char *buffer;
+    size_t length;
+    PsycModifier routing[ROUTING_LINES];
+    PsycModifier entity[ENTITY_LINES];
+    PsycPacket packet;
+    char *out;
+} PacketArg;
+
+typedef struct {
+    const char *data;
+    size_t length;
+} StringArg;
+
+// ---- timing & counters
+
+static inline uint64_t
+now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int perf_fd = -1;
+
+/**
+ * Open a group of cycle & instruction counters for this thread.
+ */
+void
+perf_init (void)
+{
+#ifdef __linux__
+    struct perf_event_attr attr;
+    int fd;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CPU_CYCLES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+
+    perf_fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    if (perf_fd < 0)
+	return;
+
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 0;
+    fd = syscall(__NR_perf_event_open, &attr, 0, -1, perf_fd, 0);
+    if (fd < 0) {
+	close(perf_fd);
+	perf_fd = -1;
+    }
+#endif
+}
+
+/**
+ * Run a benchmark n times, measuring time and if available cycles &
+ * instructions.
+ *
+ * @return Elapsed ns, or 0 on error.
+ */
+uint64_t
+measure (Bench *b, size_t n, double *cycles, double *instr)
+{
+    uint64_t start, end;
+    size_t ret;
+
+    *cycles = *instr = NAN;
+#ifdef __linux__
+    struct { uint64_t nr, values[2]; } counts;
+
+    if (perf_fd >= 0) {
+	ioctl(perf_fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(perf_fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#endif
+
+    start = now_ns();
+    ret = b->run(b->arg, n);
+    end = now_ns();
+
+#ifdef __linux__
+    if (perf_fd >= 0) {
+	ioctl(perf_fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+	if (read(perf_fd, &counts, sizeof(counts)) == sizeof(counts)) {
+	    *cycles = (double)counts.values[0] / n;
+	    *instr = (double)counts.values[1] / n;
+	}
+    }
+#endif
+
+    if (ret == SIZE_MAX)
+	return 0;
+
+    sink += ret;
+    return end > start ? end - start : 1;
+}
+
+static int
+cmp_double (const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static double
+median (double *v, size_t n)
+{
+    qsort(v, n, sizeof(double), cmp_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+void
+bench (Bench *b)
+{
+    double ns[MAX_REPS], cyc[MAX_REPS], ins[MAX_REPS];
+    double mean = 0, var = 0, med;
+    uint64_t t, target = rep_ms * 1000000;
+    size_t i, n = 1;
+
+    if (filter && !strstr(b->name, filter))
+	return;
+
+    // warmup & calibration: grow n until a run takes a tenth of the target
+    for (;;) {
+	if (!(t = measure(b, n, cyc, ins))) {
+	    printf("%-36s error\n", b->name);
+	    return;
+	}
+	if (t >= target / 10 || n >= (size_t)1 << 40)
+	    break;
+	n *= t ? (target / 10 / t > 10 ? 10 : 2) : 10;
+    }
+    n = n * target / t + 1;
+    measure(b, n, cyc, ins);
+
+    for (i = 0; i < reps; i++) {
+	t = measure(b, n, &cyc[i], &ins[i]);
+	ns[i] = (double)t / n;
+	mean += ns[i];
+    }
+    mean /= reps;
+    for (i = 0; i < reps; i++)
+	var += (ns[i] - mean) * (ns[i] - mean);
+    var /= reps;
+
+    med = median(ns, reps);
+    printf("%-36s %10.1f %10.1f %6.1f%%", b->name, med, ns[0],
+	   mean ? 100 * sqrt(var) / mean : 0);
+    if (b->bytes)
+	printf(" %10.1f", b->bytes / med * 1000); // MB/s
+    else
+	printf(" %10s", "-");
+    if (!isnan(cyc[0]))
+	printf(" %10.1f %10.1f", median(cyc, reps), median(ins, reps));
+    else
+	printf(" %10s %10s", "-", "-");
+    printf(" %12zu\n", n);
+}
+
+// ---- benchmarks
+
+/**
+ * Parse a packet, keep its parts if packet is not NULL.
+ */
+static inline int
+parse_packet (char *buffer, size_t length, PsycParseFlag flags,
+	      PsycPacket *packet)
+{
+    PsycParseState state;
+    PsycString name, value;
+    char oper;
+    int ret, n = 0;
+
+    psyc_parse_state_init(&state, flags);
+    psyc_parse_buffer_set(&state, buffer, length);
+
+    for (;;) {
+	ret = psyc_parse(&state, &oper, &name, &value);
+	switch (ret) {
+	case PSYC_PARSE_ROUTING:
+	    if (packet && packet->routing.lines < ROUTING_LINES)
+		packet->routing.modifiers[packet->routing.lines++] =
+		    PSYC_MODIFIER(oper, name, value, PSYC_MODIFIER_ROUTING);
+	    break;
+	case PSYC_PARSE_ENTITY:
+	    if (packet && packet->entity.lines < ENTITY_LINES)
+		packet->entity.modifiers[packet->entity.lines++] =
+		    PSYC_MODIFIER(oper, name, value, PSYC_MODIFIER_CHECK_LENGTH);
+	    break;
+	case PSYC_PARSE_STATE_RESYNC:
+	case PSYC_PARSE_STATE_RESET:
+	    if (packet)
+		packet->stateop = oper;
+	    break;
+	case PSYC_PARSE_BODY:
+	    if (packet) {
+		packet->method = name;
+		packet->data = value;
+	    }
+	    break;
+	case PSYC_PARSE_COMPLETE:
+	    return n;
+	default:
+	    if (ret < 0 || ret == PSYC_PARSE_INSUFFICIENT
+		|| ret == PSYC_PARSE_ENTITY_START || ret == PSYC_PARSE_BODY_START)
+		return -1;
+	}
+	n++;
+    }
+}
+
+size_t
+run_parse (void *arg, size_t n)
+{
+    PacketArg *p = arg;
+    size_t i, sum = 0;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+	if ((ret = parse_packet(p->buffer, p->length, 0, NULL)) < 0)
+	    return SIZE_MAX;
+	sum += ret;
+    }
+    return sum;
+}
+
+size_t
+run_parse_routing (void *arg, size_t n)
+{
+    PacketArg *p = arg;
+    size_t i, sum = 0;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+	ret = parse_packet(p->buffer, p->length, PSYC_PARSE_ROUTING_ONLY, NULL);
+	if (ret < 0)
+	    return SIZE_MAX;
+	sum += ret;
+    }
+    return sum;
+}
+
+size_t
+run_render (void *arg, size_t n)
+{
+    PacketArg *p = arg;
+    size_t i;
+
+    for (i = 0; i < n; i++)
+	if (psyc_render(&p->packet, p->out, p->packet.length)
+	    != PSYC_RENDER_SUCCESS)
+	    return SIZE_MAX;
+    return p->out[0];
+}
+
+size_t
+run_list (void *arg, size_t n)
+{
+    StringArg *s = arg;
+    PsycParseListState state;
+    PsycString type, elem;
+    size_t i, sum = 0;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+	psyc_parse_list_state_init(&state);
+	psyc_parse_list_buffer_set(&state, s->data, s->length);
+	do {
+	    ret = psyc_parse_list(&state, &type, &elem);
+	    sum += elem.length;
+	} while (ret > 0 && ret != PSYC_PARSE_LIST_END
+		 && ret != PSYC_PARSE_LIST_ELEM_LAST);
+	if (ret < 0)
+	    return SIZE_MAX;
+    }
+    return sum;
+}
+
+size_t
+run_dict (void *arg, size_t n)
+{
+    StringArg *s = arg;
+    PsycParseDictState state;
+    PsycString type, elem;
+    size_t i, sum = 0;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+	psyc_parse_dict_state_init(&state);
+	psyc_parse_dict_buffer_set(&state, s->data, s->length);
+	do {
+	    ret = psyc_parse_dict(&state, &type, &elem);
+	    sum += elem.length;
+	} while (ret > 0 && ret != PSYC_PARSE_DICT_END
+		 && ret != PSYC_PARSE_DICT_VALUE_LAST);
+	if (ret < 0)
+	    return SIZE_MAX;
+    }
+    return sum;
+}
+
+size_t
+run_index (void *arg, size_t n)
+{
+    StringArg *s = arg;
+    PsycParseIndexState state;
+    PsycString idx;
+    size_t i, sum = 0;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+	psyc_parse_index_state_init(&state);
+	psyc_parse_index_buffer_set(&state, s->data, s->length);
+	do {
+	    ret = psyc_parse_index(&state, &idx);
+	    sum += idx.length;
+	} while (ret > 0 && ret != PSYC_PARSE_INDEX_END
+		 && ret != PSYC_PARSE_INDEX_LIST_LAST
+		 && ret != PSYC_PARSE_INDEX_STRUCT_LAST);
+	if (ret < 0)
+	    return SIZE_MAX;
+    }
+    return sum;
+}
+
+size_t
+run_update (void *arg, size_t n)
+{
+    StringArg *s = arg;
+    PsycParseUpdateState state;
+    PsycString value;
+    size_t i, sum = 0;
+    char oper;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+	psyc_parse_update_state_init(&state);
+	psyc_parse_update_buffer_set(&state, s->data, s->length);
+	do {
+	    ret = psyc_parse_update(&state, &oper, &value);
+	    sum += value.length;
+	} while (ret > 0 && ret != PSYC_PARSE_UPDATE_END
+		 && ret != PSYC_PARSE_UPDATE_VALUE);
+	if (ret < 0)
+	    return SIZE_MAX;
+    }
+    return sum;
+}
+
+PsycTextValueRC
+text_value (void *cls, const char *name, size_t len, PsycString *value)
+{
+    static const PsycString names[] = {
+	PSYC_C2STRI("_nick"), PSYC_C2STRI("_nick_place"), PSYC_C2STRI("_time"),
+    };
+    static const PsycString values[] = {
+	PSYC_C2STRI("alice"), PSYC_C2STRI("wonderland"), PSYC_C2STRI("1312"),
+    };
+    size_t i;
+
+    for (i = 0; i < PSYC_NUM_ELEM(names); i++)
+	if (names[i].length == len && memcmp(names[i].data, name, len) == 0) {
+	    *value = values[i];
+	    return PSYC_TEXT_VALUE_FOUND;
+	}
+
+    return PSYC_TEXT_VALUE_NOT_FOUND;
+}
+
+size_t
+run_text (void *arg, size_t n)
+{
+    StringArg *s = arg;
+    PsycTextState state;
+    char buffer[256];
+    size_t i, sum = 0;
+
+    for (i = 0; i < n; i++) {
+	psyc_text_state_init(&state, (char *) s->data, s->length,
+			     buffer, sizeof(buffer));
+	if (psyc_text(&state, text_value, NULL) != PSYC_TEXT_COMPLETE)
+	    return SIZE_MAX;
+	sum += state.written;
+    }
+    return sum;
+}
+
+size_t
+run_uniform (void *arg, size_t n)
+{
+    StringArg *s = arg;
+    PsycUniform uni;
+    size_t i, sum = 0;
+    int ret;
+
+    for (i = 0; i < n; i++) {
+	if ((ret = psyc_uniform_parse(&uni, s->data, s->length)) < 0)
+	    return SIZE_MAX;
+	sum += ret + uni.host.length;
+    }
+    return sum;
+}
+
+size_t
+run_matches (void *arg, size_t n)
+{
+    size_t i, sum = 0;
+
+    for (i = 0; i < n; i++)
+	sum += psyc_matches(PSYC_C2ARG("_failure_delivery"),
+			    PSYC_C2ARG("_failure_unsuccessful_delivery_death"));
+    return sum;
+}
+
+size_t
+run_map_lookup (void *arg, size_t n)
+{
+    StringArg *s = arg;
+    size_t i, sum = 0;
+
+    for (i = 0; i < n; i++)
+	sum += psyc_map_lookup_int(psyc_methods, psyc_methods_num,
+				   s->data, s->length, PSYC_YES);
+    return sum;
+}
+
+// ---- setup
+
+/// Benchmark on a fixed string, bytes/s are measured over the string.
+#define STRING_BENCH(name, run, str) \
+    (Bench) {name, run, &(StringArg) {str, sizeof(str) - 1}, sizeof(str) - 1}
+
+int
+add_packet (Bench *b, size_t *num, const char *file)
+{
+    const char *base = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+    PacketArg *p = calloc(1, sizeof(PacketArg));
+    FILE *f = fopen(file, "r");
+    long len;
+
+    if (!p || !f || fseek(f, 0, SEEK_END) || (len = ftell(f)) <= 0) {
+	perror(file);
+	return -1;
+    }
+    rewind(f);
+    p->buffer = malloc(len);
+    p->length = fread(p->buffer, 1, len, f);
+    fclose(f);
+
+    psyc_packet_init(&p->packet, p->routing, 0, p->entity, 0, NULL, 0,
+		     NULL, 0, PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+    if (parse_packet(p->buffer, p->length, 0, &p->packet) < 0) {
+	fprintf(stderr, "%s: parse error\n", file);
+	return -1;
+    }
+    psyc_packet_length_set(&p->packet);
+    p->out = malloc(p->packet.length);
+
+    b[*num] = (Bench) {"", run_parse, p, p->length};
+    snprintf(b[(*num)++].name, sizeof(b->name), "parse/%s", base);
+    b[*num] = (Bench) {"", run_parse_routing, p, p->length};
+    snprintf(b[(*num)++].name, sizeof(b->name), "parse_routing/%s", base);
+    b[*num] = (Bench) {"", run_render, p, p->packet.length};
+    snprintf(b[(*num)++].name, sizeof(b->name), "render/%s", base);
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    Bench *b;
+    size_t num = 0, i;
+    int c;
+
+    while ((c = getopt(argc, argv, "r:t:b:Cvh")) != -1) {
+	switch (c) {
+	case 'r':
+	    reps = atoi(optarg);
+	    break;
+	case 't':
+	    rep_ms = atof(optarg);
+	    break;
+	case 'b':
+	    filter = optarg;
+	    break;
+	case 'C':
+	    counters = 0;
+	    break;
+	case 'v':
+	    verbose = 1;
+	    break;
+	default:
+	    printf("Usage: %s [-r reps] [-t ms/rep] [-b filter] [-C] "
+		   "[file.psyc ...]\n"
+		   "  -r\trepetitions, default 7\n"
+		   "  -t\tduration of a repetition in ms, default 20\n"
+		   "  -b\tonly run benchmarks whose name contains filter\n"
+		   "  -C\tdon't use performance counters\n", argv[0]);
+	    return c == 'h' ? 0 : 1;
+	}
+    }
+    if (reps < 1 || reps > MAX_REPS || rep_ms <= 0) {
+	fprintf(stderr, "invalid arguments\n");
+	return 1;
+    }
+
+    b = calloc(3 * (argc - optind) + 16, sizeof(Bench));
+    for (i = optind; i < (size_t)argc; i++)
+	if (add_packet(b, &num, argv[i]))
+	    return 1;
+
+    b[num++] = STRING_BENCH("parse_list", run_list,
+				"| foo| bar| baz|3 a|b| 1337");
+    b[num++] = STRING_BENCH("parse_dict", run_dict,
+				"{ foo} bar{3 a}b{ baz} 1337");
+    b[num++] = STRING_BENCH("parse_index", run_index, "#1{3 foo}._bar#0");
+    b[num++] = STRING_BENCH("parse_update", run_update,
+				"#1{foo}._bar =_foo bar");
+    b[num++] = STRING_BENCH("text", run_text,
+				"[_nick] enters [_nick_place] at [_time].");
+    b[num++] = STRING_BENCH("uniform_parse", run_uniform,
+				"psyc://example.net:4404/~alice#_follow");
+    b[num++] = (Bench) {"matches", run_matches, NULL, 0};
+    b[num++] = (Bench) {"map_lookup", run_map_lookup,
+			&(StringArg) {PSYC_C2ARG("_notice_context_enter_foo")}, 0};
+
+    if (counters)
+	perf_init();
+    if (verbose)
+	fprintf(stderr, "performance counters: %s\n",
+		perf_fd >= 0 ? "on" : "off");
+
+    printf("%-36s %10s %10s %7s %10s %10s %10s %12s\n", "benchmark",
+	   "ns/op", "min ns/op", "+-", "MB/s", "cycles/op", "instr/op",
+	   "iterations");
+    for (i = 0; i < num; i++)
+	bench(&b[i]);
+
+    return 0;
+}
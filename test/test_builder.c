@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+#define myUNI	"psyc://10.100.1000/~ludwig"
+
+uint8_t verbose;
+
+size_t
+num_blocks (PsycArena *arena)
+{
+    PsycArenaBlock *block;
+    size_t n = 0;
+    for (block = arena->first; block; block = block->next)
+	n++;
+    return n;
+}
+
+int
+test_arena ()
+{
+    PsycArena arena;
+    char *a, *b, *c;
+    psyc_arena_init(&arena, 256);
+
+    a = psyc_arena_alloc(&arena, 3);
+    b = psyc_arena_alloc(&arena, 5);
+    if (!a || !b || (uintptr_t)b % PSYC_ARENA_ALIGN || b - a != PSYC_ARENA_ALIGN)
+	return 1;
+
+    // the last allocation grows in place, others are copied
+    memcpy(b, "hello", 5);
+    if (psyc_arena_realloc(&arena, b, 5, 100) != b)
+	return 2;
+    memcpy(a, "foo", 3);
+    c = psyc_arena_realloc(&arena, a, 3, 10);
+    if (!c || c == a || memcmp(c, "foo", 3))
+	return 3;
+
+    // larger than a block
+    c = psyc_arena_alloc(&arena, 1000);
+    if (!c || num_blocks(&arena) != 2)
+	return 4;
+
+    // blocks are reused after a reset
+    psyc_arena_reset(&arena);
+    if (psyc_arena_alloc(&arena, 3) != a
+	|| !psyc_arena_alloc(&arena, 500) || num_blocks(&arena) != 2)
+	return 5;
+
+    c = psyc_arena_copy(&arena, "bar", 3);
+    if (!c || memcmp(c, "bar", 3))
+	return 6;
+
+    psyc_arena_free(&arena);
+    return 0;
+}
+
+int
+test_builder ()
+{
+    PsycArena arena;
+    PsycBuilder b;
+    PsycPacket packet, ref;
+    PsycModifier routing[40], entity[102];
+    PsycElem elems[] = {
+	PSYC_ELEM_VF("foo", 3, PSYC_ELEM_CHECK_LENGTH),
+	PSYC_ELEM_VF("b|r", 3, PSYC_ELEM_CHECK_LENGTH),
+    };
+    PsycDictElem delems[] = {
+	{PSYC_ELEM_VF("1", 1, PSYC_ELEM_CHECK_LENGTH),
+	 PSYC_DICT_KEY("a", 1, PSYC_ELEM_CHECK_LENGTH)},
+    };
+    char names[100][16], buffer[8192], result[8192];
+    size_t i, round, blocks = 0;
+
+    psyc_arena_init(&arena, PSYC_ARENA_BLOCK_SIZE);
+
+    for (i = 0; i < 100; i++)
+	snprintf(names[i], sizeof(names[i]), "_var%zu", i);
+
+    for (round = 0; round < 3; round++) {
+	psyc_builder_init(&b, &arena);
+
+	for (i = 0; i < 40; i++) {
+	    if (!psyc_builder_routing(&b, PSYC_OPERATOR_SET,
+				      PSYC_C2ARG("_target"), PSYC_C2ARG(myUNI)))
+		return 11;
+	    psyc_modifier_init(&routing[i], PSYC_OPERATOR_SET,
+			       PSYC_C2ARG("_target"), PSYC_C2ARG(myUNI),
+			       PSYC_MODIFIER_ROUTING);
+	}
+
+	for (i = 0; i < 100; i++) {
+	    if (!psyc_builder_entity(&b, PSYC_OPERATOR_ASSIGN,
+				     names[i], strlen(names[i]),
+				     PSYC_C2ARG("some value")))
+		return 12;
+	    psyc_modifier_init(&entity[i], PSYC_OPERATOR_ASSIGN,
+			       names[i], strlen(names[i]),
+			       PSYC_C2ARG("some value"),
+			       PSYC_MODIFIER_CHECK_LENGTH);
+	}
+
+	if (!psyc_builder_list(&b, PSYC_OPERATOR_SET, PSYC_C2ARG("_list_foo"),
+			       elems, PSYC_NUM_ELEM(elems))
+	    || !psyc_builder_dict(&b, PSYC_OPERATOR_SET,
+				  PSYC_C2ARG("_dict_foo"),
+				  delems, PSYC_NUM_ELEM(delems)))
+	    return 13;
+	psyc_modifier_init(&entity[100], PSYC_OPERATOR_SET,
+			   PSYC_C2ARG("_list_foo"), PSYC_C2ARG("| foo|3 b|r"),
+			   PSYC_MODIFIER_CHECK_LENGTH);
+	psyc_modifier_init(&entity[101], PSYC_OPERATOR_SET,
+			   PSYC_C2ARG("_dict_foo"), PSYC_C2ARG("{ a} 1"),
+			   PSYC_MODIFIER_CHECK_LENGTH);
+
+	psyc_builder_packet(&b, &packet, PSYC_C2ARG("_message_public"),
+			    PSYC_C2ARG("hello"), PSYC_STATE_NOOP,
+			    PSYC_PACKET_CHECK_LENGTH);
+	psyc_packet_init(&ref, routing, 40, entity, 102,
+			 PSYC_C2ARG("_message_public"), PSYC_C2ARG("hello"),
+			 PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+
+	if (psyc_render(&packet, result, sizeof(result))
+	    || psyc_render(&ref, buffer, sizeof(buffer))
+	    || packet.length != ref.length
+	    || memcmp(result, buffer, ref.length))
+	    return 14;
+
+	if (verbose)
+	    printf("round %zu: %zu bytes, %zu blocks\n",
+		   round, packet.length, num_blocks(&arena));
+
+	// no more blocks are needed after the first packet
+	if (round && num_blocks(&arena) != blocks)
+	    return 15;
+	blocks = num_blocks(&arena);
+	psyc_arena_reset(&arena);
+    }
+
+    psyc_arena_free(&arena);
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    int ret;
+    verbose = argc > 1;
+
+    if ((ret = test_arena()) || (ret = test_builder()))
+	return ret;
+
+    puts("psyc_builder passed all tests.");
+    return 0;
+}
@@ -0,0 +1,204 @@
+#include <stdio.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+#define myUNI	"psyc://example.com/~juliet"
+
+uint8_t verbose;
+
+int
+test_lookup (PsycAliasTable *t)
+{
+    const PsycString *s;
+    size_t i;
+
+    for (i = 0; i < psyc_aliases_num; i++) {
+	if (psyc_alias_name_id(t, PSYC_S2ARG(psyc_aliases[i].name)) != (int)i
+	    || psyc_alias_compact_id(t, PSYC_S2ARG(psyc_aliases[i].compact))
+	    != (int)i)
+	    return 1;
+    }
+
+    s = psyc_alias_compact(t, PSYC_C2ARG("_notice_presence"));
+    if (!s || s->length != 2 || memcmp(s->data, "np", 2))
+	return 2;
+
+    s = psyc_alias_expand(t, PSYC_C2ARG("c"));
+    if (!s || s->length != 8 || memcmp(s->data, "_context", 8))
+	return 3;
+
+    if (psyc_alias_compact(t, PSYC_C2ARG("_notice"))
+	|| psyc_alias_compact(t, PSYC_C2ARG("_notice_presence_"))
+	|| psyc_alias_expand(t, PSYC_C2ARG("x"))
+	|| psyc_alias_expand(t, PSYC_C2ARG("npx"))
+	|| psyc_alias_expand(t, PSYC_C2ARG("N"))
+	|| psyc_alias_id(t, PSYC_C2ARG("")) != PSYC_ALIAS_NONE)
+	return 4;
+
+    if (psyc_alias_id(t, PSYC_C2ARG("da"))
+	!= psyc_alias_id(t, PSYC_C2ARG("_degree_availability")))
+	return 5;
+
+    return 0;
+}
+
+int
+test_init ()
+{
+    PsycAliasTable t;
+    PsycAlias dup_name[] = {
+	{ PSYC_C2STRI("_context"), PSYC_C2STRI("c") },
+	{ PSYC_C2STRI("_context"), PSYC_C2STRI("x") },
+    };
+    PsycAlias dup_compact[] = {
+	{ PSYC_C2STRI("_context"), PSYC_C2STRI("c") },
+	{ PSYC_C2STRI("_counter"), PSYC_C2STRI("c") },
+    };
+    PsycAlias bad_compact[] = {
+	{ PSYC_C2STRI("_context"), PSYC_C2STRI("_c") },
+    };
+    PsycAlias bad_name[] = {
+	{ PSYC_C2STRI("context"), PSYC_C2STRI("c") },
+    };
+
+    if (psyc_alias_table_init(&t, dup_name, 2) != PSYC_ALIAS_ERROR_DUPLICATE
+	|| psyc_alias_table_init(&t, dup_compact, 2) != PSYC_ALIAS_ERROR_DUPLICATE
+	|| psyc_alias_table_init(&t, bad_compact, 1) != PSYC_ALIAS_ERROR_KEYWORD
+	|| psyc_alias_table_init(&t, bad_name, 1) != PSYC_ALIAS_ERROR_KEYWORD
+	|| psyc_alias_table_init(&t, dup_name, PSYC_ALIAS_MAX + 1)
+	!= PSYC_ALIAS_ERROR_FULL)
+	return 1;
+
+    return 0;
+}
+
+int
+test_render (PsycAliasTable *t)
+{
+    PsycModifier routing[1] = {
+	PSYC_MODIFIER(PSYC_OPERATOR_SET, PSYC_C2STR("_context"),
+		      PSYC_C2STR(myUNI), PSYC_MODIFIER_ROUTING),
+    };
+    PsycModifier entity[2] = {
+	PSYC_MODIFIER(PSYC_OPERATOR_ASSIGN, PSYC_C2STR("_degree_availability"),
+		      PSYC_C2STR("4"), PSYC_MODIFIER_CHECK_LENGTH),
+	PSYC_MODIFIER(PSYC_OPERATOR_SET, PSYC_C2STR("_nick"),
+		      PSYC_C2STR("juliet"), PSYC_MODIFIER_CHECK_LENGTH),
+    };
+    const char *rendered = "\
+:c\t" myUNI "\n\
+\n\
+=da\t4\n\
+:_nick\tjuliet\n\
+np\n\
+|\n";
+
+    PsycRenderPolicy policy = PSYC_RENDER_POLICY_DEFAULT;
+    policy.aliases = t;
+
+    PsycPacket p = PSYC_PACKET(routing, 1, entity, 2,
+			       "_notice_presence", 16, NULL, 0,
+			       PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+    PsycBuffer buf;
+    PsycString out;
+    psyc_buffer_init(&buf);
+
+    if (psyc_render_append_policy(&p, &buf, &out, &policy)
+	!= PSYC_RENDER_SUCCESS)
+	return 1;
+    if (verbose)
+	printf("%.*s", (int)out.length, out.data);
+    if (out.length != strlen(rendered) || memcmp(out.data, rendered, out.length))
+	return 2;
+
+    psyc_buffer_free(&buf);
+    return 0;
+}
+
+int
+test_parse (PsycAliasTable *t)
+{
+    char packet[] = "\
+:c\t" myUNI "\n\
+:_target\txmpp:romeo@example.net\n\
+\n\
+:j\tto be or not to be ?\n\
+:tc\ttext/plain\n\
+:_nick\thamlet\n\
+m\n\
+to be or not to be ?\n\
+|\n";
+
+    struct {
+	int ret;
+	const char *name;
+	int compact;
+    } expected[] = {
+	{PSYC_PARSE_ROUTING, "_context", 1},
+	{PSYC_PARSE_ROUTING, "_target", 0},
+	{PSYC_PARSE_ENTITY, "_subject", 1},
+	{PSYC_PARSE_ENTITY, "_type_content", 1},
+	{PSYC_PARSE_ENTITY, "_nick", 0},
+	{PSYC_PARSE_BODY, "_message", 1},
+	{PSYC_PARSE_COMPLETE, NULL, 0},
+    };
+
+    PsycParseState state;
+    PsycString name, value;
+    char oper;
+    int ret, id;
+    size_t i;
+
+    psyc_parse_state_init(&state, PSYC_PARSE_ALL);
+    psyc_parse_buffer_set(&state, packet, sizeof(packet) - 1);
+
+    for (i = 0; i < PSYC_NUM_ELEM(expected); i++) {
+	ret = psyc_parse_alias(&state, t, &oper, &name, &value, &id);
+	if (verbose)
+	    printf("%d %.*s %d\n", ret, (int)name.length, name.data, id);
+	if (ret != expected[i].ret)
+	    return 1;
+	if (!expected[i].name)
+	    continue;
+	if (name.length != strlen(expected[i].name)
+	    || memcmp(name.data, expected[i].name, name.length))
+	    return 2;
+	if (expected[i].compact
+	    && (id == PSYC_ALIAS_NONE
+		|| psyc_alias_name_id(t, PSYC_S2ARG(name)) != id))
+	    return 3;
+	if (!expected[i].compact && id != PSYC_ALIAS_NONE
+	    && psyc_alias_name_id(t, PSYC_S2ARG(name)) != id)
+	    return 4;
+    }
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    verbose = argc > 1;
+    int ret;
+
+    PsycAliasTable t;
+    if (psyc_alias_table_init(&t, psyc_aliases, psyc_aliases_num)
+	!= PSYC_ALIAS_SUCCESS)
+	return 1;
+
+    if ((ret = test_lookup(&t)))
+	return 10 + ret;
+
+    if ((ret = test_init()))
+	return 20 + ret;
+
+    if ((ret = test_render(&t)))
+	return 30 + ret;
+
+    if ((ret = test_parse(&t)))
+	return 40 + ret;
+
+    puts("psyc_alias passed all tests.");
+    return 0;
+}
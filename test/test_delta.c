@@ -0,0 +1,149 @@
+#include <stdio.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+#define myUNI	"psyc://10.100.1000/~ludwig"
+
+uint8_t verbose;
+
+int
+test_delta (PsycDelta *delta, PsycModifier *entity, size_t entitylen,
+	    const char *rendered)
+{
+    PsycModifier routing[1];
+    psyc_modifier_init(&routing[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_context"),
+		       PSYC_C2ARG(myUNI), PSYC_MODIFIER_ROUTING);
+
+    PsycModifier out[8];
+    PsycPacket packet;
+    if (PSYC_DELTA_SUCCESS !=
+	psyc_delta_packet_init(delta, &packet, routing, PSYC_NUM_ELEM(routing),
+			       entity, entitylen, out, PSYC_NUM_ELEM(out),
+			       PSYC_C2ARG("_notice_presence"), NULL, 0,
+			       PSYC_PACKET_CHECK_LENGTH))
+	return -1;
+
+    char buffer[512];
+    psyc_render(&packet, buffer, sizeof(buffer));
+    if (verbose)
+	printf("%.*s\n", (int)packet.length, buffer);
+    return packet.length != strlen(rendered)
+	|| strncmp(rendered, buffer, packet.length);
+}
+
+int
+main (int argc, char **argv)
+{
+    verbose = argc > 1;
+
+    PsycDeltaVar vars[4];
+    PsycDelta delta;
+    psyc_delta_init(&delta, vars, PSYC_NUM_ELEM(vars));
+
+    PsycModifier entity[3];
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_ASSIGN,
+		       PSYC_C2ARG("_degree_availability"),
+		       PSYC_C2ARG("4"), PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&entity[1], PSYC_OPERATOR_ASSIGN,
+		       PSYC_C2ARG("_list_members"),
+		       PSYC_C2ARG("| foo| bar"), PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&entity[2], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_time_place"),
+		       PSYC_C2ARG("1"), PSYC_MODIFIER_CHECK_LENGTH);
+
+    // first packet resets the state and sends everything
+    if (test_delta(&delta, entity, 3, "\
+:_context\t" myUNI "\n\
+87\n\
+=\n\
+:_time_place\t1\n\
+=_degree_availability\t4\n\
+=_list_members 10\t| foo| bar\n\
+_notice_presence\n\
+|\n"))
+	return 1;
+
+    // nothing changed, only the transient variable is sent
+    if (test_delta(&delta, entity, 3, "\
+:_context\t" myUNI "\n\
+\n\
+:_time_place\t1\n\
+_notice_presence\n\
+|\n"))
+	return 2;
+
+    // list grows at the end
+    psyc_modifier_init(&entity[1], PSYC_OPERATOR_ASSIGN,
+		       PSYC_C2ARG("_list_members"),
+		       PSYC_C2ARG("| foo| bar| baz"), PSYC_MODIFIER_CHECK_LENGTH);
+    if (test_delta(&delta, entity, 2, "\
+:_context\t" myUNI "\n\
+\n\
++_list_members\t| baz\n\
+_notice_presence\n\
+|\n"))
+	return 3;
+
+    // list shrinks at the end, availability changes
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_ASSIGN,
+		       PSYC_C2ARG("_degree_availability"),
+		       PSYC_C2ARG("6"), PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&entity[1], PSYC_OPERATOR_ASSIGN,
+		       PSYC_C2ARG("_list_members"),
+		       PSYC_C2ARG("| foo"), PSYC_MODIFIER_CHECK_LENGTH);
+    if (test_delta(&delta, entity, 2, "\
+:_context\t" myUNI "\n\
+70\n\
+=_degree_availability\t6\n\
+-_list_members 10\t| bar| baz\n\
+_notice_presence\n\
+|\n"))
+	return 4;
+
+    // the other side asked for a resync
+    psyc_delta_resync(&delta);
+    if (test_delta(&delta, entity, 2, "\
+:_context\t" myUNI "\n\
+\n\
+=\n\
+=_degree_availability\t6\n\
+=_list_members\t| foo\n\
+_notice_presence\n\
+|\n"))
+	return 5;
+
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_ASSIGN,
+		       PSYC_C2ARG("_list_members"),
+		       PSYC_C2ARG("| foo| bar| baz"), PSYC_MODIFIER_CHECK_LENGTH);
+    if (test_delta(&delta, entity, 1, "\
+:_context\t" myUNI "\n\
+46\n\
++_list_members 10\t| bar| baz\n\
+_notice_presence\n\
+|\n"))
+	return 6;
+
+    // the diminished value is still rendered after a later modifier
+    // of the same variable replaced it
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_ASSIGN,
+		       PSYC_C2ARG("_list_members"),
+		       PSYC_C2ARG("| foo| bar"), PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&entity[1], PSYC_OPERATOR_AUGMENT,
+		       PSYC_C2ARG("_list_members"),
+		       PSYC_C2ARG("| qux"), PSYC_MODIFIER_CHECK_LENGTH);
+    if (test_delta(&delta, entity, 2, "\
+:_context\t" myUNI "\n\
+\n\
+-_list_members\t| baz\n\
++_list_members\t| qux\n\
+_notice_presence\n\
+|\n"))
+	return 7;
+
+    psyc_delta_free(&delta);
+
+    puts("psyc_delta passed all tests.");
+    return 0;
+}
@@ -0,0 +1,179 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+#define myUNI	"psyc://10.100.1000/~ludwig"
+#define CONTENT	":_nick\tludwig\n_message_private\nhello\n|\nworld\n"
+
+uint8_t verbose;
+
+int
+test_forward (char *packet, size_t packetlen, size_t buflen,
+	      PsycModifier *rewrite, size_t rewritelen,
+	      PsycForwardRC rc, const char *result, size_t rem)
+{
+    PsycModifier routing[4];
+    char header[256], out[512];
+    struct iovec iov[PSYC_FORWARD_IOV];
+    size_t consumed, remaining, outlen;
+    PsycForwardRC ret;
+
+    ret = psyc_forward(packet, buflen, rewrite, rewritelen,
+		       routing, PSYC_NUM_ELEM(routing),
+		       header, sizeof(header), iov, &consumed, &remaining);
+    if (ret != rc)
+	return 1;
+    if (ret < PSYC_FORWARD_COMPLETE || ret == PSYC_FORWARD_INSUFFICIENT)
+	return 0;
+
+    memcpy(out, iov[0].iov_base, iov[0].iov_len);
+    memcpy(out + iov[0].iov_len, iov[1].iov_base, iov[1].iov_len);
+    outlen = iov[0].iov_len + iov[1].iov_len;
+
+    // the rest would be spliced
+    memcpy(out + outlen, packet + consumed, remaining);
+    outlen += remaining;
+
+    if (verbose)
+	printf("%.*s", (int)outlen, out);
+
+    return remaining != rem || (char *)iov[1].iov_base < packet
+	|| (char *)iov[1].iov_base > packet + buflen
+	|| outlen != strlen(result) || memcmp(out, result, outlen);
+}
+
+int
+main (int argc, char **argv)
+{
+    verbose = argc > 1;
+
+    char packet[] = ":_source\t" myUNI "\n:_target\t" myUNI "/a\n"
+	"45\n" CONTENT "|\n";
+    size_t len = sizeof(packet) - 1, clen = sizeof(CONTENT) - 1;
+
+    PsycModifier rewrite[2];
+    psyc_modifier_init(&rewrite[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_target"),
+		       PSYC_C2ARG(myUNI "/b"), PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&rewrite[1], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_source_relay"),
+		       PSYC_C2ARG("psyc://relay"), PSYC_MODIFIER_ROUTING);
+
+    char result[] = ":_source\t" myUNI "\n:_target\t" myUNI "/b\n"
+	":_source_relay\tpsyc://relay\n45\n" CONTENT "|\n";
+
+    if (clen != 45)
+	return 1;
+
+    // complete packet
+    if (test_forward(packet, len, len, rewrite, 2,
+		     PSYC_FORWARD_COMPLETE, result, 0))
+	return 2;
+
+    // no rewrites
+    if (test_forward(packet, len, len, NULL, 0,
+		     PSYC_FORWARD_COMPLETE, packet, 0))
+	return 3;
+
+    // part of the content
+    if (test_forward(packet, len, len - 20, rewrite, 2,
+		     PSYC_FORWARD_INCOMPLETE, result, 20))
+	return 4;
+
+    // content not received yet
+    if (test_forward(packet, len, len - clen - 2, rewrite, 2,
+		     PSYC_FORWARD_INCOMPLETE, result, clen + 2))
+	return 5;
+
+    // delimiter missing
+    if (test_forward(packet, len, len - 1, rewrite, 2,
+		     PSYC_FORWARD_INCOMPLETE, result, 1))
+	return 6;
+
+    // incomplete routing header
+    if (test_forward(packet, len, 20, rewrite, 2,
+		     PSYC_FORWARD_INSUFFICIENT, NULL, 0))
+	return 7;
+
+    // no content length
+    char nolen[] = ":_target\t" myUNI "\n\n_notice_foo\nbar\n|\n";
+    char nolen_result[] = ":_target\t" myUNI "/b\n"
+	":_source_relay\tpsyc://relay\n\n_notice_foo\nbar\n|\n";
+    if (test_forward(nolen, sizeof(nolen) - 1, sizeof(nolen) - 1, rewrite, 2,
+		     PSYC_FORWARD_COMPLETE, nolen_result, 0))
+	return 8;
+    if (test_forward(nolen, sizeof(nolen) - 1, sizeof(nolen) - 3, rewrite, 2,
+		     PSYC_FORWARD_INSUFFICIENT, NULL, 0))
+	return 9;
+
+    // no content
+    char empty[] = ":_target\t" myUNI "\n|\n";
+    char empty_result[] = ":_target\t" myUNI "/b\n"
+	":_source_relay\tpsyc://relay\n|\n";
+    if (test_forward(empty, sizeof(empty) - 1, sizeof(empty) - 1, rewrite, 2,
+		     PSYC_FORWARD_COMPLETE, empty_result, 0))
+	return 10;
+
+    // too many routing modifiers
+    PsycModifier many[4];
+    size_t i;
+    for (i = 0; i < 4; i++)
+	psyc_modifier_init(&many[i], PSYC_OPERATOR_SET,
+			   PSYC_C2ARG("_foo"), PSYC_C2ARG("x"),
+			   PSYC_MODIFIER_ROUTING);
+    many[1].name = PSYC_STRING("_bar", 4);
+    many[2].name = PSYC_STRING("_baz", 4);
+    if (test_forward(packet, len, len, many, 3,
+		     PSYC_FORWARD_ERROR_HEADER, NULL, 0))
+	return 11;
+
+#ifdef __linux__
+    // splice the rest of the content from one pipe to another
+    int in[2], out[2], p[2];
+    size_t piped = 0, rem = len - 50;
+    char buf[4096];
+    if (pipe(in) || pipe(out) || pipe(p))
+	return 12;
+    if (write(in[1], packet + 50, rem) != (ssize_t)rem
+	|| psyc_forward_splice(in[0], out[1], p, rem, &piped) != (ssize_t)rem
+	|| piped || read(out[0], buf, sizeof(buf)) != (ssize_t)rem
+	|| memcmp(buf, packet + 50, rem))
+	return 13;
+
+    // short transfers on non-blocking descriptors
+    fcntl(in[0], F_SETFL, O_NONBLOCK);
+    fcntl(out[0], F_SETFL, O_NONBLOCK);
+    fcntl(out[1], F_SETFL, O_NONBLOCK);
+
+    // in has only part of the content
+    if (write(in[1], packet + 50, 20) != 20
+	|| psyc_forward_splice(in[0], out[1], p, rem, &piped) != 20 || piped)
+	return 14;
+    rem -= 20;
+    if (psyc_forward_splice(in[0], out[1], p, rem, &piped) != -1
+	|| errno != EAGAIN || piped)
+	return 15;
+
+    // out is full, the rest stays in the pipe
+    memset(buf, 0, sizeof(buf));
+    while (write(out[1], buf, sizeof(buf)) > 0);
+    if (write(in[1], packet + 70, rem) != (ssize_t)rem
+	|| psyc_forward_splice(in[0], out[1], p, rem, &piped) != -1
+	|| errno != EAGAIN || piped != rem)
+	return 16;
+
+    while (read(out[0], buf, sizeof(buf)) > 0);
+    if (psyc_forward_splice(in[0], out[1], p, rem, &piped) != (ssize_t)rem
+	|| piped || read(out[0], buf, sizeof(buf)) != (ssize_t)rem
+	|| memcmp(buf, packet + 70, rem))
+	return 17;
+#endif
+
+    puts("psyc_forward passed all tests.");
+    return 0;
+}
@@ -0,0 +1,181 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+#define myUNI	"psyc://10.100.1000/~ludwig"
+#define DATA	"some data\n|\nwith a delimiter in the middle\nand more data"
+
+uint8_t verbose;
+
+static inline int
+equal (PsycString *s, const char *str, size_t len)
+{
+    return s->length == len && memcmp(s->data, str, len) == 0;
+}
+
+/**
+ * Parse a fragment and add it to the reassembly state.
+ */
+PsycReassemblyRC
+add_fragment (PsycReassembly *r, char *buf, size_t len, uint64_t now)
+{
+    PsycParseState state;
+    PsycString name, value, content = {0, 0};
+    char oper;
+    uint64_t fragment = 0, amount = 0;
+    int ret;
+
+    psyc_parse_state_init(&state, PSYC_PARSE_ROUTING_ONLY);
+    psyc_parse_buffer_set(&state, buf, len);
+
+    do {
+	ret = psyc_parse(&state, &oper, &name, &value);
+	switch (ret) {
+	case PSYC_PARSE_ROUTING:
+	    if (equal(&name, PSYC_C2ARG("_fragment")))
+		psyc_parse_uint(PSYC_S2ARG(value), &fragment);
+	    else if (equal(&name, PSYC_C2ARG("_amount_fragments")))
+		psyc_parse_uint(PSYC_S2ARG(value), &amount);
+	    break;
+	case PSYC_PARSE_CONTENT:
+	    content = value;
+	    break;
+	case PSYC_PARSE_COMPLETE:
+	    break;
+	default:
+	    return PSYC_REASSEMBLY_ERROR;
+	}
+    } while (ret != PSYC_PARSE_COMPLETE);
+
+    return psyc_reassembly_add(r, fragment, amount, PSYC_S2ARG(content), now);
+}
+
+int
+main (int argc, char **argv)
+{
+    verbose = argc > 1;
+
+    PsycModifier routing[2];
+    psyc_modifier_init(&routing[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_source"),
+		       PSYC_C2ARG(myUNI), PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&routing[1], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_target"),
+		       PSYC_C2ARG(myUNI "/a"), PSYC_MODIFIER_ROUTING);
+
+    PsycModifier entity[1];
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_nick"),
+		       PSYC_C2ARG("ludwig"), PSYC_MODIFIER_CHECK_LENGTH);
+
+    PsycPacket packet;
+    psyc_packet_init(&packet, routing, PSYC_NUM_ELEM(routing),
+		     entity, PSYC_NUM_ELEM(entity),
+		     PSYC_C2ARG("_message_private"), PSYC_C2ARG(DATA),
+		     PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+
+    char content[256];
+    if (psyc_render_content(&packet, content, sizeof(content)))
+	return 1;
+
+    char headers[512];
+    struct iovec iov[8 * PSYC_FRAGMENT_IOV];
+    size_t i, j, num, fraglen[8], contentlen = packet.contentlen;
+
+    if (psyc_fragment_split(&packet, content, contentlen, 0, headers,
+			    sizeof(headers), iov, PSYC_NUM_ELEM(iov), &num)
+	!= PSYC_RENDER_ERROR)
+	return 2;
+    if (psyc_fragment_split(&packet, content, contentlen, 16, headers,
+			    sizeof(headers), iov, PSYC_NUM_ELEM(iov), &num)
+	|| num != (contentlen + 15) / 16)
+	return 3;
+
+    // write the fragments to a stream
+    char stream[1024], *frag[8];
+    size_t cur = 0;
+    for (i = 0; i < num; i++) {
+	frag[i] = stream + cur;
+	for (j = 0; j < PSYC_FRAGMENT_IOV; j++) {
+	    memcpy(stream + cur, iov[i * PSYC_FRAGMENT_IOV + j].iov_base,
+		   iov[i * PSYC_FRAGMENT_IOV + j].iov_len);
+	    cur += iov[i * PSYC_FRAGMENT_IOV + j].iov_len;
+	}
+	fraglen[i] = stream + cur - frag[i];
+	if (verbose)
+	    printf("%.*s", (int)fraglen[i], frag[i]);
+    }
+
+    struct iovec frags[8];
+    PsycReassembly r;
+    psyc_reassembly_init(&r, frags, PSYC_NUM_ELEM(frags), 256, 10);
+
+    // receive in reverse order, with a duplicate
+    for (i = num; i > 0; i--)
+	if (add_fragment(&r, frag[i - 1], fraglen[i - 1], 100)
+	    != (i > 1 ? PSYC_REASSEMBLY_INCOMPLETE : PSYC_REASSEMBLY_COMPLETE))
+	    return 4;
+    if (add_fragment(&r, frag[1], fraglen[1], 100) != PSYC_REASSEMBLY_DUPLICATE)
+	return 5;
+    if (r.length != contentlen)
+	return 6;
+
+    char buffer[256];
+    PsycParseState state;
+    if (psyc_reassembly_parse_init(&r, &state, buffer, contentlen - 1)
+	!= PSYC_REASSEMBLY_ERROR)
+	return 7;
+    if (psyc_reassembly_parse_init(&r, &state, buffer, sizeof(buffer))
+	!= PSYC_REASSEMBLY_COMPLETE || memcmp(buffer, content, contentlen))
+	return 8;
+
+    PsycString name, value;
+    char oper;
+    int ret, body = 0;
+    do {
+	ret = psyc_parse(&state, &oper, &name, &value);
+	if (ret == PSYC_PARSE_BODY)
+	    body = equal(&name, PSYC_C2ARG("_message_private"))
+		&& equal(&value, PSYC_C2ARG(DATA));
+	else if (ret < 0)
+	    return 9;
+    } while (ret != PSYC_PARSE_COMPLETE);
+    if (!body)
+	return 10;
+
+    // content of a single fragment is parsed in place
+    psyc_reassembly_reset(&r);
+    if (psyc_reassembly_add(&r, 0, 1, content, contentlen, 200)
+	!= PSYC_REASSEMBLY_COMPLETE
+	|| psyc_reassembly_parse_init(&r, &state, NULL, 0)
+	!= PSYC_REASSEMBLY_COMPLETE
+	|| state.buffer.data != content)
+	return 11;
+
+    // timeout
+    psyc_reassembly_reset(&r);
+    if (add_fragment(&r, frag[0], fraglen[0], 300) != PSYC_REASSEMBLY_INCOMPLETE
+	|| psyc_reassembly_expired(&r, 309)
+	|| add_fragment(&r, frag[1], fraglen[1], 310)
+	!= PSYC_REASSEMBLY_ERROR_TIMEOUT
+	|| !psyc_reassembly_expired(&r, 310))
+	return 12;
+
+    // memory limit and invalid fragments
+    psyc_reassembly_init(&r, frags, PSYC_NUM_ELEM(frags), 20, 0);
+    if (add_fragment(&r, frag[0], fraglen[0], 0) != PSYC_REASSEMBLY_INCOMPLETE
+	|| add_fragment(&r, frag[1], fraglen[1], 0)
+	!= PSYC_REASSEMBLY_ERROR_MEMORY
+	|| psyc_reassembly_add(&r, 1, num + 1, content, 1, 0)
+	!= PSYC_REASSEMBLY_ERROR_FRAGMENT
+	|| psyc_reassembly_add(&r, num, num, content, 1, 0)
+	!= PSYC_REASSEMBLY_ERROR_FRAGMENT
+	|| psyc_reassembly_add(&r, 0, 9, content, 1, 0)
+	!= PSYC_REASSEMBLY_ERROR_FRAGMENT)
+	return 13;
+
+    puts("psyc_fragment passed all tests.");
+    return 0;
+}
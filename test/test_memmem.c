@@ -0,0 +1,77 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lib.h>
+
+uint8_t verbose;
+
+static const char *
+naive (const char *l, size_t l_len, const char *s, size_t s_len)
+{
+    size_t i;
+
+    if (!l_len || !s_len || l_len < s_len)
+	return NULL;
+
+    for (i = 0; i + s_len <= l_len; i++)
+	if (memcmp(l + i, s, s_len) == 0)
+	    return l + i;
+
+    return NULL;
+}
+
+int
+test_search (const char *l, size_t l_len, const char *s, size_t s_len)
+{
+    const char *exp = naive(l, l_len, s, s_len);
+    const char *ret = psyc_memmem(l, l_len, s, s_len);
+
+    if (ret != exp) {
+	if (verbose)
+	    printf("%.*s in %.*s: %ld != %ld\n", (int)s_len, s, (int)l_len, l,
+		   ret ? (long)(ret - l) : -1L, exp ? (long)(exp - l) : -1L);
+	return 1;
+    }
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    verbose = argc > 1;
+    char l[512], s[96];
+    size_t i, j, l_len, s_len, pos;
+
+    if (test_search(PSYC_C2ARG("Hello [_foo]"), PSYC_C2ARG("["))
+	|| test_search(PSYC_C2ARG("x\n|\n"), PSYC_C2ARG("\n|\n"))
+	|| test_search(PSYC_C2ARG("|\n"), PSYC_C2ARG("\n|\n"))
+	|| test_search(PSYC_C2ARG("abc"), "", 0)
+	|| test_search("", 0, PSYC_C2ARG("a")))
+	return 1;
+
+    srand(1);
+    for (i = 0; i < 20000; i++) {
+	// small alphabets give many partial and periodic matches
+	int alpha = 2 + rand() % 3;
+	l_len = rand() % sizeof(l);
+	s_len = 1 + rand() % sizeof(s);
+
+	for (j = 0; j < l_len; j++)
+	    l[j] = 'a' + rand() % alpha;
+	for (j = 0; j < s_len; j++)
+	    s[j] = 'a' + rand() % alpha;
+
+	// plant the needle sometimes
+	if (l_len >= s_len && rand() % 2) {
+	    pos = rand() % (l_len - s_len + 1);
+	    memcpy(l + pos, s, s_len);
+	}
+
+	if (test_search(l, l_len, s, s_len))
+	    return 2;
+    }
+
+    puts("psyc_memmem passed all tests.");
+    return 0;
+}
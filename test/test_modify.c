@@ -0,0 +1,148 @@
+#include <stdio.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+uint8_t verbose;
+
+PsycModifier routing[8], entity[8];
+PsycString routing_raw[8], entity_raw[8];
+PsycModPacket mp;
+
+/**
+ * Render the modified packet and compare it with psyc_render().
+ */
+int
+test_render (const char *expected)
+{
+    char buffer[1024], ref[1024];
+
+    if (psyc_modpacket_render(&mp, buffer, sizeof(buffer))
+	!= PSYC_RENDER_SUCCESS)
+	return 1;
+    if (verbose)
+	printf("%.*s\n", (int)mp.packet.length, buffer);
+
+    if (psyc_render(&mp.packet, ref, sizeof(ref)) != PSYC_RENDER_SUCCESS)
+	return 2;
+    if (memcmp(buffer, ref, mp.packet.length))
+	return 3;
+
+    if (expected && (mp.packet.length != strlen(expected)
+		     || memcmp(buffer, expected, mp.packet.length)))
+	return 4;
+
+    if (psyc_modpacket_render(&mp, buffer, mp.packet.length - 1)
+	!= PSYC_RENDER_ERROR)
+	return 5;
+
+    return 0;
+}
+
+int
+test_packet (const char *packet)
+{
+    char buffer[1024];
+    size_t len = strlen(packet);
+    PsycModifier *m;
+    int ret;
+
+    memcpy(buffer, packet, len);
+    if (psyc_modpacket_parse(&mp, buffer, len, 0) != PSYC_PARSE_COMPLETE)
+	return 1;
+
+    // unchanged
+    if ((ret = test_render(packet)))
+	return 10 + ret;
+
+    // routing variable changed
+    if (!(m = psyc_modpacket_find(&mp, PSYC_C2ARG("_target"))))
+	return 2;
+    psyc_modpacket_set(&mp, m, PSYC_C2ARG("psyc://example.net/~bob"));
+    if ((ret = test_render(NULL)))
+	return 20 + ret;
+
+    // entity variable needs a length now
+    if (!(m = psyc_modpacket_find(&mp, PSYC_C2ARG("_foo"))))
+	return 3;
+    psyc_modpacket_set(&mp, m, PSYC_C2ARG("bar\nbaz"));
+    if ((ret = test_render(NULL)))
+	return 30 + ret;
+
+    // operator changed
+    m->oper = PSYC_OPERATOR_ASSIGN;
+    if ((ret = test_render(NULL)))
+	return 40 + ret;
+
+    // added & removed
+    if (!psyc_modpacket_add(&mp, PSYC_OPERATOR_SET, PSYC_C2ARG("_nick"),
+			    PSYC_C2ARG("bob"), PSYC_MODIFIER_CHECK_LENGTH))
+	return 4;
+    if (!psyc_modpacket_add(&mp, PSYC_OPERATOR_SET, PSYC_C2ARG("_tag"),
+			    PSYC_C2ARG("x"), PSYC_MODIFIER_ROUTING))
+	return 5;
+    psyc_modpacket_remove(&mp, psyc_modpacket_find(&mp, PSYC_C2ARG("_source")));
+    psyc_modpacket_remove(&mp, psyc_modpacket_find(&mp, PSYC_C2ARG("_foo")));
+    if ((ret = test_render(NULL)))
+	return 50 + ret;
+
+    // routing only, content is copied as is
+    memcpy(buffer, packet, len);
+    if (psyc_modpacket_parse(&mp, buffer, len, PSYC_PARSE_ROUTING_ONLY)
+	!= PSYC_PARSE_COMPLETE)
+	return 6;
+    if (mp.packet.entity.lines || !mp.packet.content.length)
+	return 7;
+    if ((ret = test_render(packet)))
+	return 60 + ret;
+
+    m = psyc_modpacket_find(&mp, PSYC_C2ARG("_target"));
+    psyc_modpacket_set(&mp, m, PSYC_C2ARG("psyc://example.net/~bob"));
+    if ((ret = test_render(NULL)))
+	return 70 + ret;
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    verbose = argc > 1;
+    int ret;
+
+    psyc_modpacket_init(&mp, routing, routing_raw, 8, entity, entity_raw, 8);
+
+    if ((ret = test_packet(":_source\tpsyc://foo/~bar\n"
+			   ":_target\tpsyc://bar/~baz\n"
+			   ":_tag\tsch1828hu3r2cm\n"
+			   "86\n"
+			   ":_foo\tbar baz\n"
+			   ":_abc_def 11\tfoo bar\nbaz\n"
+			   ":_foo_bar\tyay\n"
+			   "_message_foo_bar\n"
+			   "ohai there!\n\\o/\n"
+			   "|\n")))
+	return ret;
+
+    if ((ret = test_packet(":_source\tpsyc://foo/~bar\n"
+			   ":_target\tpsyc://bar/~baz\n"
+			   "83\n"
+			   "=\n"
+			   ":_foo\tbar baz\n"
+			   ":_abc_def 11\tfoo bar\nbaz\n"
+			   ":_empty\t\n"
+			   "_message_foo_bar\n"
+			   "ohai there!\n\\o/\n"
+			   "|\n")))
+	return 100 + ret;
+
+    // too many modifiers
+    char buffer[] = ":_a\t1\n:_b\t2\n:_c\t3\n:_d\t4\n:_e\t5\n"
+	":_f\t6\n:_g\t7\n:_h\t8\n:_i\t9\n\n_notice\n|\n";
+    if (psyc_modpacket_parse(&mp, buffer, sizeof(buffer) - 1, 0)
+	!= PSYC_PARSE_ERROR)
+	return 200;
+
+    puts("psyc_modpacket passed all tests.");
+    return 0;
+}
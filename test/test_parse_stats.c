@@ -0,0 +1,168 @@
+#define PSYC_PARSE_STATS
+#define __INLINE_PSYC_PARSE
+#include "../src/parse.c"
+
+#include <unistd.h>
+#include <stdio.h>
+
+uint8_t verbose;
+
+/**
+ * Parse a packet given in buffers of at most buflen bytes, the way an
+ * application reading from a socket would.
+ */
+int
+parse (PsycParseState *state, const char *pkt, size_t pktlen, size_t buflen)
+{
+    char buf[256];
+    size_t pos = 0, len = 0, rest;
+    PsycString name, value;
+    char oper;
+    int ret;
+
+    do {
+	// keep the unparsed rest of the previous buffer
+	rest = len ? psyc_parse_remaining_length(state) : 0;
+	memmove(buf, buf + len - rest, rest);
+	len = pktlen - pos < buflen ? pktlen - pos : buflen;
+	memcpy(buf + rest, pkt + pos, len);
+	pos += len;
+	len += rest;
+	psyc_parse_buffer_set(state, buf, len);
+
+	do {
+	    ret = psyc_parse(state, &oper, &name, &value);
+	    if (verbose)
+		printf("%d ", ret);
+	} while (ret > 0 && ret != PSYC_PARSE_INSUFFICIENT
+		 && ret != PSYC_PARSE_COMPLETE);
+    } while (ret == PSYC_PARSE_INSUFFICIENT && pos < pktlen);
+
+    if (verbose)
+	printf("\n");
+    return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+    PsycParseState state;
+    PsycParseStats st, global;
+    size_t i, total;
+    verbose = argc > 1;
+
+    const char pkt[] =
+	":_source\tpsyc://example.com/~juliet\n"
+	":_target\txmpp:romeo@example.net\n"
+	"\n"
+	":_nick\tjuliet\n"
+	":_file 5\tab\ncd\n"
+	"_message\n"
+	"Art thou not Romeo, and a Montague?\n"
+	"|\n";
+
+    psyc_parse_stats_global_reset();
+
+    // in one go
+    psyc_parse_state_init(&state, 0);
+    if (parse(&state, PSYC_C2ARG(pkt), sizeof(pkt)) != PSYC_PARSE_COMPLETE)
+	return 1;
+
+    psyc_parse_stats(&state, &st);
+    for (i = total = 0; i <= PSYC_PART_END; i++)
+	total += st.bytes[i];
+
+    if (verbose)
+	printf("bytes: %zu %zu %zu %zu %zu %zu, simple %zu, binary %zu\n",
+	       st.bytes[0], st.bytes[1], st.bytes[2], st.bytes[3], st.bytes[4],
+	       st.bytes[5], st.simple, st.binary);
+
+    if (total != sizeof(pkt) - 1 || st.rewinds || st.rescanned)
+	return 2;
+    // without a length the newline after the routing header is the length part
+    if (st.bytes[PSYC_PART_ROUTING] != 68 || st.bytes[PSYC_PART_LENGTH] != 1
+	|| st.bytes[PSYC_PART_CONTENT] != 29 || st.bytes[PSYC_PART_METHOD] != 9
+	|| st.bytes[PSYC_PART_DATA] != 36 || st.bytes[PSYC_PART_END] != 2
+	|| st.simple != 4 || st.binary != 1)
+	return 3;
+
+    // in buffers of 10 bytes
+    psyc_parse_state_init(&state, 0);
+    if (parse(&state, PSYC_C2ARG(pkt), 10) != PSYC_PARSE_COMPLETE)
+	return 4;
+
+    psyc_parse_stats(&state, &st);
+    for (i = total = 0; i <= PSYC_PART_END; i++)
+	total += st.bytes[i];
+
+    if (verbose)
+	printf("bytes: %zu, rewinds: %zu, rescanned: %zu\n",
+	       total, st.rewinds, st.rescanned);
+
+    if (!st.rewinds || total != sizeof(pkt) - 1 + st.rescanned
+	|| st.simple != 4 || st.binary != 1)
+	return 5;
+
+    // with a length, in full and routing only
+    const char lpkt[] =
+	":_target\tpsyc://example.net/~romeo\n"
+	"13\n"
+	"_message\n"
+	"hi!\n"
+	"|\n";
+
+    psyc_parse_state_init(&state, 0);
+    if (parse(&state, PSYC_C2ARG(lpkt), sizeof(lpkt)) != PSYC_PARSE_COMPLETE)
+	return 10;
+
+    psyc_parse_stats(&state, &st);
+    if (verbose)
+	printf("bytes: %zu %zu %zu %zu %zu %zu\n",
+	       st.bytes[0], st.bytes[1], st.bytes[2], st.bytes[3], st.bytes[4],
+	       st.bytes[5]);
+
+    if (st.bytes[PSYC_PART_ROUTING] != 35 || st.bytes[PSYC_PART_LENGTH] != 3
+	|| st.bytes[PSYC_PART_CONTENT] || st.bytes[PSYC_PART_METHOD] != 9
+	|| st.bytes[PSYC_PART_DATA] != 3 || st.bytes[PSYC_PART_END] != 3)
+	return 11;
+
+    psyc_parse_state_init(&state, PSYC_PARSE_ROUTING_ONLY);
+    if (parse(&state, PSYC_C2ARG(lpkt), sizeof(lpkt)) != PSYC_PARSE_COMPLETE)
+	return 12;
+
+    psyc_parse_stats(&state, &st);
+    if (verbose)
+	printf("bytes: %zu %zu %zu %zu %zu %zu\n",
+	       st.bytes[0], st.bytes[1], st.bytes[2], st.bytes[3], st.bytes[4],
+	       st.bytes[5]);
+
+    if (st.bytes[PSYC_PART_ROUTING] != 35 || st.bytes[PSYC_PART_LENGTH] != 3
+	|| st.bytes[PSYC_PART_CONTENT] || st.bytes[PSYC_PART_METHOD]
+	|| st.bytes[PSYC_PART_DATA] != 13 || st.bytes[PSYC_PART_END] != 2)
+	return 13;
+
+    // error
+    psyc_parse_state_init(&state, 0);
+    if (parse(&state, PSYC_C2ARG(":_nick juliet\n\n|\n"), 256)
+	!= PSYC_PARSE_ERROR_MOD_TAB)
+	return 6;
+
+    psyc_parse_stats(&state, &st);
+    if (st.errors[-PSYC_PARSE_ERROR_MOD_TAB] != 1)
+	return 7;
+
+    // the global counters include all of the above
+    psyc_parse_stats_global(&global);
+    if (global.simple != 4 + 4 + 1 + 1 || global.binary != 2 + 1 + 1
+	|| !global.rewinds
+	|| global.errors[-PSYC_PARSE_ERROR_MOD_TAB] != 1)
+	return 8;
+
+    psyc_parse_stats_global_reset();
+    psyc_parse_stats_global(&global);
+    if (global.simple || global.errors[-PSYC_PARSE_ERROR_MOD_TAB])
+	return 9;
+
+    printf("psyc_parse_stats passed all tests.\n");
+    return 0;
+}
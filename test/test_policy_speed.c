@@ -0,0 +1,188 @@
+/**
+ * Compare render policies: bytes on the wire vs. parse time.
+ *
+ * The packet in the input file is re-rendered with each policy, then the
+ * result is parsed <count> times, fully and routing-only.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <sys/time.h>
+
+#include <psyc.h>
+
+// max size for routing & entity header
+#define ROUTING_LINES 16
+#define ENTITY_LINES 32
+
+// cmd line args
+char *filename;
+uint8_t verbose;
+size_t count = 100000;
+
+PsycModifier routing[ROUTING_LINES];
+PsycModifier entity[ENTITY_LINES];
+
+/**
+ * Parse the packet in the buffer, keep its parts if packet is not NULL.
+ *
+ * @return 0 on success.
+ */
+int
+parse (char *buffer, size_t buflen, PsycParseFlag flags, PsycPacket *packet)
+{
+    PsycParseState state;
+    PsycString name, value;
+    char oper;
+    int ret;
+
+    psyc_parse_state_init(&state, flags);
+    psyc_parse_buffer_set(&state, buffer, buflen);
+
+    for (;;) {
+	ret = psyc_parse(&state, &oper, &name, &value);
+	if (!packet) {
+	    if (ret == PSYC_PARSE_COMPLETE)
+		return 0;
+	    if (ret < 0 || ret == PSYC_PARSE_INSUFFICIENT)
+		return ret ? ret : -1;
+	    continue;
+	}
+
+	switch (ret) {
+	case PSYC_PARSE_ROUTING:
+	    if (packet->routing.lines >= ROUTING_LINES)
+		return -1;
+	    packet->routing.modifiers[packet->routing.lines++] =
+		PSYC_MODIFIER(oper, name, value, PSYC_MODIFIER_ROUTING);
+	    break;
+	case PSYC_PARSE_STATE_RESYNC:
+	case PSYC_PARSE_STATE_RESET:
+	    packet->stateop = oper;
+	    break;
+	case PSYC_PARSE_ENTITY:
+	    if (packet->entity.lines >= ENTITY_LINES)
+		return -1;
+	    // let the policy decide
+	    packet->entity.modifiers[packet->entity.lines++] =
+		PSYC_MODIFIER(oper, name, value, PSYC_MODIFIER_CHECK_LENGTH);
+	    break;
+	case PSYC_PARSE_BODY:
+	    packet->method = name;
+	    packet->data = value;
+	    break;
+	case PSYC_PARSE_COMPLETE:
+	    return 0;
+	default:
+	    // values split into parts only happen with incomplete buffers
+	    return ret ? ret : -1;
+	}
+    }
+}
+
+long
+parse_time (PsycString *rendered, PsycParseFlag flags)
+{
+    struct timeval start, end;
+    size_t i;
+
+    gettimeofday(&start, NULL);
+    for (i = 0; i < count; i++)
+	if (parse(rendered->data, rendered->length, flags, NULL))
+	    return -1;
+    gettimeofday(&end, NULL);
+
+    return (end.tv_sec - start.tv_sec) * 1000000 + end.tv_usec - start.tv_usec;
+}
+
+int
+main (int argc, char **argv)
+{
+    int c;
+    while ((c = getopt (argc, argv, "f:c:vh")) != -1) {
+	switch (c) {
+	case 'f': filename = optarg; break;
+	case 'c': count = atoi(optarg); break;
+	case 'v': verbose++; break;
+	case 'h':
+	    printf("test_policy_speed -f <filename> [-c <count>] [-v]\n"
+		   "  -f <filename>\tInput file name\n"
+		   "  -c <count>\t\tParse each rendered packet <count> times, "
+		   "default is %lu\n"
+		   "  -v\t\t\tShow rendered packets\n"
+		   "  -h\t\t\tShow this help\n", (unsigned long)count);
+	    exit(0);
+	case '?': exit(-1);
+	default:  abort();
+	}
+    }
+
+    if (!filename || !count) {
+	fprintf(stderr, "test_policy_speed: no input file, see -h\n");
+	return -1;
+    }
+
+    // Receiver-cost policies only add lengths because of skip_size.
+#define RECEIVER_COST(skip)						\
+    PSYC_RENDER_POLICY(PSYC_MODIFIER_SIZE_MAX, PSYC_ELEM_SIZE_MAX,	\
+		       PSYC_CONTENT_SIZE_MAX, skip, PSYC_POLICY_RECEIVER_COST)
+
+    struct {
+	const char *name;
+	PsycRenderPolicy policy;
+    } policies[] = {
+	{"default", PSYC_RENDER_POLICY_DEFAULT},
+	{"compact", PSYC_RENDER_POLICY(PSYC_MODIFIER_SIZE_MAX,
+				       PSYC_ELEM_SIZE_MAX,
+				       PSYC_CONTENT_SIZE_MAX, 0,
+				       PSYC_POLICY_COMPACT)},
+	{"recv-64", RECEIVER_COST(64)},
+	{"recv-16", RECEIVER_COST(16)},
+	{"recv-0", RECEIVER_COST(0)},
+    };
+
+    FILE *f = fopen(filename, "r");
+    if (!f) {
+	perror(filename);
+	return -1;
+    }
+    char *input = malloc(1024 * 1024);
+    size_t inputlen = fread(input, 1, 1024 * 1024, f);
+    fclose(f);
+
+    PsycPacket packet = PSYC_PACKET(routing, 0, entity, 0, NULL, 0, NULL, 0,
+				    PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+    if (parse(input, inputlen, PSYC_PARSE_ALL, &packet)) {
+	fprintf(stderr, "%s: parse error\n", filename);
+	return -1;
+    }
+
+    PsycBuffer buf;
+    PsycString out;
+    size_t i;
+    psyc_buffer_init(&buf);
+
+    printf("%-8s %8s %12s %12s\n", "policy", "bytes", "parse us", "routing us");
+    for (i = 0; i < PSYC_NUM_ELEM(policies); i++) {
+	buf.length = 0;
+	packet.flag = PSYC_PACKET_CHECK_LENGTH;
+	if (psyc_render_append_policy(&packet, &buf, &out, &policies[i].policy)
+	    != PSYC_RENDER_SUCCESS) {
+	    fprintf(stderr, "%s: render error\n", policies[i].name);
+	    return -1;
+	}
+	if (verbose)
+	    printf("%.*s", (int)out.length, out.data);
+
+	printf("%-8s %8lu %12ld %12ld\n", policies[i].name,
+	       (unsigned long)out.length,
+	       parse_time(&out, PSYC_PARSE_ALL),
+	       parse_time(&out, PSYC_PARSE_ROUTING_ONLY));
+    }
+
+    psyc_buffer_free(&buf);
+    free(input);
+    return 0;
+}
@@ -96,6 +96,722 @@ test_list (const char *rendered, uint8_t verbose)
     return strncmp(rendered, buffer, packet.length);
 }
 
+/* same content for several recipients, compared with rendering each packet */
+int
+test_fanout (uint8_t verbose)
+{
+    PsycModifier routing[1], targets[2][2], full[3];
+    psyc_modifier_init(&routing[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_context"),
+		       PSYC_C2ARG(myUNI), PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&targets[0][0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_target"),
+		       PSYC_C2ARG("psyc://example.net/~alice"),
+		       PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&targets[0][1], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_counter"),
+		       PSYC_C2ARG("42"), PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&targets[1][0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_target"),
+		       PSYC_C2ARG("psyc://example.net/~bob"),
+		       PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&targets[1][1], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_counter"),
+		       PSYC_C2ARG("1337"), PSYC_MODIFIER_ROUTING);
+
+    PsycHeader recipients[2] = {{2, targets[0]}, {2, targets[1]}};
+
+    PsycModifier entity[1];
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_nick"),
+		       PSYC_C2ARG("ludwig"), PSYC_MODIFIER_CHECK_LENGTH);
+
+    PsycPacket packet;
+    psyc_packet_init(&packet, routing, PSYC_NUM_ELEM(routing),
+		     entity, PSYC_NUM_ELEM(entity),
+		     PSYC_C2ARG("_message_public"),
+		     PSYC_C2ARG("hello everyone"),
+		     PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+
+    char content[128], headers[256], buffer[512], result[512];
+    struct iovec iov[2 * PSYC_FANOUT_IOV];
+    if (PSYC_RENDER_SUCCESS !=
+	psyc_render_fanout(&packet, recipients, 2, content, sizeof(content),
+			   headers, sizeof(headers), iov, PSYC_NUM_ELEM(iov)))
+	return -1;
+
+    size_t i, j, len;
+    for (i = 0; i < 2; i++) {
+	for (j = 0, len = 0; j < PSYC_FANOUT_IOV; j++) {
+	    memcpy(result + len, iov[i * PSYC_FANOUT_IOV + j].iov_base,
+		   iov[i * PSYC_FANOUT_IOV + j].iov_len);
+	    len += iov[i * PSYC_FANOUT_IOV + j].iov_len;
+	}
+	if (verbose)
+	    printf("%.*s\n", (int)len, result);
+
+	full[0] = routing[0];
+	full[1] = targets[i][0];
+	full[2] = targets[i][1];
+	PsycPacket p;
+	psyc_packet_init(&p, full, PSYC_NUM_ELEM(full),
+			 entity, PSYC_NUM_ELEM(entity),
+			 PSYC_C2ARG("_message_public"),
+			 PSYC_C2ARG("hello everyone"),
+			 PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+	psyc_render(&p, buffer, sizeof(buffer));
+
+	if (len != p.length || memcmp(result, buffer, len))
+	    return 1;
+    }
+
+    return 0;
+}
+
+static size_t
+gather (struct iovec *iov, size_t iovcnt, char *buffer)
+{
+    size_t i, len = 0;
+    for (i = 0; i < iovcnt; i++) {
+	memcpy(buffer + len, iov[i].iov_base, iov[i].iov_len);
+	len += iov[i].iov_len;
+    }
+    return len;
+}
+
+int
+test_iov (uint8_t verbose)
+{
+    char data[2000];
+    memset(data, 'x', sizeof(data));
+
+    PsycModifier routing[1];
+    psyc_modifier_init(&routing[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_context"),
+		       PSYC_C2ARG(myUNI), PSYC_MODIFIER_ROUTING);
+
+    PsycElem elems[3] = {
+	PSYC_ELEM_VF("foo", 3, PSYC_ELEM_CHECK_LENGTH),
+	PSYC_ELEM_VF(data, 1000, PSYC_ELEM_CHECK_LENGTH),
+	PSYC_ELEM_TV("_binary", 7, "b|r", 3),
+    };
+    PsycDictElem delems[2] = {
+	{PSYC_ELEM_VF("x|y", 3, PSYC_ELEM_CHECK_LENGTH),
+	 PSYC_DICT_KEY("key", 3, PSYC_ELEM_CHECK_LENGTH)},
+	{PSYC_ELEM_VF(data, 600, PSYC_ELEM_CHECK_LENGTH),
+	 PSYC_DICT_KEY(data, 512, PSYC_ELEM_CHECK_LENGTH)},
+    };
+    PsycList list;
+    PsycDict dict;
+    psyc_list_init(&list, elems, PSYC_NUM_ELEM(elems));
+    psyc_dict_init(&dict, delems, PSYC_NUM_ELEM(delems));
+
+    PsycModifier entity[2];
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_nick"),
+		       PSYC_C2ARG("ludwig"), PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&entity[1], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_text"),
+		       data, 700, PSYC_MODIFIER_CHECK_LENGTH);
+
+    PsycPacket packet;
+    psyc_packet_init(&packet, routing, PSYC_NUM_ELEM(routing),
+		     entity, PSYC_NUM_ELEM(entity),
+		     PSYC_C2ARG("_message_public"), data, sizeof(data),
+		     PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+
+    char scratch[256], buffer[4096], result[4096];
+    struct iovec iov[16];
+    PsycRenderIov r;
+    size_t len;
+
+    psyc_render_iov_init(&r, iov, PSYC_NUM_ELEM(iov), scratch, sizeof(scratch),
+			 PSYC_RENDER_IOV_THRESHOLD);
+    if (psyc_render_iov(&packet, &r) != PSYC_RENDER_SUCCESS)
+	return 1;
+
+    // large values are referenced, the rest is merged into scratch entries
+    if (r.iovcnt != 5 || iov[1].iov_base != data || iov[3].iov_base != data)
+	return 2;
+
+    len = gather(iov, r.iovcnt, result);
+    psyc_render(&packet, buffer, sizeof(buffer));
+    if (verbose)
+	printf("%.*s\n", (int)len, result);
+    if (len != packet.length || memcmp(result, buffer, len))
+	return 3;
+
+    // everything is copied with a high threshold, but scratch is too small
+    psyc_render_iov_init(&r, iov, PSYC_NUM_ELEM(iov), scratch, sizeof(scratch),
+			 SIZE_MAX);
+    if (psyc_render_iov(&packet, &r) != PSYC_RENDER_ERROR)
+	return 4;
+
+    // iov is too small
+    psyc_render_iov_init(&r, iov, 4, scratch, sizeof(scratch),
+			 PSYC_RENDER_IOV_THRESHOLD);
+    if (psyc_render_iov(&packet, &r) != PSYC_RENDER_ERROR)
+	return 5;
+
+    psyc_render_iov_init(&r, iov, PSYC_NUM_ELEM(iov), scratch, sizeof(scratch),
+			 PSYC_RENDER_IOV_THRESHOLD);
+    if (psyc_render_list_iov(&list, &r) != PSYC_RENDER_SUCCESS
+	|| r.iovcnt != 3 || iov[1].iov_base != data)
+	return 6;
+    len = gather(iov, r.iovcnt, result);
+    psyc_render_list(&list, buffer, sizeof(buffer));
+    if (len != list.length || memcmp(result, buffer, len))
+	return 7;
+
+    psyc_render_iov_init(&r, iov, PSYC_NUM_ELEM(iov), scratch, sizeof(scratch),
+			 PSYC_RENDER_IOV_THRESHOLD);
+    if (psyc_render_dict_iov(&dict, &r) != PSYC_RENDER_SUCCESS
+	|| r.iovcnt != 4)
+	return 8;
+    len = gather(iov, r.iovcnt, result);
+    psyc_render_dict(&dict, buffer, sizeof(buffer));
+    if (len != dict.length || memcmp(result, buffer, len))
+	return 9;
+
+    return 0;
+}
+
+int
+test_stream (uint8_t verbose)
+{
+    char data[2000];
+    memset(data, 'x', sizeof(data));
+
+    PsycModifier routing[1], entity[2];
+    psyc_modifier_init(&routing[0], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_context"),
+		       PSYC_C2ARG(myUNI), PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_ASSIGN,
+		       PSYC_C2ARG("_nick"),
+		       PSYC_C2ARG("ludwig"), PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&entity[1], PSYC_OPERATOR_SET,
+		       PSYC_C2ARG("_text"),
+		       data, 700, PSYC_MODIFIER_CHECK_LENGTH);
+
+    PsycPacket packet;
+    psyc_packet_init(&packet, routing, PSYC_NUM_ELEM(routing),
+		     entity, PSYC_NUM_ELEM(entity),
+		     PSYC_C2ARG("_message_public"), data, sizeof(data),
+		     PSYC_STATE_RESET, PSYC_PACKET_CHECK_LENGTH);
+
+    char buffer[4096], result[4096], chunk[100];
+    size_t sizes[] = {1, 7, 64, 100}, i, len;
+    PsycRenderState state;
+    PsycRenderRC ret;
+
+    psyc_render(&packet, buffer, sizeof(buffer));
+
+    for (i = 0; i < PSYC_NUM_ELEM(sizes); i++) {
+	psyc_render_state_init(&state, &packet);
+	len = 0;
+	do {
+	    psyc_render_buffer_set(&state, chunk, sizes[i]);
+	    ret = psyc_render_stream(&state);
+	    if (ret < 0 || len + psyc_render_bytes_written(&state) > packet.length)
+		return 1;
+	    memcpy(result + len, chunk, psyc_render_bytes_written(&state));
+	    len += psyc_render_bytes_written(&state);
+	} while (ret == PSYC_RENDER_INCOMPLETE);
+
+	if (verbose)
+	    printf("%zu: %zu\n", sizes[i], len);
+	if (len != packet.length || memcmp(result, buffer, len))
+	    return 2;
+    }
+
+    // the whole packet fits
+    psyc_render_state_init(&state, &packet);
+    psyc_render_buffer_set(&state, result, sizeof(result));
+    if (psyc_render_stream(&state) != PSYC_RENDER_SUCCESS
+	|| psyc_render_bytes_written(&state) != packet.length)
+	return 3;
+
+    // data without method
+    packet.method.length = 0;
+    psyc_render_state_init(&state, &packet);
+    psyc_render_buffer_set(&state, result, sizeof(result));
+    if (psyc_render_stream(&state) != PSYC_RENDER_ERROR_METHOD_MISSING)
+	return 4;
+    packet.method.length = 15;
+
+    // an empty buffer is an error, not a full one
+    psyc_render_state_init(&state, &packet);
+    psyc_render_buffer_set(&state, chunk, 0);
+    if (psyc_render_stream(&state) != PSYC_RENDER_ERROR)
+	return 5;
+
+    // errors after the first buffers end the loop
+    entity[1].name.length = 0;
+    psyc_render_state_init(&state, &packet);
+    do {
+	psyc_render_buffer_set(&state, chunk, 10);
+	ret = psyc_render_stream(&state);
+    } while (ret == PSYC_RENDER_INCOMPLETE);
+    if (ret != PSYC_RENDER_ERROR_MODIFIER_NAME_MISSING || !state.offset)
+	return 6;
+    entity[1].name.length = 5;
+
+    // raw content without routing header
+    psyc_packet_init_raw(&packet, NULL, 0, data, 300, PSYC_PACKET_CHECK_LENGTH);
+    psyc_render(&packet, buffer, sizeof(buffer));
+    psyc_render_state_init(&state, &packet);
+    len = 0;
+    do {
+	psyc_render_buffer_set(&state, chunk, 7);
+	ret = psyc_render_stream(&state);
+	memcpy(result + len, chunk, psyc_render_bytes_written(&state));
+	len += psyc_render_bytes_written(&state);
+    } while (ret == PSYC_RENDER_INCOMPLETE);
+    if (ret != PSYC_RENDER_SUCCESS || len != packet.length
+	|| memcmp(result, buffer, len))
+	return 7;
+
+    return 0;
+}
+
+int
+test_utoa (uint8_t verbose)
+{
+    uint64_t n[] = {0, 9, 10, 99, 100, 999, 1000, 9999, 10000, 12345678,
+		    4294967296ULL, 10000000000000000000ULL, UINT64_MAX};
+    char buf[24], expected[24];
+    size_t i, len;
+
+    for (i = 0; i < PSYC_NUM_ELEM(n); i++) {
+	len = utoa(n[i], buf);
+	snprintf(expected, sizeof(expected), "%llu", (unsigned long long)n[i]);
+	if (verbose)
+	    printf("%.*s\n", (int)len, buf);
+	if (len != strlen(expected) || len != psyc_num_length(n[i])
+	    || memcmp(buf, expected, len))
+	    return 1;
+    }
+
+    return 0;
+}
+
+int
+test_append (uint8_t verbose)
+{
+    char data[2000], buffer[4096];
+    memset(data, 'x', sizeof(data));
+
+    PsycModifier routing[2] = {
+	{PSYC_STRING("_context", 8), PSYC_STRING(myUNI, sizeof(myUNI) - 1),
+	 PSYC_MODIFIER_ROUTING, PSYC_OPERATOR_SET},
+	{PSYC_STRING("_counter", 8), PSYC_STRING("42", 2),
+	 PSYC_MODIFIER_ROUTING, PSYC_OPERATOR_SET},
+    };
+    PsycModifier entity[3] = {
+	{PSYC_STRING("_nick", 5), PSYC_STRING("ludwig", 6),
+	 PSYC_MODIFIER_CHECK_LENGTH, PSYC_OPERATOR_ASSIGN},
+	{PSYC_STRING("_nl", 3), PSYC_STRING("a\nb", 3),
+	 PSYC_MODIFIER_CHECK_LENGTH, PSYC_OPERATOR_SET},
+	{PSYC_STRING("_text", 5), PSYC_STRING(data, 700),
+	 PSYC_MODIFIER_CHECK_LENGTH, PSYC_OPERATOR_SET},
+    };
+
+    struct {
+	size_t routing, entity, datalen;
+	char *method, stateop;
+    } tests[] = {
+	{2, 3, sizeof(data), "_message_public", PSYC_STATE_RESET},
+	{1, 1, 5, "_message_public", PSYC_STATE_NOOP},
+	{1, 0, 1, "_message_public", PSYC_STATE_NOOP}, // data is "x"
+	{2, 0, 0, "_request_foo", PSYC_STATE_NOOP},
+	{1, 0, 0, NULL, PSYC_STATE_RESYNC},
+	{0, 0, 0, NULL, PSYC_STATE_NOOP},
+    };
+
+    // the same with the length flags resolved for psyc_render()
+    PsycModifier checked[3];
+    size_t i, method;
+    for (i = 0; i < 3; i++)
+	psyc_modifier_init(&checked[i], entity[i].oper,
+			   PSYC_S2ARG(entity[i].name),
+			   PSYC_S2ARG(entity[i].value),
+			   PSYC_MODIFIER_CHECK_LENGTH);
+
+    PsycBuffer buf;
+    PsycString out;
+    PsycPacket p, ref;
+    psyc_buffer_init(&buf);
+
+    for (i = 0; i < PSYC_NUM_ELEM(tests); i++) {
+	method = tests[i].method ? strlen(tests[i].method) : 0;
+	p = PSYC_PACKET(routing, tests[i].routing, entity, tests[i].entity,
+			tests[i].method, method, data, tests[i].datalen,
+			tests[i].stateop, PSYC_PACKET_CHECK_LENGTH);
+
+	if (psyc_render_append(&p, &buf, &out) != PSYC_RENDER_SUCCESS)
+	    return 1;
+
+	psyc_packet_init(&ref, routing, tests[i].routing,
+			 checked, tests[i].entity,
+			 tests[i].method, method, data, tests[i].datalen,
+			 tests[i].stateop, PSYC_PACKET_CHECK_LENGTH);
+	psyc_render(&ref, buffer, sizeof(buffer));
+
+	if (verbose)
+	    printf("%.*s\n", (int)out.length, out.data);
+	if (out.length != ref.length || memcmp(out.data, buffer, ref.length)
+	    || p.length != ref.length || p.contentlen != ref.contentlen
+	    || p.routinglen != ref.routinglen || p.flag != ref.flag)
+	    return 2;
+    }
+
+    // raw content
+    psyc_packet_init_raw(&ref, routing, 2, data, 40, PSYC_PACKET_NEED_LENGTH);
+    p = ref;
+    if (psyc_render_append(&p, &buf, &out) != PSYC_RENDER_SUCCESS)
+	return 3;
+    psyc_render(&ref, buffer, sizeof(buffer));
+    if (out.length != ref.length || memcmp(out.data, buffer, ref.length))
+	return 4;
+
+    // errors leave the buffer as it was
+    i = buf.length;
+    p = PSYC_PACKET(routing, 1, entity, 1, NULL, 0, data, 1,
+		    PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+    if (psyc_render_append(&p, &buf, &out) != PSYC_RENDER_ERROR_METHOD_MISSING
+	|| buf.length != i)
+	return 5;
+
+    psyc_buffer_free(&buf);
+    return 0;
+}
+
+int
+test_policy (uint8_t verbose)
+{
+    PsycModifier routing[1] = {
+	{PSYC_STRING("_context", 8), PSYC_STRING(myUNI, sizeof(myUNI) - 1),
+	 PSYC_MODIFIER_ROUTING, PSYC_OPERATOR_SET},
+    };
+    PsycModifier entity[2] = {
+	{PSYC_STRING("_nick", 5), PSYC_STRING("ludwig", 6),
+	 PSYC_MODIFIER_CHECK_LENGTH, PSYC_OPERATOR_ASSIGN},
+	{PSYC_STRING("_text", 5), PSYC_STRING("hello world!", 12),
+	 PSYC_MODIFIER_CHECK_LENGTH, PSYC_OPERATOR_SET},
+    };
+
+    struct {
+	PsycRenderPolicy policy;
+	const char *rendered;
+    } tests[] = {
+	{PSYC_RENDER_POLICY_DEFAULT, "\
+:_context\t" myUNI "\n\
+56\n\
+=_nick\tludwig\n\
+:_text 12\thello world!\n\
+_message_public\n\
+hi\n\
+|\n"},
+	{PSYC_RENDER_POLICY(100, 100, 100, 0, PSYC_POLICY_COMPACT), "\
+:_context\t" myUNI "\n\
+\n\
+=_nick\tludwig\n\
+:_text\thello world!\n\
+_message_public\n\
+hi\n\
+|\n"},
+	{PSYC_RENDER_POLICY(100, 100, 100, 4, PSYC_POLICY_RECEIVER_COST), "\
+:_context\t" myUNI "\n\
+58\n\
+=_nick 6\tludwig\n\
+:_text 12\thello world!\n\
+_message_public\n\
+hi\n\
+|\n"},
+	// content is larger than skip_size, the values are not
+	{PSYC_RENDER_POLICY(100, 100, 100, 40, PSYC_POLICY_RECEIVER_COST), "\
+:_context\t" myUNI "\n\
+53\n\
+=_nick\tludwig\n\
+:_text\thello world!\n\
+_message_public\n\
+hi\n\
+|\n"},
+    };
+
+    PsycModifier ent[2];
+    PsycPacketFlag flag;
+    PsycBuffer buf;
+    PsycString out;
+    PsycPacket p;
+    char buffer[512];
+    size_t i;
+    psyc_buffer_init(&buf);
+
+    for (i = 0; i < PSYC_NUM_ELEM(tests); i++) {
+	p = PSYC_PACKET(routing, 1, entity, 2, "_message_public", 15,
+			"hi", 2, PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+	// checking must not touch the packet
+	flag = psyc_packet_length_check_policy(&p, &tests[i].policy);
+	if (p.length || p.routinglen || p.contentlen
+	    || p.flag != PSYC_PACKET_CHECK_LENGTH)
+	    return 4;
+	if (psyc_render_append_policy(&p, &buf, &out, &tests[i].policy)
+	    != PSYC_RENDER_SUCCESS)
+	    return 1;
+	if (verbose)
+	    printf("%.*s\n", (int)out.length, out.data);
+	if (out.length != strlen(tests[i].rendered)
+	    || memcmp(out.data, tests[i].rendered, out.length)
+	    || p.flag != flag)
+	    return 2;
+
+	// psyc_render() renders the same with the policy applied at init
+	memcpy(ent, entity, sizeof(ent));
+	psyc_packet_init_policy(&p, routing, 1, ent, 2,
+				PSYC_C2ARG("_message_public"), PSYC_C2ARG("hi"),
+				PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH,
+				&tests[i].policy);
+	if (psyc_render(&p, buffer, sizeof(buffer)) != PSYC_RENDER_SUCCESS
+	    || p.length != out.length || memcmp(buffer, out.data, out.length))
+	    return 5;
+    }
+    psyc_buffer_free(&buf);
+
+    // list elements
+    PsycRenderPolicy policy =
+	PSYC_RENDER_POLICY(100, 100, 100, 4, PSYC_POLICY_RECEIVER_COST);
+    PsycElem elems[] = {
+	PSYC_ELEM_V("foo", 3),
+	PSYC_ELEM_V("barbaz", 6),
+    };
+    PsycList list = {
+	.num_elems = PSYC_NUM_ELEM(elems),
+	.elems = elems,
+    };
+    psyc_list_length_set_policy(&list, &policy);
+    psyc_render_list(&list, buffer, sizeof(buffer));
+    if (verbose)
+	printf("%.*s\n", (int)list.length, buffer);
+    if (list.length != 14 || memcmp(buffer, "| foo|6 barbaz", 14))
+	return 3;
+
+    return 0;
+}
+
+/**
+ * Parse a packet, flagging all entity modifiers to be checked for length.
+ */
+int
+parse_packet (char *buffer, size_t length, PsycPacket *p)
+{
+    PsycParseState state;
+    PsycString name, value;
+    char oper;
+    int ret;
+
+    psyc_parse_state_init(&state, PSYC_PARSE_ALL);
+    psyc_parse_buffer_set(&state, buffer, length);
+
+    for (;;) {
+	ret = psyc_parse(&state, &oper, &name, &value);
+	switch (ret) {
+	case PSYC_PARSE_ROUTING:
+	    p->routing.modifiers[p->routing.lines++] =
+		PSYC_MODIFIER(oper, name, value, PSYC_MODIFIER_ROUTING);
+	    break;
+	case PSYC_PARSE_ENTITY:
+	    p->entity.modifiers[p->entity.lines++] =
+		PSYC_MODIFIER(oper, name, value, PSYC_MODIFIER_CHECK_LENGTH);
+	    break;
+	case PSYC_PARSE_STATE_RESYNC:
+	case PSYC_PARSE_STATE_RESET:
+	    p->stateop = oper;
+	    break;
+	case PSYC_PARSE_BODY:
+	    p->method = name;
+	    p->data = value;
+	    break;
+	case PSYC_PARSE_COMPLETE:
+	    return 0;
+	default:
+	    if (ret < 0 || ret == PSYC_PARSE_INSUFFICIENT
+		|| ret == PSYC_PARSE_ENTITY_START || ret == PSYC_PARSE_BODY_START)
+		return -1;
+	}
+    }
+}
+
+/**
+ * psyc_packet_length_check_policy() and psyc_render_append_policy()
+ * must agree about the content length of the bench packets.
+ */
+int
+test_policy_bench (uint8_t verbose)
+{
+    const char *files[] = {
+	"activity", "activity-c", "chat_msg", "chat_msg-c", "json-unfriendly",
+	"presence", "presence-c", "psyc-unfriendly", "user_profile",
+	"xml-unfriendly",
+    };
+    PsycRenderPolicy policies[] = {
+	PSYC_RENDER_POLICY_DEFAULT,
+	PSYC_RENDER_POLICY(100, 100, 100, 0, PSYC_POLICY_COMPACT),
+	PSYC_RENDER_POLICY(8, 8, 8, 0, PSYC_POLICY_COMPACT),
+	PSYC_RENDER_POLICY(100, 100, 100, 4, PSYC_POLICY_RECEIVER_COST),
+	PSYC_RENDER_POLICY(100, 100, 100, 40, PSYC_POLICY_RECEIVER_COST),
+	PSYC_RENDER_POLICY(1000, 1000, 1000, 200, PSYC_POLICY_RECEIVER_COST),
+	PSYC_RENDER_POLICY_DEFAULT,
+    };
+    PsycModifier routing[64], entity[64];
+    PsycAliasTable aliases;
+    PsycPacketFlag flag;
+    PsycBuffer buf;
+    PsycString out;
+    PsycPacket p;
+    char path[64], data[8192];
+    size_t i, j, len;
+    FILE *f;
+
+    if (psyc_alias_table_init(&aliases, psyc_aliases, psyc_aliases_num)
+	!= PSYC_ALIAS_SUCCESS)
+	return 1;
+    policies[PSYC_NUM_ELEM(policies) - 1].aliases = &aliases;
+
+    psyc_buffer_init(&buf);
+    for (i = 0; i < PSYC_NUM_ELEM(files); i++) {
+	snprintf(path, sizeof(path), "../bench/packets/%s.psyc", files[i]);
+	if (!(f = fopen(path, "r"))) {
+	    perror(path);
+	    return 2;
+	}
+	len = fread(data, 1, sizeof(data), f);
+	fclose(f);
+
+	for (j = 0; j < PSYC_NUM_ELEM(policies); j++) {
+	    p = PSYC_PACKET(routing, 0, entity, 0, NULL, 0, NULL, 0,
+			    PSYC_STATE_NOOP, PSYC_PACKET_CHECK_LENGTH);
+	    if (parse_packet(data, len, &p))
+		return 3;
+
+	    flag = psyc_packet_length_check_policy(&p, &policies[j]);
+	    if (psyc_render_append_policy(&p, &buf, &out, &policies[j])
+		!= PSYC_RENDER_SUCCESS)
+		return 4;
+	    if (verbose)
+		printf(">> %s, policy %zu: %s\n", files[i], j,
+		       flag == PSYC_PACKET_NEED_LENGTH ? "length" : "no length");
+	    if (p.flag != flag)
+		return 5;
+	}
+    }
+    psyc_buffer_free(&buf);
+
+    return 0;
+}
+
+int
+test_list_append (uint8_t verbose)
+{
+    char large[100];
+    memset(large, 'x', sizeof(large));
+    large[90] = '|';
+    large[95] = '{';
+    large[97] = '}';
+
+    PsycString values[] = {
+	PSYC_C2STR("foo"),
+	PSYC_C2STR("b|r"),
+	PSYC_C2STR("b{z}"),
+	PSYC_C2STR(""),
+	PSYC_C2STR("0123456789"),
+	PSYC_STRING(large, 16),
+	PSYC_STRING(large, 40),
+	PSYC_STRING(large, sizeof(large)),
+    };
+    PsycRenderPolicy policies[] = {
+	PSYC_RENDER_POLICY_DEFAULT,
+	PSYC_RENDER_POLICY(1000, 1000, 1000, 0, PSYC_POLICY_COMPACT),
+	PSYC_RENDER_POLICY(1000, 1000, 1000, 2, PSYC_POLICY_RECEIVER_COST),
+    };
+
+    size_t n = PSYC_NUM_ELEM(values), i, j;
+    PsycElem elems[2][PSYC_NUM_ELEM(values)];
+    PsycDictElem delems[2][PSYC_NUM_ELEM(values)];
+    PsycList list[2];
+    PsycDict dict[2];
+    PsycBuffer buf;
+    PsycString out;
+    char buffer[1024];
+
+    psyc_buffer_init(&buf);
+
+    for (i = 0; i < PSYC_NUM_ELEM(policies); i++) {
+	for (j = 0; j < n; j++) {
+	    elems[0][j] = PSYC_ELEM_V(values[j].data, values[j].length);
+	    if (j % 3 == 1)
+		elems[0][j].type = PSYC_C2STR("_type");
+	    if (j == 2)
+		elems[0][j].flag = PSYC_ELEM_NEED_LENGTH;
+	    elems[1][j] = elems[0][j];
+
+	    delems[0][j].key = PSYC_DICT_KEY(values[n - 1 - j].data,
+					     values[n - 1 - j].length,
+					     PSYC_ELEM_CHECK_LENGTH);
+	    delems[0][j].value = elems[0][j];
+	    delems[1][j] = delems[0][j];
+	}
+
+	list[0] = list[1] = (PsycList) {
+	    .type = PSYC_C2STR("_list_test"),
+	    .elems = elems[0],
+	    .num_elems = n,
+	};
+	list[1].elems = elems[1];
+	psyc_list_length_set_policy(&list[0], &policies[i]);
+	psyc_render_list(&list[0], buffer, sizeof(buffer));
+
+	if (psyc_render_list_append(&list[1], &buf, &out, &policies[i])
+	    != PSYC_RENDER_SUCCESS)
+	    return 1;
+	if (verbose)
+	    printf("%.*s\n", (int)out.length, out.data);
+	if (out.length != list[0].length || list[1].length != list[0].length
+	    || memcmp(out.data, buffer, out.length))
+	    return 2;
+	for (j = 0; j < n; j++)
+	    if (elems[0][j].flag != elems[1][j].flag
+		|| elems[0][j].length != elems[1][j].length)
+		return 3;
+
+	dict[0] = dict[1] = (PsycDict) {
+	    .elems = delems[0],
+	    .num_elems = n,
+	};
+	dict[1].elems = delems[1];
+	psyc_dict_length_set_policy(&dict[0], &policies[i]);
+	psyc_render_dict(&dict[0], buffer, sizeof(buffer));
+
+	if (psyc_render_dict_append(&dict[1], &buf, &out, &policies[i])
+	    != PSYC_RENDER_SUCCESS)
+	    return 4;
+	if (verbose)
+	    printf("%.*s\n", (int)out.length, out.data);
+	if (out.length != dict[0].length || dict[1].length != dict[0].length
+	    || memcmp(out.data, buffer, out.length))
+	    return 5;
+	for (j = 0; j < n; j++)
+	    if (delems[0][j].key.flag != delems[1][j].key.flag
+		|| delems[0][j].key.length != delems[1][j].key.length
+		|| delems[0][j].value.flag != delems[1][j].value.flag
+		|| delems[0][j].value.length != delems[1][j].value.length)
+		return 6;
+    }
+
+    psyc_buffer_free(&buf);
+    return 0;
+}
+
 int
 main (int argc, char **argv)
 {
@@ -122,6 +838,30 @@ list test\n\
 |\n", verbose))
 	return 2;
 
+    if (test_fanout(verbose))
+	return 3;
+
+    if (test_iov(verbose))
+	return 4;
+
+    if (test_stream(verbose))
+	return 5;
+
+    if (test_utoa(verbose))
+	return 6;
+
+    if (test_append(verbose))
+	return 7;
+
+    if (test_policy(verbose))
+	return 8;
+
+    if (test_list_append(verbose))
+	return 9;
+
+    if (test_policy_bench(verbose))
+	return 10;
+
     puts("psyc_render passed all tests.");
 
     return 0;
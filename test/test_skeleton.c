@@ -0,0 +1,123 @@
+#include <stdio.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+#define myUNI	"psyc://10.100.1000/~ludwig"
+
+uint8_t verbose;
+
+/**
+ * Render a packet from the skeleton and compare it with one rendered from
+ * scratch with the same values.
+ */
+int
+test_values (PsycSkeleton *skel, const char *counter, const char *target,
+	     const char *place, const char *data, PsycPacketFlag flag)
+{
+    PsycModifier routing[3], entity[2];
+    PsycString values[3] = {
+	PSYC_STRING((char *)counter, strlen(counter)),
+	PSYC_STRING((char *)target, strlen(target)),
+	PSYC_STRING((char *)place, strlen(place)),
+    };
+
+    psyc_modifier_init(&routing[0], PSYC_OPERATOR_SET, PSYC_C2ARG("_context"),
+		       PSYC_C2ARG(myUNI), PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&routing[1], PSYC_OPERATOR_SET, PSYC_C2ARG("_counter"),
+		       PSYC_S2ARG(values[0]), PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&routing[2], PSYC_OPERATOR_SET, PSYC_C2ARG("_target"),
+		       PSYC_S2ARG(values[1]), PSYC_MODIFIER_ROUTING);
+    psyc_modifier_init(&entity[0], PSYC_OPERATOR_SET, PSYC_C2ARG("_nick"),
+		       PSYC_C2ARG("ludwig"), PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&entity[1], PSYC_OPERATOR_SET, PSYC_C2ARG("_time_place"),
+		       PSYC_S2ARG(values[2]), PSYC_MODIFIER_CHECK_LENGTH);
+
+    PsycPacket packet;
+    psyc_packet_init(&packet, routing, 3, entity, 2,
+		     PSYC_C2ARG("_message_public"), (char *)data, strlen(data),
+		     PSYC_STATE_NOOP, flag);
+
+    char ref[512], buffer[512];
+    size_t len;
+    if (psyc_render(&packet, ref, sizeof(ref)) != PSYC_RENDER_SUCCESS)
+	return 1;
+
+    if (!skel->data) {
+	static PsycString names[] = {
+	    PSYC_C2STRI("_counter"),
+	    PSYC_C2STRI("_target"),
+	    PSYC_C2STRI("_time_place"),
+	};
+	static PsycSkeletonField fields[3];
+	static char skelbuf[512];
+	if (psyc_skeleton_init(skel, &packet, names, 3, fields,
+			       skelbuf, sizeof(skelbuf))
+	    != PSYC_SKELETON_SUCCESS)
+	    return 2;
+    }
+
+    if (psyc_skeleton_render(skel, values, buffer, sizeof(buffer), &len)
+	!= PSYC_RENDER_SUCCESS)
+	return 3;
+
+    if (verbose)
+	printf("%.*s\n", (int)len, buffer);
+    if (len != packet.length || memcmp(buffer, ref, len))
+	return 4;
+
+    if (psyc_skeleton_render(skel, values, buffer, len - 1, &len)
+	!= PSYC_RENDER_ERROR)
+	return 5;
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    verbose = argc > 1;
+    PsycSkeleton skel = {0};
+    int ret;
+
+    const char *data = "Hello there, how are you?";
+
+    // template with a content length
+    if ((ret = test_values(&skel, "10", "psyc://example.net/~a", "1",
+			   data, PSYC_PACKET_CHECK_LENGTH)))
+	return ret;
+    // same widths, copy & store
+    if ((ret = test_values(&skel, "11", "psyc://example.net/~b", "2",
+			   data, PSYC_PACKET_CHECK_LENGTH)))
+	return 10 + ret;
+    // wider routing variable
+    if ((ret = test_values(&skel, "1000", "psyc://example.net/~bob", "3",
+			   data, PSYC_PACKET_CHECK_LENGTH)))
+	return 20 + ret;
+    // entity variable needs a length, content length changes
+    if ((ret = test_values(&skel, "7", "psyc://example.net/~b",
+			   "somewhere over the rainbow",
+			   data, PSYC_PACKET_CHECK_LENGTH)))
+	return 30 + ret;
+    // value with a newline
+    if ((ret = test_values(&skel, "12", "psyc://example.net/~b", "a\nb",
+			   data, PSYC_PACKET_CHECK_LENGTH)))
+	return 40 + ret;
+
+    // template without a content length
+    PsycSkeleton small = {0};
+    if ((ret = test_values(&small, "1", "psyc://example.net/~a", "1",
+			   "hi", PSYC_PACKET_CHECK_LENGTH)))
+	return 50 + ret;
+    if ((ret = test_values(&small, "2", "psyc://example.net/~abc", "2",
+			   "hi", PSYC_PACKET_CHECK_LENGTH)))
+	return 60 + ret;
+    // entity variable needs a length, content length is added
+    if ((ret = test_values(&small, "3", "psyc://example.net/~a",
+			   "somewhere over the rainbow",
+			   "hi", PSYC_PACKET_CHECK_LENGTH)))
+	return 70 + ret;
+
+    puts("psyc_skeleton passed all tests.");
+    return 0;
+}
@@ -35,9 +35,69 @@ getValueNotFound (void *cls, const char *name, size_t len, PsycString *value)
     return PSYC_TEXT_VALUE_NOT_FOUND;
 }
 
+PsycTextValueRC
+getValueSpecial (void *cls, const char *name, size_t len, PsycString *value)
+{
+    if (verbose)
+	printf("> getValue: %.*s\n", (int)len, name);
+    *value = PSYC_C2STR("<b>Tom & \"Jerry\"</b>\n\x01 \xc3\xa4 it's");
+    return PSYC_TEXT_VALUE_FOUND;
+}
+
+/**
+ * Fill out a template with getValueSpecial, escaped.
+ */
+int
+testEscape (PsycTextEscape escape, const char *expected)
+{
+    char *str = "x [_foo] y";
+    size_t len = strlen(str), explen = strlen(expected);
+    char buffer[BUFSIZE], scratch[BUFSIZE];
+    PsycTextState state;
+    PsycTextTemplate tmpl;
+    PsycTextVar vars[1];
+    struct iovec iov[3];
+    size_t num, i, length = 0;
+
+    psyc_text_state_init(&state, str, len, buffer, BUFSIZE);
+    psyc_text_escape_set(&state, escape);
+    if (psyc_text(&state, getValueSpecial, NULL) != PSYC_TEXT_COMPLETE
+	|| state.written != explen || memcmp(buffer, expected, explen))
+	return 1;
+
+    psyc_text_compile(&tmpl, str, len, PSYC_C2ARG("["), PSYC_C2ARG("]"),
+		      vars, 1);
+    psyc_text_state_init(&state, NULL, 0, buffer, explen - 3);
+    psyc_text_escape_set(&state, escape);
+    if (psyc_text_compiled(&state, &tmpl, getValueSpecial, NULL)
+	!= PSYC_TEXT_INCOMPLETE || state.written != 2)
+	return 2;
+    psyc_text_buffer_set(&state, buffer + 2, BUFSIZE - 2);
+    if (psyc_text_compiled(&state, &tmpl, getValueSpecial, NULL)
+	!= PSYC_TEXT_COMPLETE || state.written != explen - 2
+	|| memcmp(buffer, expected, explen))
+	return 3;
+
+    psyc_text_state_init(&state, NULL, 0, scratch, BUFSIZE);
+    psyc_text_escape_set(&state, escape);
+    if (psyc_text_iov(&state, &tmpl, getValueSpecial, NULL, iov, 3, &num)
+	!= PSYC_TEXT_COMPLETE || num != 3 || state.written != explen)
+	return 4;
+    for (i = 0; i < num; i++) {
+	memcpy(buffer + length, iov[i].iov_base, iov[i].iov_len);
+	length += iov[i].iov_len;
+    }
+    if (length != explen || memcmp(buffer, expected, explen))
+	return 5;
+    if (escape && iov[1].iov_base != scratch)
+	return 6;
+
+    return 0;
+}
+
 int
 testText (char *template, size_t tmplen, char *buffer, size_t buflen,
-	  PsycString *result, PsycTextCB getValue)
+	  PsycString *result, PsycTextCB getValue, const PsycTextTemplate *t)
 {
     PsycTextState state;
     size_t length = 0;
@@ -45,7 +105,8 @@ testText (char *template, size_t tmplen, char *buffer, size_t buflen,
 
     psyc_text_state_init(&state, template, tmplen, buffer, buflen);
     do {
-	ret = psyc_text(&state, getValue, NULL);
+	ret = t ? psyc_text_compiled(&state, t, getValue, NULL)
+	    : psyc_text(&state, getValue, NULL);
 	length += psyc_text_bytes_written(&state);
 	switch (ret) {
 	case PSYC_TEXT_INCOMPLETE:
@@ -79,26 +140,186 @@ main (int argc, char **argv)
 
     char *str = "Hello [_foo] & [_bar]!";
     size_t len = strlen(str);
-    int i;
+    int i, j, ret;
 
-    testText(str, len, buffer, BUFSIZE, &result, &getValueFooBar);
+    testText(str, len, buffer, BUFSIZE, &result, &getValueFooBar, NULL);
     if (memcmp(result.data, PSYC_C2ARG("Hello Foo Bar & Foo Bar!")))
 	return 1;
 
-    testText(str, len, buffer, BUFSIZE, &result, &getValueEmpty);
+    testText(str, len, buffer, BUFSIZE, &result, &getValueEmpty, NULL);
     if (memcmp(result.data, PSYC_C2ARG("Hello  & !")))
 	return 2;
 
     if (PSYC_TEXT_NO_SUBST != testText(str, len, buffer, BUFSIZE,
-				       &result, &getValueNotFound))
+				       &result, &getValueNotFound, NULL))
 	return 3;
 
     for (i = 1; i < 22; i++) {
-	testText(str, len, buffer, i, &result, &getValueFooBar);
+	testText(str, len, buffer, i, &result, &getValueFooBar, NULL);
 	if (memcmp(result.data, PSYC_C2ARG("Hello Foo Bar & Foo Bar!")))
 	    return 10 + i;
     }
 
+    PsycTextTemplate tmpl;
+    PsycTextVar vars[4];
+    if (psyc_text_compile(&tmpl, str, len, PSYC_C2ARG("["), PSYC_C2ARG("]"),
+			  vars, 4) != 2)
+	return 4;
+    if (psyc_text_compile(&tmpl, str, len, PSYC_C2ARG("["), PSYC_C2ARG("]"),
+			  vars, 1) != -1)
+	return 5;
+    psyc_text_compile(&tmpl, str, len, PSYC_C2ARG("["), PSYC_C2ARG("]"),
+		      vars, 4);
+
+    testText(str, len, buffer, BUFSIZE, &result, &getValueFooBar, &tmpl);
+    if (memcmp(result.data, PSYC_C2ARG("Hello Foo Bar & Foo Bar!")))
+	return 6;
+
+    testText(str, len, buffer, BUFSIZE, &result, &getValueEmpty, &tmpl);
+    if (memcmp(result.data, PSYC_C2ARG("Hello  & !")))
+	return 7;
+
+    if (PSYC_TEXT_NO_SUBST != testText(str, len, buffer, BUFSIZE,
+				       &result, &getValueNotFound, &tmpl))
+	return 8;
+
+    for (i = 1; i < 22; i++) {
+	testText(str, len, buffer, i, &result, &getValueFooBar, &tmpl);
+	if (memcmp(result.data, PSYC_C2ARG("Hello Foo Bar & Foo Bar!")))
+	    return 40 + i;
+    }
+
+    // segments instead of a copy
+    struct iovec iov[5];
+    size_t num, length;
+    PsycTextState state;
+
+    for (i = 1; i <= 5; i++) {
+	PsycTextRC ret;
+	length = 0;
+	psyc_text_state_init(&state, NULL, 0, NULL, 0);
+	do {
+	    ret = psyc_text_iov(&state, &tmpl, &getValueFooBar, NULL,
+				iov, i, &num);
+	    if (num > (size_t)i)
+		return 50 + i;
+	    for (j = 0; j < num; j++) {
+		memcpy(buffer + length, iov[j].iov_base, iov[j].iov_len);
+		length += iov[j].iov_len;
+	    }
+	} while (ret == PSYC_TEXT_INCOMPLETE);
+
+	if (ret != PSYC_TEXT_COMPLETE || length != 24
+	    || memcmp(buffer, PSYC_C2ARG("Hello Foo Bar & Foo Bar!")))
+	    return 55 + i;
+    }
+    if (PSYC_TEXT_IOV(&tmpl) != 5
+	|| iov[0].iov_base != str || iov[4].iov_base != str + len - 1)
+	return 61;
+
+    // empty values are left out
+    psyc_text_state_init(&state, NULL, 0, NULL, 0);
+    if (psyc_text_iov(&state, &tmpl, &getValueEmpty, NULL, iov, 5, &num)
+	!= PSYC_TEXT_COMPLETE || num != 3 || psyc_text_bytes_written(&state) != 10)
+	return 62;
+    psyc_text_state_init(&state, NULL, 0, NULL, 0);
+    if (psyc_text_iov(&state, &tmpl, &getValueNotFound, NULL, iov, 5, &num)
+	!= PSYC_TEXT_NO_SUBST || num != 0)
+	return 63;
+
+    // empty & unterminated names are left as is
+    char *str2 = "[] [_foo] [] x [_bar";
+    size_t len2 = strlen(str2);
+    PsycString result2;
+    char buffer2[BUFSIZE];
+    if (psyc_text_compile(&tmpl, str2, len2, PSYC_C2ARG("["), PSYC_C2ARG("]"),
+			  vars, 4) != 1)
+	return 9;
+    testText(str2, len2, buffer, BUFSIZE, &result, &getValueFooBar, NULL);
+    testText(str2, len2, buffer2, BUFSIZE, &result2, &getValueFooBar, &tmpl);
+    if (result.length != result2.length
+	|| memcmp(result.data, result2.data, result.length))
+	return 70;
+
+    const PsycTextTemplate *ct = psyc_template_compiled(PSYC_MC_NOTICE_ALIAS_CHANGE);
+    if (ct->num_vars != 2 || ct != psyc_template_compiled(PSYC_MC_NOTICE_ALIAS_CHANGE)
+	|| memcmp(ct->vars[1].name.data, PSYC_C2ARG("_nick_new")))
+	return 71;
+    testText((char *) ct->tmpl.data, ct->tmpl.length, buffer, BUFSIZE,
+	     &result, &getValueFooBar, ct);
+    if (memcmp(result.data, PSYC_C2ARG("Foo Bar is now known as Foo Bar")))
+	return 72;
+
+    // values from an indexed header
+    PsycModifier mods[3];
+    psyc_modifier_init(&mods[0], PSYC_OPERATOR_SET, PSYC_C2ARG("_nick"),
+		       PSYC_C2ARG("alice"), PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&mods[1], PSYC_OPERATOR_SET, PSYC_C2ARG("_uniform"),
+		       PSYC_C2ARG("psyc://example.net/~alice"),
+		       PSYC_MODIFIER_CHECK_LENGTH);
+    psyc_modifier_init(&mods[2], PSYC_OPERATOR_SET, PSYC_C2ARG("_nick"),
+		       PSYC_C2ARG("bob"), PSYC_MODIFIER_CHECK_LENGTH);
+    PsycHeader header = {3, mods};
+    PsycTextIndex idx;
+
+    if (!psyc_text_index_init(&idx, &header))
+	return 80;
+    if (psyc_text_index_get(&idx, PSYC_C2ARG("_nick"), PSYC_FALSE) != &mods[2]
+	|| psyc_text_index_get(&idx, PSYC_C2ARG("_uniform"), PSYC_FALSE) != &mods[1]
+	|| psyc_text_index_get(&idx, PSYC_C2ARG("_nick_place"), PSYC_FALSE)
+	|| psyc_text_index_get(&idx, PSYC_C2ARG("_nick_place"), PSYC_TRUE) != &mods[2]
+	|| psyc_text_index_get(&idx, PSYC_C2ARG("_place"), PSYC_TRUE))
+	return 81;
+
+    ct = psyc_template_compiled(PSYC_MC_NOTICE_CONTEXT_ENTER);
+    psyc_text_state_init(&state, NULL, 0, buffer, BUFSIZE);
+    if (psyc_text_header(&state, ct, &idx, PSYC_FALSE) != PSYC_TEXT_COMPLETE
+	|| memcmp(buffer, PSYC_C2ARG("bob enters [_nick_place]")))
+	return 82;
+
+    for (i = 1; i < 16; i++) {
+	size_t length = 0;
+	PsycTextRC ret;
+	psyc_text_state_init(&state, NULL, 0, buffer, i);
+	while ((ret = psyc_text_header(&state, ct, &idx, PSYC_TRUE))
+	       == PSYC_TEXT_INCOMPLETE) {
+	    length += psyc_text_bytes_written(&state);
+	    psyc_text_buffer_set(&state, buffer + length, BUFSIZE - length);
+	}
+	length += psyc_text_bytes_written(&state);
+	if (ret != PSYC_TEXT_COMPLETE || length != 14
+	    || memcmp(buffer, PSYC_C2ARG("bob enters bob")))
+	    return 90 + i;
+    }
+
+    psyc_text_state_init(&state, NULL, 0, NULL, 0);
+    if (psyc_text_header_iov(&state, ct, &idx, PSYC_TRUE, iov, 5, &num)
+	!= PSYC_TEXT_COMPLETE || num != 3 || iov[0].iov_base != mods[2].value.data
+	|| iov[2].iov_base != mods[2].value.data
+	|| psyc_text_bytes_written(&state) != 14)
+	return 84;
+
+    header.lines = 0;
+    psyc_text_index_init(&idx, &header);
+    psyc_text_state_init(&state, NULL, 0, buffer, BUFSIZE);
+    if (psyc_text_header(&state, ct, &idx, PSYC_TRUE) != PSYC_TEXT_NO_SUBST)
+	return 83;
+
+    // escaped values
+    if ((ret = testEscape(PSYC_TEXT_ESCAPE_NONE,
+			  "x <b>Tom & \"Jerry\"</b>\n\x01 \xc3\xa4 it's y")))
+	return 100 + ret;
+    if ((ret = testEscape(PSYC_TEXT_ESCAPE_HTML,
+			  "x &lt;b&gt;Tom &amp; &quot;Jerry&quot;&lt;/b&gt;\n\x01 "
+			  "\xc3\xa4 it&#39;s y")))
+	return 110 + ret;
+    if ((ret = testEscape(PSYC_TEXT_ESCAPE_JSON,
+			  "x <b>Tom & \\\"Jerry\\\"</b>\\n\\u0001 \xc3\xa4 it's y")))
+	return 120 + ret;
+    if ((ret = testEscape(PSYC_TEXT_ESCAPE_IRC,
+			  "x <b>Tom & \"Jerry\"</b> \x01 \xc3\xa4 it's y")))
+	return 130 + ret;
+
     size_t tlen = 0;
     const char *t = psyc_template(PSYC_MC_NOTICE_CONTEXT_ENTER, &tlen);
     printf("_notice_context_enter = %s, %ld\n", t, tlen);
@@ -0,0 +1,121 @@
+#if !defined(_GNU_SOURCE) && !defined(_XOPEN_SOURCE)
+# define _XOPEN_SOURCE 700 // mkstemp()
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+uint8_t verbose;
+
+PsycTemplatePackEntry entries[] = {
+    { PSYC_C2STRI("_echo_context_enter"),	PSYC_C2STRI("Du betrittst [_nick_place].") },
+    { PSYC_C2STRI("_notice_context_enter"),	PSYC_C2STRI("[_nick] betritt [_nick_place].") },
+    { PSYC_C2STRI("_notice_custom"),		PSYC_C2STRI("[_nick] macht etwas.") },
+    { PSYC_C2STRI("_notice_empty"),		PSYC_C2STRI("") },
+};
+
+int
+test_pack (PsycTemplatePack *pack)
+{
+    const char *t;
+    size_t len;
+
+    if (pack->lang.length != 2 || memcmp(pack->lang.data, "de", 2))
+	return 1;
+
+    t = psyc_tpack_template(pack, PSYC_MC_NOTICE_CONTEXT_ENTER, &len);
+    if (!t || len != entries[1].tmpl.length || strcmp(t, entries[1].tmpl.data))
+	return 2;
+    if (psyc_tpack_template(pack, PSYC_MC_NOTICE_CONTEXT_LEAVE, &len)
+	|| psyc_tpack_template(pack, PSYC_METHODS_NUM, &len))
+	return 3;
+
+    t = psyc_tpack_lookup(pack, PSYC_C2ARG("_notice_custom"), &len);
+    if (!t || len != entries[2].tmpl.length || strcmp(t, entries[2].tmpl.data))
+	return 4;
+    t = psyc_tpack_lookup(pack, PSYC_C2ARG("_notice_empty"), &len);
+    if (!t || len != 0)
+	return 5;
+    if (psyc_tpack_lookup(pack, PSYC_C2ARG("_notice"), &len)
+	|| psyc_tpack_lookup(pack, PSYC_C2ARG("_zzz"), &len)
+	|| psyc_tpack_lookup(pack, PSYC_C2ARG("_a"), &len))
+	return 6;
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    verbose = argc > 1;
+    size_t num = PSYC_NUM_ELEM(entries), size;
+    PsycTemplatePack pack, mapped;
+    uint32_t *buffer;
+    char path[] = "/tmp/test_tpack.XXXXXX";
+    int ret, fd;
+
+    size = psyc_tpack_build(NULL, 0, PSYC_C2ARG("de"), entries, num);
+    if (!size)
+	return 1;
+    buffer = malloc(size);
+    if (psyc_tpack_build((char *) buffer, size - 1, PSYC_C2ARG("de"),
+			 entries, num) != size
+	|| psyc_tpack_build((char *) buffer, size, PSYC_C2ARG("de"),
+			    entries, num) != size)
+	return 2;
+
+    if (psyc_tpack_load(&pack, (char *) buffer, size) != PSYC_TPACK_SUCCESS)
+	return 3;
+    if ((ret = test_pack(&pack)))
+	return 10 + ret;
+
+    // single entry, no entries, duplicates
+    if (psyc_tpack_build(NULL, 0, PSYC_C2ARG("de"), entries + 1, 1) == 0
+	|| psyc_tpack_build(NULL, 0, PSYC_C2ARG("de"), entries + 2, 0) == 0)
+	return 4;
+    PsycTemplatePackEntry dup[] = { entries[1], entries[0] };
+    if (psyc_tpack_build(NULL, 0, PSYC_C2ARG("de"), dup, 2) != 0)
+	return 5;
+
+    // truncated & corrupt packs
+    if (psyc_tpack_load(&pack, (char *) buffer, size - 1)
+	!= PSYC_TPACK_ERROR_FORMAT)
+	return 6;
+    ((char *) buffer)[size - 1] = 'x';
+    if (psyc_tpack_load(&pack, (char *) buffer, size)
+	!= PSYC_TPACK_ERROR_FORMAT)
+	return 7;
+    ((char *) buffer)[size - 1] = '\0';
+    ((char *) buffer)[0] = 'X';
+    if (psyc_tpack_load(&pack, (char *) buffer, size)
+	!= PSYC_TPACK_ERROR_FORMAT)
+	return 8;
+    ((char *) buffer)[0] = 'P';
+
+    // mapped from a file
+    if ((fd = mkstemp(path)) < 0 || write(fd, buffer, size) != (ssize_t)size)
+	return 9;
+    close(fd);
+    ret = psyc_tpack_open(&mapped, path);
+    unlink(path);
+    if (ret != PSYC_TPACK_SUCCESS)
+	return 20;
+    if ((ret = test_pack(&mapped)))
+	return 30 + ret;
+
+    if (psyc_tpack_current() || psyc_tpack_swap(&pack) != NULL
+	|| psyc_tpack_swap(&mapped) != &pack || psyc_tpack_current() != &mapped)
+	return 40;
+
+    psyc_tpack_close(psyc_tpack_swap(NULL));
+    if (psyc_tpack_open(&mapped, path) != PSYC_TPACK_ERROR)
+	return 41;
+
+    free(buffer);
+    puts("psyc_tpack passed all tests.");
+    return 0;
+}
@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <lib.h>
+#include <psyc.h>
+
+uint8_t verbose;
+
+int
+test_window ()
+{
+    PsycWindow w;
+    psyc_window_init(&w);
+
+    if (psyc_window_update(&w, 10) != PSYC_WINDOW_IN_ORDER) return 1;
+    if (psyc_window_update(&w, 11) != PSYC_WINDOW_IN_ORDER) return 2;
+    if (psyc_window_update(&w, 11) != PSYC_WINDOW_DUPLICATE) return 3;
+    if (psyc_window_update(&w, 14) != PSYC_WINDOW_GAP) return 4;
+    if (psyc_window_update(&w, 12) != PSYC_WINDOW_LATE) return 5;
+    if (psyc_window_update(&w, 12) != PSYC_WINDOW_DUPLICATE) return 6;
+    if (psyc_window_update(&w, 10) != PSYC_WINDOW_DUPLICATE) return 7;
+    if (psyc_window_update(&w, 13) != PSYC_WINDOW_LATE) return 8;
+    if (psyc_window_update(&w, 100) != PSYC_WINDOW_GAP) return 9;
+    if (psyc_window_update(&w, 14) != PSYC_WINDOW_TOO_OLD) return 10;
+    if (psyc_window_update(&w, 37) != PSYC_WINDOW_LATE) return 11;
+
+    return 0;
+}
+
+int
+test_reorder ()
+{
+    void *slots[4];
+    char *pkts[] = {"0", "1", "2", "3", "4", "5", "6", "7"};
+    PsycReorder r;
+    psyc_reorder_init(&r, slots, PSYC_NUM_ELEM(slots));
+
+    if (psyc_reorder_push(&r, 0, pkts[0]) != PSYC_REORDER_DELIVER) return 21;
+    if (psyc_reorder_pop(&r)) return 22;
+    if (psyc_reorder_push(&r, 2, pkts[2]) != PSYC_REORDER_BUFFERED) return 23;
+    if (psyc_reorder_push(&r, 3, pkts[3]) != PSYC_REORDER_BUFFERED) return 24;
+    if (psyc_reorder_push(&r, 3, pkts[3]) != PSYC_REORDER_DUPLICATE) return 25;
+    if (psyc_reorder_push(&r, 5, pkts[5]) != PSYC_REORDER_OVERFLOW) return 26;
+    if (psyc_reorder_push(&r, 1, pkts[1]) != PSYC_REORDER_DELIVER) return 27;
+    if (psyc_reorder_pop(&r) != pkts[2]) return 28;
+    if (psyc_reorder_pop(&r) != pkts[3]) return 29;
+    if (psyc_reorder_pop(&r)) return 30;
+    if (psyc_reorder_push(&r, 0, pkts[0]) != PSYC_REORDER_DUPLICATE) return 31;
+
+    // 4 is lost
+    if (psyc_reorder_push(&r, 6, pkts[6]) != PSYC_REORDER_BUFFERED) return 32;
+    if (psyc_reorder_push(&r, 5, pkts[5]) != PSYC_REORDER_BUFFERED) return 33;
+    if (psyc_reorder_pop(&r)) return 34;
+    if (psyc_reorder_skip(&r) != 1) return 35;
+    if (psyc_reorder_pop(&r) != pkts[5]) return 36;
+    if (psyc_reorder_pop(&r) != pkts[6]) return 37;
+    if (r.pending || psyc_reorder_skip(&r)) return 38;
+
+    return 0;
+}
+
+int
+test_table ()
+{
+    size_t i, n = 1000;
+    char ctx[32], src[32];
+    PsycWindowEntry entries[2048], *e, *f;
+    PsycWindowTable t;
+    const uint8_t key[PSYC_WINDOW_KEY_SIZE] = "0123456789abcdef";
+    psyc_window_table_init(&t, entries, PSYC_NUM_ELEM(entries), key);
+
+    PsycList id;
+    PsycElem elems[PSYC_PACKET_ID_ELEMS];
+    memset(elems, 0, sizeof(elems));
+    psyc_packet_id(&id, elems, PSYC_C2ARG("psyc://example.net/@bar"),
+		   PSYC_C2ARG("psyc://example.net/~alice"), NULL, 0,
+		   PSYC_C2ARG("1337"), NULL, 0);
+
+    if (psyc_window_table_update_id(&t, &id, &e) != PSYC_WINDOW_IN_ORDER)
+	return 41;
+    if (psyc_window_table_update_id(&t, &id, &f) != PSYC_WINDOW_DUPLICATE
+	|| e != f)
+	return 42;
+
+    for (i = 0; i < n; i++) {
+	snprintf(ctx, sizeof(ctx), "psyc://example.net/@%zu", i);
+	snprintf(src, sizeof(src), "psyc://example.net/~%zu", i % 7);
+	e = psyc_window_table_get(&t, ctx, strlen(ctx), src, strlen(src));
+	if (!e || psyc_window_update(&e->window, i) != PSYC_WINDOW_IN_ORDER)
+	    return 43;
+    }
+    if (t.used != n + 1)
+	return 44;
+
+    for (i = 0; i < n; i += 2) {
+	snprintf(ctx, sizeof(ctx), "psyc://example.net/@%zu", i);
+	snprintf(src, sizeof(src), "psyc://example.net/~%zu", i % 7);
+	e = psyc_window_table_get(&t, ctx, strlen(ctx), src, strlen(src));
+	psyc_window_table_remove(&t, e);
+    }
+    if (t.used != n / 2 + 1)
+	return 45;
+
+    for (i = 1; i < n; i += 2) {
+	snprintf(ctx, sizeof(ctx), "psyc://example.net/@%zu", i);
+	snprintf(src, sizeof(src), "psyc://example.net/~%zu", i % 7);
+	e = psyc_window_table_get(&t, ctx, strlen(ctx), src, strlen(src));
+	if (psyc_window_update(&e->window, i) != PSYC_WINDOW_DUPLICATE)
+	    return 46;
+    }
+    if (t.used != n / 2 + 1)
+	return 47;
+
+    // pairs that only differ in where the context ends get their own windows
+    e = psyc_window_table_get(&t, PSYC_C2ARG("a|"), PSYC_C2ARG("b"));
+    f = psyc_window_table_get(&t, PSYC_C2ARG("a"), PSYC_C2ARG("|b"));
+    if (!e || !f || e == f)
+	return 48;
+
+    return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+    int ret;
+    verbose = argc > 1;
+
+    if ((ret = test_window()) || (ret = test_reorder()) || (ret = test_table()))
+	return ret;
+
+    puts("psyc_window passed all tests.");
+    return 0;
+}